@@ -109,6 +109,36 @@ bil.read.file <- function (model, file_name, input_vars = c("P", "R", "T", "H",
         stop(err)
 }
 
+#' Data input from a binary file
+#'
+#' Loads initial date, catchment area and observed data from a binary columnar file written by \code{\link{bil.write.binary}}.
+#'
+#' @param model pointer to model instance
+#' @param file_name input file name
+#' @details The file is memory-mapped (where the system allows it) and values are copied without parsing,
+#'   so loading is much faster than from a text file by \code{\link{bil.read.file}}.
+#'   Variables are identified by names stored in the file. An error occurs if the file was written for other type of model
+#'   (daily or monthly) or on a machine with different byte order.
+#' @seealso \code{\link{bil.write.binary}} for writing to a binary file, \code{\link{bil.read.file}} for text files
+#' @export
+#' @examples
+#' b = bil.new("m")
+#' bil.set.values(b, init_date = "1990-11-01", input_vars =
+#'   data.frame(P = c(42, 48, 53, 66, 46, 26, 149, 50, 75, 33, 55, 36),
+#'   R = c(23, 16, 28, 26, 40, 78, 62, 27, 16, 11, 12, 18),
+#'   T = c(1.7, -4.6, -2.9, -3.7, -2.9, 7.3, 8.7, 12.4, 13.8, 15.7, 10.8, 6.9)))
+#' file_name = tempfile(fileext = ".bin")
+#' bil.write.binary(b, file_name)
+#' b2 = bil.new("m")
+#' bil.read.binary(b2, file_name)
+#' bil.get.values(b2)
+bil.read.binary <- function (model, file_name) {
+    err = .Call("read_binary", check.model(model), as.character(file_name), PACKAGE = "bilan")
+
+    if (err != "")
+        stop(err)
+}
+
 #' Input variable settings
 #'
 #' Sets time-series of (input) variables and initial date.
@@ -200,6 +230,31 @@ bil.write.file <- function (model, file_name, type = "series") {
         stop(err)
 }
 
+#' Data output to a binary file
+#'
+#' Writes initial date, catchment area and input variables of the model into a binary columnar file.
+#'
+#' @param model pointer to model instance
+#' @param file_name output file name
+#' @details The file begins with a header (initial date, model type, number of time steps and variables, catchment area)
+#'   followed by names of variables and contiguous columns of double precision values, all in native byte order.
+#'   It can be read by \code{\link{bil.read.binary}}.
+#' @seealso \code{\link{bil.read.binary}}
+#' @export
+#' @examples
+#' b = bil.new("m")
+#' bil.set.values(b, init_date = "1990-11-01", input_vars =
+#'   data.frame(P = c(42, 48, 53, 66, 46, 26, 149, 50, 75, 33, 55, 36),
+#'   R = c(23, 16, 28, 26, 40, 78, 62, 27, 16, 11, 12, 18),
+#'   T = c(1.7, -4.6, -2.9, -3.7, -2.9, 7.3, 8.7, 12.4, 13.8, 15.7, 10.8, 6.9)))
+#' bil.write.binary(b, tempfile(fileext = ".bin"))
+bil.write.binary <- function (model, file_name) {
+    err = .Call("write_binary", check.model(model), as.character(file_name), PACKAGE = "bilan")
+
+    if (err != "")
+        stop(err)
+}
+
 #' @name bil.set.params
 #' @rdname bil.set.params
 bil.set.params.init <- function (model, params) {
@@ -437,6 +492,34 @@ bil.run <- function (model, file = NULL, var_names = NULL, data = NULL, init_GS
     }
 }
 
+#' Check of working precision
+#'
+#' Runs model in the working precision of the simulation core and in long double precision on the same inputs
+#'   and compares the results.
+#'
+#' @param model pointer to model instance
+#' @param init_GS initial groundwater storage
+#' @return A list containing name of working floating-point type (\code{real_type}), its number of binary digits
+#'   (\code{digits}) and a named vector of maximum absolute deviations of variables from the long double run (\code{max_dev}).
+#' @details The working precision is given at compile time (\code{-DBIL_REAL=double} or \code{float} in \code{PKG_CPPFLAGS}),
+#'   long double is used by default and deviations are zero then. Model variables are overwritten by the working precision run.
+#' @export
+#' @examples
+#' b = bil.new("m")
+#' bil.set.values(b, init_date = "1990-11-01", input_vars =
+#'   data.frame(P = c(42, 48, 53, 66, 46, 26, 149, 50, 75, 33, 55, 36),
+#'   R = c(23, 16, 28, 26, 40, 78, 62, 27, 16, 11, 12, 18),
+#'   T = c(1.7, -4.6, -2.9, -3.7, -2.9, 7.3, 8.7, 12.4, 13.8, 15.7, 10.8, 6.9)))
+#' bil.pet(b)
+#' bil.check.precision(b)
+bil.check.precision <- function (model, init_GS = 50) {
+    resul = .Call("check_precision", check.model(model), init_GS, PACKAGE = "bilan")
+    if (class(resul) == "character")
+        stop(resul)
+    else
+        return(resul)
+}
+
 #' Optimization procedure
 #'
 #' Optimizes model parameters according to observed data by using selected algorithm (a two-step gradient procedure or combined
@@ -466,6 +549,47 @@ bil.optimize <- function (model) {
         return(bil.get.values(model)$vars)        
 }
 
+#' Batch optimization of many models
+#'
+#' Optimizes parameters of several models (typically of many catchments) by differential evolution using a shared pool of threads.
+#'
+#' @param models a list of distinct model instances, optimization of each of them must be set by \code{\link{bil.set.optimDE}}
+#' @param n_threads number of threads of the pool (used only if the package is compiled with OpenMP)
+#' @param log_file name of text file to which a line is written when an ensemble member is optimized (empty for no log)
+#' @return Data frame with one row for each optimized ensemble member: serial number of model and ensemble member, thread, start
+#'   and duration of optimization (in seconds from the start of batch) and number of model evaluations. Rows are in order in which
+#'   the members were assigned to threads, i.e. from the most expensive ones.
+#' @details Each ensemble member of each model is a task. Tasks are started from the most expensive ones (according to maximum number of model
+#'   evaluations and length of time series) and assigned to threads as they become free, so all threads are kept busy even when some models
+#'   finish early. Results are the same as by \code{\link{bil.optimize}} for each model (number of threads set for models is not used)
+#'   and can be obtained by \code{\link{bil.get.ens.resul}}.
+#' @seealso \code{\link{bil.optimize}}, \code{\link{bil.set.optimDE}}
+#' @export
+#' @examples
+#' input = data.frame(
+#'   P = c(42, 48, 53, 66, 46, 26, 149, 50, 75, 33, 55, 36),
+#'   R = c(23, 16, 28, 26, 40, 78, 62, 27, 16, 11, 12, 18),
+#'   T = c(1.7, -4.6, -2.9, -3.7, -2.9, 7.3, 8.7, 12.4, 13.8, 15.7, 10.8, 6.9))
+#' models = list()
+#' for (m in 1:3) {
+#'   b = bil.new("m")
+#'   bil.set.values(b, input, init_date = "1990-11-01")
+#'   bil.pet(b, "latit")
+#'   bil.set.optimDE(b, ens_count = 2, seed = m)
+#'   models[[m]] = b
+#' }
+#' tasks = bil.optimize.batch(models, n_threads = 2)
+#' bil.get.ens.resul(models[[1]])
+bil.optimize.batch <- function (models, n_threads = 1, log_file = "") {
+    models = c(models)
+    for (model in models)
+        check.model(model)
+    resul = .Call("optimize_batch", models, n_threads, log_file, PACKAGE = "bilan")
+    if (is.character(resul))
+        stop(resul)
+    return(resul)
+}
+
 #' @name bil.get.values
 #' @rdname bil.get.values
 bil.get.dtm <- function (model) {
@@ -584,9 +708,13 @@ bil.info <- function (model, print = TRUE) {
 #' Access to results of model ensemble
 #'
 #' For differential evolution optimization, gets results of model ensemble: parameters and criterion values.
+#' For multi-objective optimization, gets the Pareto front.
 #'
 #' @param model pointer to model instance
-#' @return Data frame whose named columns represents model parameters, criterion value and number of model evaluations, the ensemble is represented by rows.
+#' @return Data frame whose named columns represents model parameters, criterion value, number of model evaluations and reason for termination
+#'   (\code{"shuffles"}, \code{"improvement"}, \code{"spread"} or \code{"evals"}, see \code{\link{bil.set.optimDE}}), the ensemble is represented by rows.
+#'   For multi-objective optimization, columns are model parameters, criterion of runoff, criterion of baseflow (\code{BF}) and number of model evaluations,
+#'   rows are members of the Pareto front ordered from the best criterion of runoff (see \code{\link{bil.set.optimMO}}).
 #' @export
 #' @examples
 #' b = bil.new("m")
@@ -603,9 +731,13 @@ bil.get.ens.resul <- function(model) {
   resul = .Call("get_ens_resul", check.model(model), PACKAGE = "bilan")
   if (is.null(nrow(resul))) # gradient
     return(NA)
-  else { # differential evolution
+  else { # differential evolution or multi-objective
     crit_names = c("MSE", "MAE", "NS", "LNNS", "MAPE")
-    names(resul)[ncol(resul) - 1] = crit_names[as.numeric(sub("OF", "", names(resul)[ncol(resul) - 1], fixed = TRUE)) + 1]
+    names(resul)[ncol(resul) - 2] = crit_names[as.numeric(sub("OF", "", names(resul)[ncol(resul) - 2], fixed = TRUE)) + 1]
+    if (!is.null(resul$stop)) {
+      stop_names = c("shuffles", "improvement", "spread", "evals")
+      resul$stop = stop_names[resul$stop + 1]
+    }
     return(resul)
   }
 }
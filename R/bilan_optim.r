@@ -5,14 +5,21 @@
 #'
 #' @param object pointer to model instance or to system of catchments instance
 #' @return List of criterion value and optimization settings, for two-step gradient algorithm:
+#'   \item{cache_hits}{number of criterion values taken from the cache in the last optimization}
+#'   \item{cache_misses}{number of criterion values not found in the cache in the last optimization}
+#'   \item{cache_size}{maximum number of cached criterion values}
 #'   \item{crit_part1}{criterion for the first part}
 #'   \item{crit_part2}{criterion for the second part}
 #'   \item{crit_value}{resulting criterion value (after the second part)}
 #'   \item{init_GS}{initial groundwater storage}
 #'   \item{max_iter}{maximum number of iterations}
+#'   \item{n_threads}{number of threads}
+#'   \item{probes}{which probes are evaluated together}
 #'   \item{weight_BF}{weight for baseflow}
 #'   For shuffled complex evolution combined with differential evolution:
 #'   \item{DE_type}{differential evolution version}
+#'   \item{bound_handling}{handling of parameters outside bounds}
+#'   \item{checkpoint_file}{name of checkpoint file (empty if not used)}
 #'   \item{comp_size}{complex size}
 #'   \item{crit}{optimization criterion}
 #'   \item{crit_value}{resulting criterion value (after the second part)}  
@@ -20,12 +27,33 @@
 #'   \item{ens_count}{number of runs in ensemble}
 #'   \item{init_GS}{initial groundwater storage}
 #'   \item{maxn_shuffles}{number of shuffling}
+#'   \item{max_eval}{maximum number of model evaluations for ensemble member}
 #'   \item{mutat_f}{mutation parameter}
 #'   \item{mutat_k}{mutation parameter}
 #'   \item{n_comp}{number of complexes}
 #'   \item{n_gen_comp}{number of generations in one complex}
+#'   \item{n_threads}{number of threads}
+#'   \item{parallel_comp}{whether complexes are evolved concurrently (1) or not (0)}
+#'   \item{generational}{whether offsprings are evaluated by generations (1) or replace their parents one by one (0)}
+#'   \item{resume}{whether optimization is resumed from checkpoint file (1) or not (0)}
 #'   \item{seed}{seed used for random number generator}
+#'   \item{stop_improv}{maximum relative improvement leading to termination}
+#'   \item{stop_shuffles}{number of shuffles for evaluation of improvement}
+#'   \item{stop_spread}{parameter spread leading to termination}
+#'   \item{surrogate}{whether offsprings are pre-screened by surrogate (1) or not (0)}
+#'   \item{surrogate_factor}{multiple of surrogate error for skipping offsprings}
+#'   \item{surrogate_size}{maximum number of models used by surrogate}
+#'   \item{surrogate_skipped}{fraction of offsprings not evaluated due to surrogate in the last optimization}
 #'   \item{weight_BF}{weight for baseflow}
+#'   For multi-objective optimization:
+#'   \item{crit}{optimization criterion of runoff and baseflow}
+#'   \item{cross}{crossover parameter}
+#'   \item{front_count}{number of parameter sets in the Pareto front}
+#'   \item{model_eval}{number of model evaluations in the last optimization}
+#'   \item{mutat_f}{mutation parameter}
+#'   \item{n_gen}{number of generations}
+#'   \item{popul_size}{population size}
+#'   \item{seed}{seed used for random number generator}
 #' @seealso \code{\link{bil.set.optim}}
 #' @aliases sbil.get.optim
 #' @export
@@ -59,7 +87,7 @@ sbil.get.optim <- function (object) {
 # general optimization settings for all optimization methods
 #' @name bil.set.optim
 #' @rdname bil.set.optim
-set.optim.gen <- function (object, crit = NULL, crit_part1 = NULL, crit_part2 = NULL, weight_BF = 0, init_GS = 50, use_weights = FALSE, weights = NULL, ...) {
+set.optim.gen <- function (object, crit = NULL, crit_part1 = NULL, crit_part2 = NULL, weight_BF = 0, init_GS = 50, use_weights = FALSE, weights = NULL, n_threads = 1, ...) {
     crit_names = c("MSE", "MAE", "NS", "LNNS", "MAPE")
     pos = pmatch(crit, crit_names) - 1 # to C index
     if (is.null(crit)) { #crit not defined, crits for parts used if available
@@ -82,6 +110,8 @@ set.optim.gen <- function (object, crit = NULL, crit_part1 = NULL, crit_part2 =
 
     if (is.na(pos_crit1) || is.na(pos_crit2))
         stop("Unknown name of optimization criterion.")
+    if (n_threads < 1)
+        stop("Number of threads must be positive.")
 
     if (!is.null(weights)) {
         if (class(object) == "bilan")
@@ -90,7 +120,7 @@ set.optim.gen <- function (object, crit = NULL, crit_part1 = NULL, crit_part2 =
             stop("Optimization using weights is not supported for system of catchments.")
     }
         
-    return(list(pos_crit1 = pos_crit1, pos_crit2 = pos_crit2, weight_BF = weight_BF, init_GS = init_GS, use_weights = use_weights))
+    return(list(pos_crit1 = pos_crit1, pos_crit2 = pos_crit2, weight_BF = weight_BF, init_GS = init_GS, use_weights = use_weights, n_threads = n_threads))
 }
 
 #' Binary search optimization settings
@@ -99,6 +129,12 @@ set.optim.gen <- function (object, crit = NULL, crit_part1 = NULL, crit_part2 =
 #'
 #' @param object pointer to model instance or to system of catchments instance
 #' @param max_iter maximum number of iterations
+#' @param probes which probes (changes of one parameter) are evaluated together: \code{"serial"} (one at a time), \code{"param"} (both changes of a parameter)
+#'   or \code{"sweep"} (all remaining changes of a sweep over parameters). Probes after the current one are evaluated in advance, concurrently if \code{n_threads}
+#'   is greater than one, and used when the algorithm tries them, so results are the same for all settings.
+#' @param cache_size maximum number of criterion values cached for parameter sets already evaluated (zero for no cache). The algorithm often returns
+#'   to the same parameter sets, their criterion is then taken from the cache instead of running the model. Numbers of cache hits and misses
+#'   are available by \code{\link{bil.get.optim}}.
 #' @param \dots common optimization arguments described at \code{\link{bil.set.optim}}
 #' @seealso \code{\link{bil.set.optim}}
 #' @aliases sbil.set.optimBS
@@ -115,10 +151,15 @@ set.optim.gen <- function (object, crit = NULL, crit_part1 = NULL, crit_part2 =
 #' bil.optimize(b)
 #' s = sbil.new(b)
 #' sbil.set.optimBS(s, crit = "NS", max_iter = 1e3)
-bil.set.optimBS <- function (object, max_iter = 500, ...) {
+bil.set.optimBS <- function (object, max_iter = 500, probes = "serial", cache_size = 0, ...) {
     optim_par = set.optim.gen(object, ...)
     if (max_iter < 0)
         stop("Number of iterations cannot be negative.")
+    if (cache_size < 0)
+        stop("Cache size cannot be negative.")
+    pos_probes = pmatch(probes, c("serial", "param", "sweep")) - 1
+    if (is.na(pos_probes))
+        stop("Unknown type of probes evaluation.")
         
     if (class(object) == "bil_system") {
         func = "sbil_set_optim"
@@ -128,7 +169,7 @@ bil.set.optimBS <- function (object, max_iter = 500, ...) {
         func = "set_optim"
         check_func = check.model
     }
-    err = .Call(func, check_func(object), optim_par[["pos_crit1"]], optim_par[["pos_crit2"]], optim_par[["weight_BF"]], max_iter, optim_par[["init_GS"]], optim_par[["use_weights"]], PACKAGE = "bilan")
+    err = .Call(func, check_func(object), optim_par[["pos_crit1"]], optim_par[["pos_crit2"]], optim_par[["weight_BF"]], max_iter, optim_par[["init_GS"]], optim_par[["use_weights"]], optim_par[["n_threads"]], pos_probes, cache_size, PACKAGE = "bilan")
     
     if (err != "")  
       stop(err)
@@ -146,7 +187,9 @@ sbil.set.optimBS <- function (object, ...) {
 #'
 #' @param object pointer to model instance or to system of catchments instance
 #' @param DE_type name of differential evolution version: \code{"best_one_bin"}, \code{"best_two_bin"}, \code{"rand_two_bin"} 
-#'   (means mutation of best/random parameter set and number of differences between parameters used for the mutation)
+#'   (means mutation of best/random parameter set and number of differences between parameters used for the mutation),
+#'   self-adaptive versions \code{"jde_best_one_bin"}, \code{"jde_rand_one_bin"} adapt mutation and crossover parameters of each individual
+#'   (offspring gets new random values with probability 0.1 and keeps them only if it replaces its parent, \code{cross} and \code{mutat_f} are initial values)
 #' @param n_comp number of complexes
 #' @param comp_size complex size (population size in one complex)
 #' @param cross crossover parameter
@@ -156,6 +199,30 @@ sbil.set.optimBS <- function (object, ...) {
 #' @param n_gen_comp number of generations in one complex
 #' @param ens_count number of runs in ensemble
 #' @param seed seed to initialize random number generator (<= 0 for initialization based on time)
+#' @param parallel_comp whether complexes are evolved concurrently. Each complex then uses the best parameter set found before the shuffling
+#'   and its own improvements, the best of complexes is taken after all of them finish. Results do not depend on number of threads,
+#'   but they differ from those obtained by sequential evolution of complexes.
+#' @param generational whether offsprings of one generation in a complex are created from the complex at the beginning of the generation
+#'   and evaluated together, concurrently if \code{n_threads} is greater than one. Otherwise each offspring replaces its parent
+#'   before the next one is created and models are evaluated one by one. Results of generational evolution do not depend on number of threads,
+#'   but they differ from those of the default steady-state evolution.
+#' @param checkpoint_file name of binary file where state of optimization is written after each shuffle and each finished ensemble member
+#'   (empty for no checkpoints). The file can be used only on the same platform.
+#' @param resume whether to resume optimization from existing \code{checkpoint_file}; the remaining ensemble members are then finished with the same
+#'   results as in uninterrupted optimization. Settings and parameter bounds must be the same as for the interrupted optimization.
+#' @param stop_shuffles number of shuffles over which improvement of the best criterion value is evaluated (0 for no check);
+#'   ensemble member is terminated when relative improvement over the last \code{stop_shuffles} shuffles is not greater than \code{stop_improv}
+#' @param stop_improv maximum relative improvement of the best criterion value leading to termination
+#' @param stop_spread ensemble member is terminated when range of each parameter in population relative to range of its bounds is lower (0 for no check)
+#' @param max_eval maximum number of model evaluations for ensemble member (0 for no limit); shuffle which would exceed it is not started
+#' @param bound_handling how a parameter of offspring which gets outside its bounds by mutation is handled: \code{"reject"} (parent value is used),
+#'   \code{"none"} (value is kept, model run may fail), \code{"reflect"} (reflection from the bound), \code{"midpoint"} (midpoint between the parent value and the bound),
+#'   \code{"random"} (random value within bounds), \code{"clamp"} (value of the bound)
+#' @param surrogate whether offsprings are pre-screened by a surrogate of the criterion (inverse distance weighting of the nearest models
+#'   evaluated in the current shuffle); offspring is not evaluated if its predicted criterion is worse than that of its parent
+#'   by more than \code{surrogate_factor} times the mean error of the surrogate
+#' @param surrogate_factor multiple of the mean error of the surrogate, larger values skip fewer offsprings
+#' @param surrogate_size maximum number of evaluated models used by the surrogate
 #' @param \dots common optimization arguments described at \code{\link{bil.set.optim}}
 #' @seealso \code{\link{bil.set.optim}}
 #' @aliases sbil.set.optimDE
@@ -178,15 +245,20 @@ sbil.set.optimBS <- function (object, ...) {
 #' s = sbil.new(b)
 #' sbil.set.optimDE(s, crit = "NS", comp_size = 20, cross = 0.8, mutat_f = 0.8)
 bil.set.optimDE <- function (object, DE_type = "best_one_bin", n_comp = 4, comp_size = 10, cross = 0.95, mutat_f = 0.95, mutat_k = 0.85,
-                             maxn_shuffles = 5, n_gen_comp = 10, ens_count = 5, seed = 0, ...) {
+                             maxn_shuffles = 5, n_gen_comp = 10, ens_count = 5, seed = 0, parallel_comp = FALSE, generational = FALSE,
+                             checkpoint_file = "", resume = FALSE, stop_shuffles = 0, stop_improv = 0, stop_spread = 0, max_eval = 0,
+                             bound_handling = "reject", surrogate = FALSE, surrogate_factor = 2, surrogate_size = 1000, ...) {
     if (is.list(DE_type))
         stop("Passing list to bil.set.optimDE is obsolete. Use function arguments instead.")
 
     optim_par = set.optim.gen(object, ...)
 
-    pos_DE_type = pmatch(DE_type, c("best_one_bin", "best_two_bin", "rand_two_bin")) - 1
+    pos_DE_type = pmatch(DE_type, c("best_one_bin", "best_two_bin", "rand_two_bin", "jde_best_one_bin", "jde_rand_one_bin")) - 1
     if (is.na(pos_DE_type))
         stop("Unknown name of DE type.")
+    pos_bound_handling = pmatch(bound_handling, c("reject", "none", "reflect", "midpoint", "random", "clamp")) - 1
+    if (is.na(pos_bound_handling))
+        stop("Unknown type of bound handling.")
 
     if (class(object) == "bil_system") {
         func = "sbil_set_DE_optim"
@@ -197,7 +269,9 @@ bil.set.optimDE <- function (object, DE_type = "best_one_bin", n_comp = 4, comp_
         check_func = check.model
     }
     err = .Call(func, check_func(object), optim_par[["pos_crit1"]], pos_DE_type, n_comp, comp_size, cross, mutat_f, mutat_k, maxn_shuffles,
-                n_gen_comp, ens_count, seed, optim_par[["weight_BF"]], optim_par[["init_GS"]], optim_par[["use_weights"]], PACKAGE = "bilan")
+                n_gen_comp, ens_count, seed, optim_par[["weight_BF"]], optim_par[["init_GS"]], optim_par[["use_weights"]], optim_par[["n_threads"]], parallel_comp, generational,
+                checkpoint_file, resume, stop_shuffles, stop_improv, stop_spread, max_eval, pos_bound_handling,
+                surrogate, surrogate_factor, surrogate_size, PACKAGE = "bilan")
 
     if (err != "")  
         stop(err)
@@ -209,31 +283,102 @@ sbil.set.optimDE <- function (object, ...) {
     bil.set.optimDE(object, ...)
 }
 
+#' Multi-objective optimization settings
+#'
+#' Sets optimization method to multi-objective calibration of criteria of runoff and baseflow (NSGA-II with differential evolution operators)
+#'   and sets its parameters, either for the model or for the system of catchments.
+#'
+#' Both criteria (of the same type given by \code{crit}) are calculated from one model run, so observed baseflow \code{B} is required.
+#' Offsprings of each generation are created by DE/rand/1/bin mutation and crossover (values outside parameter bounds are replaced by values of parent)
+#' and evaluated together, concurrently if \code{n_threads} is greater than one. Next generation is selected from parents and offsprings
+#' by non-dominated sorting and crowding distance. Results do not depend on number of threads.
+#'
+#' The Pareto front of the final population is available by \code{\link{bil.get.ens.resul}}. The model gets parameters of the front member
+#' with the best criterion weighted by \code{weight_BF}.
+#'
+#' @param object pointer to model instance or to system of catchments instance
+#' @param popul_size number of parameter sets in population (at least 5)
+#' @param n_gen number of generations
+#' @param cross crossover parameter
+#' @param mutat_f mutation parameter
+#' @param seed seed to initialize random number generator (<= 0 for initialization based on time)
+#' @param \dots common optimization arguments described at \code{\link{bil.set.optim}}
+#' @seealso \code{\link{bil.set.optim}}, \code{\link{bil.get.ens.resul}}
+#' @aliases sbil.set.optimMO
+#' @references Kalyanmoy Deb, Amrit Pratap, Sameer Agarwal, and T. Meyarivan. A fast and elitist multiobjective genetic algorithm: NSGA-II.
+#'   IEEE Transactions on Evolutionary Computation, 6(2):182–197, 2002.
+#' @export
+#' @examples
+#' b = bil.new("m")
+#' input = data.frame(
+#'   P = c(42, 48, 53, 66, 46, 26, 149, 50, 75, 33, 55, 36),
+#'   R = c(23, 16, 28, 26, 40, 78, 62, 27, 16, 11, 12, 18),
+#'   B = c(12, 10, 14, 13, 18, 30, 28, 15, 10, 7, 7, 10),
+#'   T = c(1.7, -4.6, -2.9, -3.7, -2.9, 7.3, 8.7, 12.4, 13.8, 15.7, 10.8, 6.9))
+#' bil.set.values(b, input, init_date = "1990-11-01")
+#' bil.pet(b, "latit")
+#' bil.set.optimMO(b, crit = "NS", popul_size = 20, n_gen = 20, weight_BF = 0.3)
+#' bil.optimize(b)
+#' bil.get.ens.resul(b)
+bil.set.optimMO <- function (object, popul_size = 40, n_gen = 50, cross = 0.9, mutat_f = 0.5, seed = 0, ...) {
+    optim_par = set.optim.gen(object, ...)
+    if (popul_size < 5)
+        stop("Population size must be at least 5.")
+    if (n_gen < 0)
+        stop("Number of generations cannot be negative.")
+
+    if (class(object) == "bil_system") {
+        func = "sbil_set_MO_optim"
+        check_func = check.system
+    }
+    else {
+        func = "set_MO_optim"
+        check_func = check.model
+    }
+    err = .Call(func, check_func(object), optim_par[["pos_crit1"]], popul_size, n_gen, cross, mutat_f, seed,
+                optim_par[["weight_BF"]], optim_par[["init_GS"]], optim_par[["use_weights"]], optim_par[["n_threads"]], PACKAGE = "bilan")
+
+    if (err != "")
+        stop(err)
+}
+
+#' @name bil.set.optimMO
+#' @rdname bil.set.optimMO
+sbil.set.optimMO <- function (object, ...) {
+    bil.set.optimMO(object, ...)
+}
+
 #' Optimization setting
 #'
 #' Sets optimization method and its parameters, either for the model or for the system of catchments.
 #'
 #' @param object pointer to model instance or to system of catchments instance
-#' @param method optimization method: gradient-based binary search (\code{"BS"}) or combined shuffled complex evolution (SCE-UA) and differential evolution (\code{"DE"})
+#' @param method optimization method: gradient-based binary search (\code{"BS"}), combined shuffled complex evolution (SCE-UA) and differential evolution (\code{"DE"})
+#'   or multi-objective calibration of runoff and baseflow (\code{"MO"})
 #' @param from for model only, pointer to another model instance; if specified, optimization settings is copied from that model and all other arguments are ignored
-#' @param \dots other common or specific arguments. The specific arguments are described at \code{\link{bil.set.optimBS}} or \code{\link{bil.set.optimDE}}, the common (passed to \code{set.optim.gen}) below.
+#' @param \dots other common or specific arguments. The specific arguments are described at \code{\link{bil.set.optimBS}}, \code{\link{bil.set.optimDE}} or \code{\link{bil.set.optimMO}}, the common (passed to \code{set.optim.gen}) below.
 #' @param crit For BS method, sets criteria for both parts of optimization; if defined, \code{crit_part1} and \code{crit_part2} are ignored. For MSE and MAE, MAPE is used
 #'   in the second part, for others, the criterion is the same for both parts.
 #'
-#'   For DE method, name of optimization criterion (default MSE).
+#'   For DE and MO methods, name of optimization criterion (default MSE).
 #'
 #'   Supported criteria: \code{"MSE"} (mean squared error), \code{"MAE"} (mean absolute error), \code{"NS"} (Nash-Sutcliffe efficiency),
 #'   \code{"LNNS"} (Nash-Sutcliffe of log-transformed data), \code{"MAPE"} (mean absolute percentage error)
 #' @param crit_part1 for BS method, name of criterion for the first part of optimization: MSE (mean squared error), MAE (mean absolute error), NS (Nash-Sutcliffe efficiency),
 #'   LNNS (Nash-Sutcliffe of log-transformed data), MAPE (mean absolute percentage error); default MSE used if not defined
 #' @param crit_part2 for BS method, name of criterion for the second part of optimization; default MAPE used if not defined
-#' @param weight_BF weight for criterion for observed and modelled baseflow (between 0 and 1, default 0), weight for runoff is (1 - weight_BF)
+#' @param weight_BF weight for criterion for observed and modelled baseflow (between 0 and 1, default 0), weight for runoff is (1 - weight_BF).
+#'   For MO method, it is used only to choose parameters from the Pareto front assigned to the model.
 #' @param init_GS initial groundwater storage in mm (initial condition, default 50)
 #' @param use_weights whether to use weights for criterion calculation in optimization
 #' @param weights a vector of weights for criterion calculation, length of weights must correspond with number of time steps of variable series. 
 #'   If not given, the variable \code{WEI} is used (by default, its values are equal). The weights are considered as relative, e.g. \code{c(2,2,3)} has the same effect as \code{c(4,4,6)}.
 #'   Parts of time series can be excluded from optimization by setting weights to zero.
-#' @seealso \code{\link{bil.optimize}}, \code{\link{bil.set.optimBS}}, \code{\link{bil.set.optimDE}}
+#' @param n_threads number of threads (used only if the package is compiled with OpenMP). For DE method, ensemble members are optimized concurrently
+#'   if there are at least as many members as threads, otherwise initial population, complexes (\code{parallel_comp}) or offsprings of a generation
+#'   (\code{generational}) are evaluated concurrently. For system of catchments, catchments are run
+#'   concurrently when parameter sets are not evaluated concurrently. Results do not depend on number of threads.
+#' @seealso \code{\link{bil.optimize}}, \code{\link{bil.set.optimBS}}, \code{\link{bil.set.optimDE}}, \code{\link{bil.set.optimMO}}
 #' @aliases set.optim.gen sbil.set.optim
 #' @export
 #' @examples
@@ -262,6 +407,8 @@ bil.set.optim <- function(object, method = "BS", from = NULL, ...) {
             bil.set.optimBS(object, ...)
         else if (method == "DE")
             bil.set.optimDE(object, ...)
+        else if (method == "MO")
+            bil.set.optimMO(object, ...)
         else
             stop("Unknown optimization method.")
     }
@@ -272,3 +419,197 @@ bil.set.optim <- function(object, method = "BS", from = NULL, ...) {
 sbil.set.optim <- function (object, ...) {
     bil.set.optim(object, ...)
 }
+
+#' Global sensitivity analysis
+#'
+#' Calculates sensitivity of optimization criterion to parameters within their limits, either for the model or for the system of catchments.
+#'
+#' For Sobol method, parameter sets are sampled randomly by Saltelli design (matrices A and B and matrices A with one parameter taken from B),
+#' the model is evaluated \code{sample_count * (number of parameters + 2)} times. First order indices are estimated by Saltelli et al. (2010),
+#' total order indices by Jansen (1999). All indices are zero when the criterion has zero variance over the samples.
+#'
+#' For Morris method, \code{sample_count} trajectories are created on grid of \code{levels}, each of them changes parameters one by one
+#' (in random order), the model is evaluated \code{sample_count * (number of parameters + 1)} times. Elementary effects are related to parameter
+#' changes relative to their ranges.
+#'
+#' All parameter sets are evaluated together in batches, concurrently if \code{n_threads} is greater than one; results do not depend on number of threads.
+#' Parameters of the model are not changed.
+#'
+#' @param object pointer to model instance or to system of catchments instance
+#' @param method sensitivity method: \code{"sobol"} (variance-based indices) or \code{"morris"} (elementary effects)
+#' @param sample_count number of base samples (Sobol) or trajectories (Morris)
+#' @param levels number of levels of grid for Morris method (even number)
+#' @param seed seed to initialize random number generator (<= 0 for initialization based on time)
+#' @param \dots criterion settings (\code{crit}, \code{weight_BF}, \code{init_GS}, \code{use_weights}, \code{weights}) and \code{n_threads}
+#'   as described at \code{\link{bil.set.optim}}
+#' @return List of two data frames:
+#'   \item{indices}{for each parameter, first order (\code{first}) and total order (\code{total}) Sobol indices,
+#'     or mean (\code{mu}), mean of absolute values (\code{mu_star}) and standard deviation (\code{sigma}) of elementary effects}
+#'   \item{evals}{all evaluated parameter sets and their criterion values (\code{crit}, Nash-Sutcliffe efficiency for NS and LNNS) in order of design}
+#' @references Andrea Saltelli, Paola Annoni, Ivano Azzini, Francesca Campolongo, Marco Ratto, and Stefano Tarantola. Variance based sensitivity
+#'   analysis of model output. Design and estimator for the total sensitivity index. Computer Physics Communications, 181(2):259–270, 2010.
+#'
+#'   Francesca Campolongo, Jessica Cariboni, and Andrea Saltelli. An effective screening design for sensitivity analysis of large models.
+#'   Environmental Modelling & Software, 22(10):1509–1518, 2007.
+#' @seealso \code{\link{bil.set.optim}}
+#' @aliases sbil.sensitivity
+#' @export
+#' @examples
+#' b = bil.new("m")
+#' input = data.frame(
+#'   P = c(42, 48, 53, 66, 46, 26, 149, 50, 75, 33, 55, 36),
+#'   R = c(23, 16, 28, 26, 40, 78, 62, 27, 16, 11, 12, 18),
+#'   T = c(1.7, -4.6, -2.9, -3.7, -2.9, 7.3, 8.7, 12.4, 13.8, 15.7, 10.8, 6.9))
+#' bil.set.values(b, input, init_date = "1990-11-01")
+#' bil.pet(b, "latit")
+#' sens = bil.sensitivity(b, "sobol", sample_count = 200, crit = "NS")
+#' sens$indices
+#' sens = bil.sensitivity(b, "morris", sample_count = 20, crit = "NS")
+#' sens$indices
+bil.sensitivity <- function (object, method = "sobol", sample_count = 1000, levels = 4, seed = 0, ...) {
+    optim_par = set.optim.gen(object, ...)
+    pos_method = pmatch(method, c("sobol", "morris")) - 1
+    if (is.na(pos_method))
+        stop("Unknown sensitivity method.")
+    if (sample_count < 1)
+        stop("Number of samples must be positive.")
+
+    if (class(object) == "bil_system") {
+        func = "sbil_sensitivity"
+        check_func = check.system
+    }
+    else {
+        func = "sensitivity"
+        check_func = check.model
+    }
+    resul = .Call(func, check_func(object), pos_method, sample_count, levels, seed, optim_par[["pos_crit1"]],
+                  optim_par[["weight_BF"]], optim_par[["init_GS"]], optim_par[["use_weights"]], optim_par[["n_threads"]], PACKAGE = "bilan")
+    if (is.character(resul))
+        stop(resul)
+    names(resul$evals) = make.unique(names(resul$evals)) # parameters of catchments in system have the same names
+    return(resul)
+}
+
+#' @name bil.sensitivity
+#' @rdname bil.sensitivity
+sbil.sensitivity <- function (object, ...) {
+    bil.sensitivity(object, ...)
+}
+
+#' Monte Carlo uncertainty analysis
+#'
+#' Samples parameter sets uniformly within their limits, evaluates optimization criterion of each of them and estimates quantiles
+#' of modelled runoff of behavioral parameter sets (GLUE approach).
+#'
+#' Parameter sets are evaluated in chunks, concurrently if \code{n_threads} is greater than one, and only quantiles are kept
+#' for runoff series, so memory does not depend on number of samples. Parameters and criterion of each sample can be streamed
+#' to a text file. Sets whose criterion cannot be calculated (e.g. infinite for LNNS) are not behavioral and their criterion is written
+#' as \code{NA}. Quantiles for each time step are estimated by P-square algorithm (exact for up to five behavioral sets) from series
+#' added in order of samples, so results do not depend on number of threads. Quantiles are not weighted by likelihood.
+#' Parameters of the model are not changed.
+#'
+#' @param model pointer to model instance
+#' @param sample_count number of sampled parameter sets
+#' @param threshold threshold of criterion for behavioral parameter sets (Nash-Sutcliffe efficiency for NS and LNNS, sets with higher or equal value
+#'   are behavioral, for other criteria sets with lower or equal value), \code{NA} for all sets being behavioral
+#' @param quantiles probabilities of quantiles of modelled runoff (empty for no series)
+#' @param out_file name of tab-separated file where parameters, criterion (\code{OK}) and behavioral flag of each sample are written (empty for no file)
+#' @param seed seed to initialize random number generator (<= 0 for initialization based on time)
+#' @param \dots criterion settings (\code{crit}, \code{weight_BF}, \code{init_GS}, \code{use_weights}, \code{weights}) and \code{n_threads}
+#'   as described at \code{\link{bil.set.optim}}
+#' @return List of:
+#'   \item{sample_count}{number of samples}
+#'   \item{behavioral}{number of behavioral samples}
+#'   \item{best}{parameters and criterion value (\code{crit}) of the best sample}
+#'   \item{bands}{data frame with dates (\code{DTM}) and estimated quantiles of modelled runoff of behavioral samples for each time step}
+#' @references Keith Beven and Andrew Binley. The future of distributed models: model calibration and uncertainty prediction.
+#'   Hydrological Processes, 6(3):279–298, 1992.
+#'
+#'   Raj Jain and Imrich Chlamtac. The P2 algorithm for dynamic calculation of quantiles and histograms without storing observations.
+#'   Communications of the ACM, 28(10):1076–1085, 1985.
+#' @seealso \code{\link{bil.set.optim}}, \code{\link{bil.sensitivity}}
+#' @export
+#' @examples
+#' b = bil.new("m")
+#' input = data.frame(
+#'   P = c(42, 48, 53, 66, 46, 26, 149, 50, 75, 33, 55, 36),
+#'   R = c(23, 16, 28, 26, 40, 78, 62, 27, 16, 11, 12, 18),
+#'   T = c(1.7, -4.6, -2.9, -3.7, -2.9, 7.3, 8.7, 12.4, 13.8, 15.7, 10.8, 6.9))
+#' bil.set.values(b, input, init_date = "1990-11-01")
+#' bil.pet(b, "latit")
+#' mc = bil.monte.carlo(b, sample_count = 2000, threshold = 0, crit = "NS")
+#' mc$behavioral
+#' mc$bands
+bil.monte.carlo <- function (model, sample_count = 10000, threshold = NA, quantiles = c(0.05, 0.5, 0.95), out_file = "", seed = 0, ...) {
+    optim_par = set.optim.gen(model, ...)
+    if (sample_count < 1)
+        stop("Number of samples must be positive.")
+
+    resul = .Call("monte_carlo", check.model(model), sample_count, seed, as.numeric(threshold), as.numeric(quantiles), out_file, optim_par[["pos_crit1"]],
+                  optim_par[["weight_BF"]], optim_par[["init_GS"]], optim_par[["use_weights"]], optim_par[["n_threads"]], PACKAGE = "bilan")
+    if (is.character(resul))
+        stop(resul)
+    resul$best = unlist(resul$best)
+    dates = bil.get.dtm(model)
+    resul$bands = if (length(quantiles) > 0) data.frame(DTM = dates, resul$bands) else data.frame(DTM = dates)
+    return(resul)
+}
+
+#' Quantiles of outputs of an ensemble
+#'
+#' Runs the model for each member of an ensemble of parameter sets (by default the optimized ensemble) and estimates quantiles of selected
+#' output variables for each time step.
+#'
+#' Members are run in chunks, concurrently if \code{n_threads} is greater than one, and only quantiles are kept for output series,
+#' so memory does not depend on number of members. Quantiles are estimated by P-square algorithm from series added in order of members
+#' (exact for up to five members, minimum and maximum are always exact), so results do not depend on number of threads.
+#' Each member is run from the beginning of data period with \code{init_GS}. Parameters of the model are not changed.
+#'
+#' @param model pointer to model instance
+#' @param params a data frame or matrix of parameter sets with columns named as parameters of the model, one row for each member;
+#'   if not defined, results of differential evolution or multi-objective optimization are used (see \code{\link{bil.get.ens.resul}})
+#' @param vars names of output variables
+#' @param quantiles probabilities of quantiles (0 for minimum, 1 for maximum)
+#' @param init_GS initial groundwater storage; if not defined, it is tried to be taken from optimization settings
+#' @param n_threads number of threads (used only if the package is compiled with OpenMP)
+#' @return A data frame of dates (\code{DTM}) and estimated quantiles of each variable named by variable and probability
+#'   (e.g. \code{RM.Q0.5})
+#' @references Raj Jain and Imrich Chlamtac. The P2 algorithm for dynamic calculation of quantiles and histograms without storing observations.
+#'   Communications of the ACM, 28(10):1076–1085, 1985.
+#' @seealso \code{\link{bil.get.ens.resul}}, \code{\link{bil.monte.carlo}}
+#' @export
+#' @examples
+#' b = bil.new("m")
+#' input = data.frame(
+#'   P = c(42, 48, 53, 66, 46, 26, 149, 50, 75, 33, 55, 36),
+#'   R = c(23, 16, 28, 26, 40, 78, 62, 27, 16, 11, 12, 18),
+#'   T = c(1.7, -4.6, -2.9, -3.7, -2.9, 7.3, 8.7, 12.4, 13.8, 15.7, 10.8, 6.9))
+#' bil.set.values(b, input, init_date = "1990-11-01")
+#' bil.pet(b, "latit")
+#' bil.set.optim(b, method = "DE", ens_count = 5)
+#' bil.optimize(b)
+#' bil.ens.bands(b, vars = c("RM", "BF"), quantiles = c(0, 0.5, 1))
+bil.ens.bands <- function (model, params = NULL, vars = c("RM", "BF"), quantiles = c(0, 0.05, 0.5, 0.95, 1), init_GS = NULL, n_threads = 1) {
+    if (is.null(params)) {
+        params = bil.get.ens.resul(model)
+        if (!is.data.frame(params))
+            stop("Model has no results of ensemble optimization.")
+    }
+    par_names = bil.get.params(model)$name
+    if (!all(par_names %in% colnames(params)))
+        stop("Parameter sets must contain all parameters of the model.")
+    if (nrow(params) < 1)
+        stop("Ensemble has no members.")
+    if (is.null(init_GS)) {
+        if (is.null(bil.get.optim(model)$init_GS))
+            stop("Initial groundwater storage is not defined.")
+        else
+            init_GS = bil.get.optim(model)$init_GS
+    }
+
+    params = lapply(par_names, function(par) as.numeric(params[, par]))
+    bands = .Call("ens_bands", check.model(model), params, as.character(vars), as.numeric(quantiles), as.numeric(init_GS), n_threads, PACKAGE = "bilan")
+    if (is.character(bands))
+        stop(bands)
+    return(data.frame(DTM = bil.get.dtm(model), bands, check.names = FALSE))
+}
@@ -1,7 +1,26 @@
 #include "bil_model.h"
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+//! identification of binary columnar file
+static const char bin_magic[8] = { 'B', 'I', 'L', 'A', 'N', 'B', 'I', 'N' };
+//! written in native byte order to recognize files from machines with other byte order
+static const uint32_t bin_byte_order = 0x01020304;
+//! version of binary columnar format
+static const uint32_t bin_version = 1;
+//! length of variable name in binary file (padded by zeros)
+static const unsigned bin_name_length = 8;
+//! size of header before variable names: magic, byte order, version, type, year, month, day, time steps, columns, area
+static const size_t bin_header_size = 48;
+
 /**
  * - creates instance of file info with zeros
  */
@@ -12,30 +31,34 @@ input_file_info::input_file_info()
 }
 
 /**
- * - reads header from input file
+ * - reads header from contents of input file, lines are counted in the same scan
+ * @param file contents of file
  * @param file_name name of file
  */
-void input_file_info::read_header(string file_name)
+void input_file_info::read_header(const bil_mapped_file &file, string file_name)
 {
-  ifstream in_stream(file_name.c_str());
-  if (!in_stream) {
-    throw bil_err("The input file '" + file_name + "' does not exist.");
-  }
-
-  string tmp;
-  for (unsigned r = 0; r < 4; r++) {
-    getline(in_stream, rows[r]);
-  }
+  const char *line = file.get_data(), *end = line + file.get_size(), *line_end;
+  unsigned r;
+  for (r = 0; r < 4 && line < end; r++) {
+    line_end = find_line_end(line, end);
+    rows[r].assign(line, line_end);
+    line = line_end < end ? line_end + 1 : end;
+  }
+  for (; r < 4; r++)
+    rows[r].clear();
   nrow = 4; //to get number of rows
   nrow_blank = 0; //blank lines to be skipped
-  while(getline(in_stream, tmp)) {
-    if (tmp.find_first_not_of(" \t\r\n") == string::npos)
+  while (line < end) {
+    line_end = find_line_end(line, end);
+    if (is_blank(line, line_end))
       nrow_blank++;
     else
       nrow++;
+    line = line_end < end ? line_end + 1 : end;
   }
 
   //check if file is old-style formatted (3 rows of header) or not (1 row - date header)
+  string tmp;
   old_style = false;
   stringstream st_stream;
   list<string> tmp_row;
@@ -53,8 +76,171 @@ void input_file_info::read_header(string file_name)
   ncol = 0;
   while (st_stream >> tmp)
     ncol++;
+}
 
-  in_stream.close();
+/**
+ * - finds end of line as by getline
+ * @param line beginning of line
+ * @param end end of file contents
+ * @return position of new line character or end of contents
+ */
+const char* input_file_info::find_line_end(const char *line, const char *end)
+{
+  const char *line_end = static_cast<const char*>(memchr(line, '\n', end - line));
+  return line_end ? line_end : end;
+}
+
+/**
+ * - checks if line contains only spaces, tabulators and line ends
+ * @param line beginning of line
+ * @param line_end end of line
+ * @return whether line is blank
+ */
+bool input_file_info::is_blank(const char *line, const char *line_end)
+{
+  for (; line < line_end; line++) {
+    if (*line != ' ' && *line != '\t' && *line != '\r' && *line != '\n')
+      return false;
+  }
+  return true;
+}
+
+/**
+ * - parses the next number in line, accepts the same characters and gives the same value as extraction of long double
+ *   from a stream in classic locale (e.g. 1-2 are two numbers, 1e is an error), independently of current locale
+ * - numbers with at most 18 significant digits (15 if long double is double) and decimal exponent up to 22 are converted
+ *   with correct rounding by one multiplication or division, other numbers by strtold
+ * @param pos position in line, moved after the number
+ * @param line_end end of line
+ * @param value parsed number
+ * @return whether a number was parsed
+ */
+bool input_file_info::parse_number(const char *&pos, const char *line_end, long double &value)
+{
+  static const long double pow10[] = { 1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L,
+    1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L };
+  static const int max_exact_pow = 22; //5^22 < 2^53, so powers are exact for long double at least as precise as double
+  static const unsigned max_digits = numeric_limits<long double>::digits10 < 19 ? numeric_limits<long double>::digits10 : 19; //exact integer fitting into 64 bits
+  volatile long double one = 1; //arithmetic may be limited by precision control of x87 unit
+  static const bool is_exact_arith = one + numeric_limits<long double>::epsilon() != one;
+
+  const char *p = pos;
+  while (p < line_end && (*p == ' ' || (*p >= '\t' && *p <= '\r')))
+    p++;
+  const char *num_begin = p;
+  bool is_neg = false;
+  if (p < line_end && (*p == '+' || *p == '-')) {
+    is_neg = *p == '-';
+    p++;
+  }
+
+  uint64_t mant = 0;
+  unsigned mant_digits = 0, sig_digits = 0, exp_digits = 0;
+  int exp_dec = 0, exp_val = 0;
+  bool found_dec = false, found_sci = false, is_exp_neg = false, is_exact = true;
+  for (; p < line_end; p++) {
+    char c = *p;
+    if (c == '.' && !found_dec && !found_sci)
+      found_dec = true;
+    else if (c >= '0' && c <= '9') {
+      if (found_sci) {
+        if (exp_val < 100000)
+          exp_val = exp_val * 10 + (c - '0');
+        exp_digits++;
+      }
+      else {
+        mant_digits++;
+        if (mant == 0 && c == '0') { //leading zeros
+          if (found_dec)
+            exp_dec--;
+        }
+        else if (sig_digits < max_digits) {
+          mant = mant * 10 + (c - '0');
+          sig_digits++;
+          if (found_dec)
+            exp_dec--;
+        }
+        else {
+          is_exact = false;
+        }
+      }
+    }
+    else if ((c == 'e' || c == 'E') && !found_sci && mant_digits > 0) {
+      found_sci = true;
+      if (p + 1 < line_end && (p[1] == '+' || p[1] == '-')) {
+        is_exp_neg = p[1] == '-';
+        p++;
+      }
+    }
+    else
+      break;
+  }
+  pos = p;
+  if (mant_digits == 0 || (found_sci && exp_digits == 0))
+    return false; //not a complete number, as by strtold
+
+  int exp_total = exp_dec + (is_exp_neg ? -exp_val : exp_val);
+  if (is_exact && is_exact_arith && exp_total >= -max_exact_pow && exp_total <= max_exact_pow) {
+    value = exp_total >= 0 ? mant * pow10[exp_total] : mant / pow10[-exp_total];
+    if (is_neg)
+      value = -value;
+    return true;
+  }
+
+  string tmp_num(num_begin, p);
+  value = strtold(tmp_num.c_str(), 0);
+  if (value == numeric_limits<long double>::infinity() || value == -numeric_limits<long double>::infinity())
+    return false; //out of range is an error for streams
+  return true;
+}
+
+/**
+ * - maps whole file to memory (reads it into a buffer if mapping is not available)
+ * @param file_name name of file
+ */
+bil_mapped_file::bil_mapped_file(string file_name)
+  : data(0), size(0), is_mapped(false)
+{
+#ifndef _WIN32
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw bil_err("The input file '" + file_name + "' does not exist.");
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw bil_err("The input file '" + file_name + "' cannot be read.");
+  }
+  size = static_cast<size_t>(st.st_size);
+  if (size > 0) {
+    void *addr = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      data = static_cast<const char*>(addr);
+      is_mapped = true;
+    }
+  }
+  close(fd); //mapping remains valid
+  if (is_mapped || size == 0)
+    return;
+#endif
+  ifstream in_stream(file_name.c_str(), ios::binary);
+  if (!in_stream)
+    throw bil_err("The input file '" + file_name + "' does not exist.");
+  char chunk[65536];
+  while (in_stream.read(chunk, sizeof(chunk)) || in_stream.gcount() > 0) //errors (e.g. for directory) end the contents
+    buffer.insert(buffer.end(), chunk, chunk + in_stream.gcount());
+  size = buffer.size();
+  data = size > 0 ? &buffer[0] : 0;
+}
+
+/**
+ * - unmaps the file
+ */
+bil_mapped_file::~bil_mapped_file()
+{
+#ifndef _WIN32
+  if (is_mapped)
+    munmap(const_cast<char*>(data), size);
+#endif
 }
 
 /**
@@ -67,8 +253,9 @@ void input_file_info::read_header(string file_name)
  */
 void bilan::read_file(string file_name, unsigned input_var[], unsigned input_var_count)
 {
+  bil_mapped_file file(file_name);
   input_file_info info;
-  info.read_header(file_name);
+  info.read_header(file, file_name);
 
   //check if input_var count correct
   if (input_var_count > info.ncol)
@@ -155,15 +342,13 @@ void bilan::read_file(string file_name, unsigned input_var[], unsigned input_var
     throw bil_err("File '" + file_name + "': " + error.descr);
   }
   //read data
-  ifstream in_stream(file_name.c_str());
-  if (!in_stream) {
-    throw bil_err("The input file '" + file_name + "' does not exist.");
-  }
+  const char *line = file.get_data(), *end = line + file.get_size(), *line_end;
   unsigned header = 1;
   if (info.old_style)
     header = 3;
   for (unsigned r = 0; r < header; r++) {
-    getline(in_stream, info.rows[r]);
+    line_end = input_file_info::find_line_end(line, end);
+    line = line_end < end ? line_end + 1 : end;
   }
   info.nrow = info.nrow - header;
 
@@ -177,27 +362,25 @@ void bilan::read_file(string file_name, unsigned input_var[], unsigned input_var
   set_calendar(init_date.year, init_date.month, init_date.day);
 
   long double tmp_double;
-  string curr_row;
+  const char *pos;
   unsigned col, r_eff = 0;
   for (unsigned r = 0; r < info.nrow + info.nrow_blank; r++) {
-    getline(in_stream, curr_row);
-    st_stream.clear(); //no error flag
-    st_stream.str(""); //to be empty
-    st_stream << curr_row;
-
-    if (curr_row.find_first_not_of(" \t\r\n") != string::npos) {
+    line_end = input_file_info::find_line_end(line, end);
+    if (!input_file_info::is_blank(line, line_end)) {
+      pos = line;
       for (col = 0; col < input_var_count; col++) {
-        if (!(st_stream >> tmp_double))
-          throw bil_err("File '" + file_name + "': Incomplete line found:\n" + curr_row);
-        var[r_eff][input_var[col]] = tmp_double;
+        if (!input_file_info::parse_number(pos, line_end, tmp_double))
+          throw bil_err("File '" + file_name + "': Incomplete line found:\n" + string(line, line_end));
+        var[input_var[col]][r_eff] = tmp_double;
       }
       r_eff++;
     }
+    line = line_end < end ? line_end + 1 : end;
   }
-  in_stream.close();
 
   input_file = file_name;
   are_chars = false;
+  clear_obs_stats();
   for (col = 0; col < input_var_count; col++)
     var_is_input[input_var[col]] = true;
 
@@ -205,6 +388,123 @@ void bilan::read_file(string file_name, unsigned input_var[], unsigned input_var
     BIL_OSTREAM << "File '" << file_name << "': " << info.nrow_blank << " blank lines skipped.\n";
 }
 
+/**
+ * - reads observed data from binary columnar file written by write_binary, values are taken from the mapped file without parsing
+ * - the file contains header (initial date, model type, number of time steps and columns, catchment area),
+ *   names of variables and contiguous columns of doubles, all in native byte order
+ * @param file_name name of file
+ */
+void bilan::read_binary(string file_name)
+{
+  bil_mapped_file file(file_name);
+  const char *data = file.get_data();
+  size_t size = file.get_size();
+  if (size < bin_header_size || memcmp(data, bin_magic, sizeof(bin_magic)) != 0)
+    throw bil_err("File '" + file_name + "' is not a binary Bilan file.");
+
+  uint32_t header[8]; //byte order, version, type, year, month, day, time steps, columns
+  memcpy(header, data + sizeof(bin_magic), sizeof(header));
+  if (header[0] != bin_byte_order)
+    throw bil_err("File '" + file_name + "' was written with different byte order.");
+  if (header[1] != bin_version)
+    throw bil_err("File '" + file_name + "': Unsupported version of binary format.");
+  if (header[2] != static_cast<uint32_t>(type))
+    throw bil_err("File '" + file_name + "': Type of model does not match the file.");
+  unsigned new_time_steps = header[6], col_count = header[7];
+  size_t data_offset = bin_header_size + static_cast<size_t>(col_count) * bin_name_length;
+  if (size != data_offset + static_cast<size_t>(col_count) * new_time_steps * sizeof(double))
+    throw bil_err("File '" + file_name + "': Size of file does not match its header.");
+
+  date init_date;
+  try {
+    init_date = date(header[3], header[4], header[5]);
+  }
+  catch (bil_err &error) {
+    throw bil_err("File '" + file_name + "': " + error.descr);
+  }
+
+  //names are checked before water use is switched on, water use variables are known only to the model with water use
+  vector<string> col_names(col_count);
+  bool is_water_use = false;
+  unsigned col;
+  for (col = 0; col < col_count; col++) {
+    const char *name = data + bin_header_size + col * bin_name_length;
+    col_names[col] = string(name, find(name, name + bin_name_length, '\0'));
+    if (col_names[col] == "POD" || col_names[col] == "POV" || col_names[col] == "PVN" || col_names[col] == "VYP")
+      is_water_use = true;
+    else
+      get_var_pos(col_names[col]);
+  }
+  if (is_water_use)
+    set_water_use(true);
+  vector<unsigned> input_var(col_count);
+  for (col = 0; col < col_count; col++)
+    input_var[col] = get_var_pos(col_names[col]);
+
+  init_var(new_time_steps);
+  set_calendar(init_date.year, init_date.month, init_date.day);
+  memcpy(&area, data + bin_header_size - sizeof(double), sizeof(double));
+
+  const double *values = reinterpret_cast<const double*>(data + data_offset); //offset is a multiple of 8 from page start
+  for (col = 0; col < col_count; col++) {
+    bil_real *column = var[input_var[col]];
+    for (ts = 0; ts < time_steps; ts++)
+      column[ts] = values[ts];
+    values += time_steps;
+  }
+
+  input_file = file_name;
+  are_chars = false;
+  clear_obs_stats();
+  for (col = 0; col < col_count; col++)
+    var_is_input[input_var[col]] = true;
+}
+
+/**
+ * - writes input variables into binary columnar file to be read by read_binary
+ * - values are written as doubles (long double precision is not kept)
+ * @param file_name name of file
+ */
+void bilan::write_binary(string file_name)
+{
+  if (!var)
+    throw bil_err("No variables to output.");
+  vector<unsigned> output_var;
+  for (unsigned v = 0; v < var_count; v++) {
+    if (var_is_input[v])
+      output_var.push_back(v);
+  }
+  if (output_var.empty())
+    throw bil_err("No input variables to output.");
+
+  ofstream out_stream(file_name.c_str(), ios::binary);
+  if (!out_stream) {
+    throw bil_err("The output file '" + file_name + "' cannot be used.");
+  }
+  uint32_t header[8] = { bin_byte_order, bin_version, static_cast<uint32_t>(type), calen[0].year, calen[0].month, calen[0].day,
+    time_steps, static_cast<uint32_t>(output_var.size()) };
+  out_stream.write(bin_magic, sizeof(bin_magic));
+  out_stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+  out_stream.write(reinterpret_cast<const char*>(&area), sizeof(area));
+
+  unsigned col;
+  for (col = 0; col < output_var.size(); col++) {
+    char name[bin_name_length] = { 0 };
+    string var_name = get_var_name(output_var[col]);
+    var_name.copy(name, bin_name_length);
+    out_stream.write(name, bin_name_length);
+  }
+  vector<double> column(time_steps);
+  for (col = 0; col < output_var.size(); col++) {
+    for (ts = 0; ts < time_steps; ts++)
+      column[ts] = static_cast<double>(var[output_var[col]][ts]);
+    out_stream.write(reinterpret_cast<const char*>(&column[0]), time_steps * sizeof(double));
+  }
+  if (!out_stream)
+    throw bil_err("The output file '" + file_name + "' cannot be written.");
+  out_stream.close();
+}
+
 /**
  * - reads parameters from output file
  * @param file_name name of file
@@ -288,12 +588,8 @@ void bilan::read_params_file(string file_name)
 void bilan::calc_var_mon()
 {
   unsigned m;
-  if (var_mon) {
-    for (m = 0; m < months; m++) {
-      delete[] var_mon[m];
-    }
-    delete[] var_mon;
-  }
+  delete_columns(var_mon);
+  var_mon = 0;
   delete[] calen_mon;
   calen_mon = 0;
 
@@ -330,13 +626,9 @@ void bilan::calc_var_mon()
   while (calen[ts_last] != eff_last_date)
     ts_last--;
 
-  var_mon = new long double*[months];
+  var_mon = new_columns(var_count, months);
   calen_mon = new date[months];
-  for (m = 0; m < months; m++) {
-    var_mon[m] = new long double[var_count];
-    for (unsigned v = 0; v < var_count; v++)
-      var_mon[m][v] = 999;
-  }
+  fill(var_mon[0], var_mon[0] + var_count * months, 999);
 
   long double sum;
   unsigned tmp_m;
@@ -346,16 +638,16 @@ void bilan::calc_var_mon()
       tmp_m = calen[ts].month;
       sum = 0;
       while (ts < ts_last + 1 && calen[ts].month == tmp_m) {
-        sum += var[ts][v];
+        sum += var[v][ts];
         ts++;
       }
       calen_mon[m] = calen[ts - 1];
       calen_mon[m].day = 1;
 
       if (v == T || v == H || v == SW || v == SS || v == GS || v == DS)
-        var_mon[m][v] = sum / calen[ts - 1].day;
+        var_mon[v][m] = sum / calen[ts - 1].day;
       else
-        var_mon[m][v] = sum;
+        var_mon[v][m] = sum;
     }
   }
 }
@@ -418,8 +710,8 @@ void bilan::calc_char_mon()
   char_mon = 0;
 
   const unsigned months_in_year = 12;
-  long double tmp_value;
-  long double **var_ser = 0;
+  bil_real tmp_value;
+  bil_real **var_ser = 0;
 
   switch (type) {
     case DAILY:
@@ -434,9 +726,9 @@ void bilan::calc_char_mon()
 
   unsigned v, y;
 
-  char_mon = new long double*[months_in_year];
+  char_mon = new bil_real*[months_in_year];
   for (m = 0; m < months_in_year; m++) {
-    char_mon[m] = new long double[var_count * 3]; //min, mean, max
+    char_mon[m] = new bil_real[var_count * 3]; //min, mean, max
     for (v = 0; v < var_count; v++) {
       char_mon[m][v * 3] = 999999; //min
       char_mon[m][v * 3 + 1] = 0; //mean
@@ -447,7 +739,7 @@ void bilan::calc_char_mon()
   for (v = 0; v < var_count; v++) {
     for (y = 0; y < years; y++) {
       for (m = 0; m < months_in_year; m++) {
-        tmp_value = var_ser[init_m + y * 12 + m][v];
+        tmp_value = var_ser[v][init_m + y * 12 + m];
         if (tmp_value < char_mon[m][v * 3])
           char_mon[m][v * 3] = tmp_value;
         if (tmp_value > char_mon[m][v * 3 + 2])
@@ -497,7 +789,7 @@ void bilan::calc_chars()
  * @param var time-series of variables (daily or monhtly)
  * @param time_steps number of days or months
  */
-void bilan::write_series_file(ofstream& out_stream, long double **var, unsigned time_steps)
+void bilan::write_series_file(ofstream& out_stream, bil_real **var, unsigned time_steps)
 {
   unsigned v;
   out_stream << "\n\n";
@@ -515,7 +807,7 @@ void bilan::write_series_file(ofstream& out_stream, long double **var, unsigned
       if (is_value_na(ts, v))
         out_stream << "NA";
       else
-        out_stream << static_cast<double>(var[ts][v]);
+        out_stream << static_cast<double>(var[v][ts]);
     }
   }
 }
@@ -0,0 +1,1052 @@
+/**
+ * @file
+ * - simulation core of Bilan model templated on floating-point type of variables
+ * - accumulation of optimization criteria
+ */
+
+#ifndef BIL_KERNEL_H_INCLUDED
+#define BIL_KERNEL_H_INCLUDED
+
+#include <cmath>
+
+#include "bil_model.h"
+
+/**
+ * - optimization criterion for observed and modelled series accumulated time step by time step
+ * - statistics of observed series are precalculated in bil_obs_stats
+ * - NS and LNNS are residuals to 1 (to be minimized)
+ */
+class bil_crit_sum
+{
+  public:
+    //! empty sums (unused criterion)
+    bil_crit_sum() : stats(0), obs(0), wei(0), ok(0), cit(0) { };
+    bil_crit_sum(const bil_obs_stats& stats, const bil_real *obs, const bil_real *wei); //!< prepares sums for given statistics and observed series
+
+    void add(unsigned ts, bil_real mod); //!< adds one time step
+    bil_real get(); //!< criterion value from accumulated sums
+    static bil_real calc(const bil_obs_stats& stats, bil_real ok, bil_real cit); //!< criterion value from given sums
+
+  private:
+    const bil_obs_stats *stats; //!< statistics of observed series
+    const bil_real *obs; //!< observed series
+    const bil_real *wei; //!< weights of time steps
+    bil_real ok; //!< sum for MSE, MAE and MAPE
+    bil_real cit; //!< numerator for NS and LNNS
+};
+
+/**
+ * - initializes sums
+ * @param stats statistics of observed series calculated for the criterion
+ * @param obs observed series
+ * @param wei series of weights
+ */
+inline bil_crit_sum::bil_crit_sum(const bil_obs_stats& stats, const bil_real *obs, const bil_real *wei)
+  : stats(&stats), obs(obs), wei(wei), ok(0), cit(0)
+{
+
+}
+
+/**
+ * - adds modelled value of one time step
+ * @param ts time step
+ * @param mod modelled value
+ */
+inline void bil_crit_sum::add(unsigned ts, bil_real mod)
+{
+  bil_real tmp_weight;
+  if (stats->use_weights) {
+    if (wei[ts] < NUMERIC_EPS && wei[ts] > -NUMERIC_EPS)
+      return;
+    tmp_weight = wei[ts] / stats->mean_weight;
+  }
+  else
+    tmp_weight = 1;
+
+  switch (stats->crit_type) {
+    case optimizer_gen<bilan_fcd*>::MSE:
+      ok = ok + tmp_weight * pow((obs[ts] - mod), 2); //standard error
+      break;
+    case optimizer_gen<bilan_fcd*>::MAE:
+      ok = ok + tmp_weight * abs(obs[ts] - mod); //mean absolute error
+      break;
+    case optimizer_gen<bilan_fcd*>::MAPE:
+      ok = ok + tmp_weight * abs(obs[ts] - mod) / obs[ts]; //mean absolute percentage error
+      break;
+    case optimizer_gen<bilan_fcd*>::NS: //Nash-Sutcliffe efficiency
+      cit = cit + tmp_weight * pow(obs[ts] - mod, 2);
+      break;
+    case optimizer_gen<bilan_fcd*>::LNNS: //logarithmic Nash-Sutcliffe efficiency
+      cit = cit + tmp_weight * pow(stats->log_obs[ts] - log(mod), 2);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * - calculates criterion from sums
+ * @return value of the criterion
+ */
+inline bil_real bil_crit_sum::get()
+{
+  return calc(*stats, ok, cit);
+}
+
+/**
+ * - calculates criterion from sums of one model
+ * @param stats statistics of observed series
+ * @param ok sum for MSE, MAE and MAPE
+ * @param cit numerator for NS and LNNS
+ * @return value of the criterion
+ */
+inline bil_real bil_crit_sum::calc(const bil_obs_stats& stats, bil_real ok, bil_real cit)
+{
+  bil_real crit = ok;
+  unsigned crit_type = stats.crit_type;
+  if ((crit_type == optimizer_gen<bilan_fcd*>::MSE) || (crit_type == optimizer_gen<bilan_fcd*>::MAE) || (crit_type == optimizer_gen<bilan_fcd*>::MAPE))
+    crit = ok / stats.time_steps;
+  else if ((crit_type == optimizer_gen<bilan_fcd*>::NS) || (crit_type == optimizer_gen<bilan_fcd*>::LNNS))
+    crit = cit / stats.jmen;
+
+  if (crit == numeric_limits<bil_real>::infinity()) //zero modelled value matters for LNNS
+    throw bil_err("Optimization criterion value is infinity (probably due to zero observed or modelled value).");
+
+  return crit;
+}
+
+/**
+ * - optimization criterion accumulated time step by time step for several models run in lockstep (lanes of batch kernel)
+ * - weight of time step and criterion type are common for all lanes, sums are kept in arrays to be vectorized
+ */
+class bil_crit_lanes
+{
+  public:
+    //! empty sums (unused criterion)
+    bil_crit_lanes() : stats(0), obs(0), wei(0) { };
+    bil_crit_lanes(const bil_obs_stats& stats, const bil_real *obs, const bil_real *wei); //!< prepares sums for given statistics and observed series
+
+    void add(unsigned ts, const bil_real *mod); //!< adds one time step of all lanes
+    //! criterion value of a lane from accumulated sums
+    bil_real get(unsigned lane) { return bil_crit_sum::calc(*stats, ok[lane], cit[lane]); };
+
+  private:
+    const bil_obs_stats *stats; //!< statistics of observed series
+    const bil_real *obs; //!< observed series
+    const bil_real *wei; //!< weights of time steps
+    bil_real ok[BIL_LANES]; //!< sums for MSE, MAE and MAPE
+    bil_real cit[BIL_LANES]; //!< numerators for NS and LNNS
+};
+
+/**
+ * - initializes sums of all lanes
+ * @param stats statistics of observed series calculated for the criterion
+ * @param obs observed series
+ * @param wei series of weights
+ */
+inline bil_crit_lanes::bil_crit_lanes(const bil_obs_stats& stats, const bil_real *obs, const bil_real *wei)
+  : stats(&stats), obs(obs), wei(wei)
+{
+  for (unsigned lane = 0; lane < BIL_LANES; lane++) {
+    ok[lane] = 0;
+    cit[lane] = 0;
+  }
+}
+
+/**
+ * - adds modelled values of one time step, the same operations as in bil_crit_sum::add for each lane
+ * @param ts time step
+ * @param mod modelled values of lanes
+ */
+inline void bil_crit_lanes::add(unsigned ts, const bil_real *mod)
+{
+  bil_real tmp_weight;
+  if (stats->use_weights) {
+    if (wei[ts] < NUMERIC_EPS && wei[ts] > -NUMERIC_EPS)
+      return;
+    tmp_weight = wei[ts] / stats->mean_weight;
+  }
+  else
+    tmp_weight = 1;
+
+  bil_real tmp_obs = obs[ts];
+  unsigned lane;
+  switch (stats->crit_type) {
+    case optimizer_gen<bilan_fcd*>::MSE:
+      for (lane = 0; lane < BIL_LANES; lane++)
+        ok[lane] = ok[lane] + tmp_weight * pow((tmp_obs - mod[lane]), 2);
+      break;
+    case optimizer_gen<bilan_fcd*>::MAE:
+      for (lane = 0; lane < BIL_LANES; lane++)
+        ok[lane] = ok[lane] + tmp_weight * abs(tmp_obs - mod[lane]);
+      break;
+    case optimizer_gen<bilan_fcd*>::MAPE:
+      for (lane = 0; lane < BIL_LANES; lane++)
+        ok[lane] = ok[lane] + tmp_weight * abs(tmp_obs - mod[lane]) / tmp_obs;
+      break;
+    case optimizer_gen<bilan_fcd*>::NS:
+      for (lane = 0; lane < BIL_LANES; lane++)
+        cit[lane] = cit[lane] + tmp_weight * pow(tmp_obs - mod[lane], 2);
+      break;
+    case optimizer_gen<bilan_fcd*>::LNNS:
+      for (lane = 0; lane < BIL_LANES; lane++)
+        cit[lane] = cit[lane] + tmp_weight * pow(stats->log_obs[ts] - log(mod[lane]), 2);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * - daily and monthly Bilan computation over columns of variables
+ * - REAL is the type of variables (bil_real for model runs, long double for reference runs)
+ * - storages of previous time step are kept in double as in the original model
+ * - variables of current time step are computed in a row, columns are read for inputs and written for outputs,
+ *   in scoring mode only criterion sums are accumulated and outputs are not written (except optional RM),
+ *   in output mode only selected outputs are written to separate columns
+ */
+template <class REAL>
+class bil_kernel
+{
+  public:
+    bil_kernel(REAL **var, const parameter *param, bilan::bilan_type type, bool water_use); //!< creates kernel over given columns and parameters
+
+    void set_scoring(bil_crit_sum *sum_RM, bil_crit_sum *sum_BF, REAL *RM_out); //!< switches to scoring mode
+    void set_outputs(const unsigned *out_vars, unsigned out_count, REAL **out_cols); //!< switches to output mode
+    int run(unsigned ts_begin, unsigned ts_end, int prev_season, const double prev_st[bil_state::st_var_count]); //!< runs model for a period of time steps
+
+  private:
+    REAL **var; //!< observed and modelled variables (+variable, +time step)
+    const parameter *param; //!< model parameters
+    bilan::bilan_type type; //!< daily or monthly
+    bool water_use; //!< whether to use variables of water use
+    unsigned ts; //!< current time when running
+    REAL cur[bilan::VYP + 1]; //!< variables of current time step
+
+    bil_crit_sum *sum_RM; //!< criterion sums for runoff in scoring mode (null otherwise)
+    bil_crit_sum *sum_BF; //!< criterion sums for baseflow in scoring mode (null if baseflow not used)
+    REAL *RM_out; //!< column for modelled runoff in scoring mode (null if not written)
+    const unsigned *out_vars; //!< output variables written in output mode
+    unsigned out_count; //!< number of output variables written in output mode
+    REAL **out_cols; //!< columns for output variables in output mode (null otherwise)
+
+    void load_inputs(); //!< copies input variables of current time step into the row
+    void store_outputs(); //!< copies output variables of current time step into columns
+    void winter_daily(double prev_snow); //!< winter surface balance - daily
+    void winter_monthly(double prev_snow); //!< winter surface balance - monthly
+    void melt_daily(double prev_snow); //!< snow melting - daily
+    void melt_monthly(double prev_snow); //!< snow melting - monthly
+    void winter_balance(double prev_W); //!< winter soil balance
+    void summer_balance(double prev_W); //!< summer soil balance
+    void divide_daily(int mode, double prev_DS, double prev_RB); //!< runoff divider - daily
+    void divide_monthly(int mode, double prev_RB); //!< runoff divider - monthly
+    void include_water_use(); //!< includes withdrawals and release
+};
+
+/**
+ * - creates kernel, all arrays remain owned by caller
+ * @param var columns of variables with input data
+ * @param param model parameters
+ * @param type daily or monthly model type
+ * @param water_use whether to use variables of water use
+ */
+template <class REAL>
+bil_kernel<REAL>::bil_kernel(REAL **var, const parameter *param, bilan::bilan_type type, bool water_use)
+  : var(var), param(param), type(type), water_use(water_use), ts(0), sum_RM(0), sum_BF(0), RM_out(0), out_vars(0), out_count(0), out_cols(0)
+{
+
+}
+
+/**
+ * - instead of writing outputs, criterion sums are accumulated for each time step
+ * @param sum_RM sums for observed and modelled runoff
+ * @param sum_BF sums for observed baseflow and modelled baseflow, null if not used
+ * @param RM_out column where modelled runoff is written, null if not needed (it may differ from the column of model)
+ */
+template <class REAL>
+void bil_kernel<REAL>::set_scoring(bil_crit_sum *sum_RM, bil_crit_sum *sum_BF, REAL *RM_out)
+{
+  this->sum_RM = sum_RM;
+  this->sum_BF = sum_BF;
+  this->RM_out = RM_out;
+}
+
+/**
+ * - instead of writing all outputs to columns of variables, selected outputs are written to given columns
+ * @param out_vars output variables to be written
+ * @param out_count number of output variables
+ * @param out_cols column for each output variable (it may differ from the columns of model)
+ */
+template <class REAL>
+void bil_kernel<REAL>::set_outputs(const unsigned *out_vars, unsigned out_count, REAL **out_cols)
+{
+  this->out_vars = out_vars;
+  this->out_count = out_count;
+  this->out_cols = out_cols;
+}
+
+/**
+ * - runs the Bilan model in daily or monthly step for time steps from ts_begin to ts_end - 1
+ * @param ts_begin the first time step
+ * @param ts_end time step after the last one
+ * @param prev_season seasonal mode before the first time step
+ * @param prev_st storages before the first time step (ordered as bil_state::state_var_names)
+ * @return seasonal mode of the last time step
+ */
+template <class REAL>
+int bil_kernel<REAL>::run(unsigned ts_begin, unsigned ts_end, int prev_season, const double prev_st[bil_state::st_var_count])
+{
+  int akt_typ = prev_season; //seasonal mode for the current and previous time step
+  int predch_typ;
+
+  double predch_snih, predch_W, predch_DS, predch_RB; //hodnoty pro den - 1, takhle zvlášť kvůli ošetření prvního řádku
+
+  for (ts = ts_begin; ts < ts_end; ts++) {
+    //previous state variables and dealing with both the first time and specified state, row still contains previous time step
+    if (ts == ts_begin) {
+      predch_typ = prev_season;
+      predch_snih = prev_st[bil_state::stSS];
+      predch_W = prev_st[bil_state::stSW];
+      predch_DS = prev_st[bil_state::stDS];
+      predch_RB = prev_st[bil_state::stGS];
+    }
+    else {
+      predch_typ = akt_typ;
+      predch_snih = cur[bilan::SS];
+      predch_W = cur[bilan::SW];
+      predch_RB = cur[bilan::GS];
+      if (type == bilan::DAILY)
+        predch_DS = cur[bilan::DS];
+      else
+        predch_DS = 0;
+    }
+    load_inputs();
+
+    //seasonal model, first previous is assumed to be summer
+    if (cur[bilan::T] >= 0) {
+      if (predch_typ == bilan::ZIMNI || (predch_typ == bilan::TANI && predch_snih > 0)) //previous winter => melting, previous melting and snow available => melting
+        akt_typ = bilan::TANI;
+      else //previous summer => summer, previous melting and no snow => summer
+        akt_typ = bilan::LETNI;
+    }
+    else
+      akt_typ = bilan::ZIMNI; //winter for negative temperature
+
+    switch (type) {
+      case bilan::DAILY:
+        switch (akt_typ) {
+          case bilan::TANI:
+            melt_daily(predch_snih);
+            winter_balance(predch_W);
+            divide_daily(akt_typ, predch_DS, predch_RB);
+            break;
+          case bilan::LETNI:
+            summer_balance(predch_W);
+            divide_daily(akt_typ, predch_DS, predch_RB);
+            break;
+          case bilan::ZIMNI:
+            winter_daily(predch_snih);
+            winter_balance(predch_W);
+            divide_daily(akt_typ, predch_DS, predch_RB);
+            break;
+          default:
+            break;
+        }
+        break;
+      case bilan::MONTHLY:
+        switch (akt_typ) {
+          case bilan::TANI:
+            melt_monthly(predch_snih);
+            winter_balance(predch_W);
+            divide_monthly(akt_typ, predch_RB);
+            break;
+          case bilan::LETNI:
+            summer_balance(predch_W);
+            divide_monthly(akt_typ, predch_RB);
+            break;
+          case bilan::ZIMNI:
+            winter_monthly(predch_snih);
+            winter_balance(predch_W);
+            divide_monthly(akt_typ, predch_RB);
+            break;
+          default:
+            break;
+        }
+        break;
+      default:
+        break;
+    }
+
+    if (sum_RM) {
+      sum_RM->add(ts, cur[bilan::RM]);
+      if (sum_BF)
+        sum_BF->add(ts, cur[bilan::BF]);
+      if (RM_out)
+        RM_out[ts] = cur[bilan::RM];
+    }
+    else if (out_cols) {
+      for (unsigned o = 0; o < out_count; o++)
+        out_cols[o][ts] = cur[out_vars[o]];
+    }
+    else
+      store_outputs();
+  }
+  return akt_typ;
+}
+
+/**
+ * - copies input variables of current time step into the row
+ */
+template <class REAL>
+void bil_kernel<REAL>::load_inputs()
+{
+  cur[bilan::P] = var[bilan::P][ts];
+  cur[bilan::T] = var[bilan::T][ts];
+  cur[bilan::PET] = var[bilan::PET][ts];
+  if (water_use) {
+    cur[bilan::POD] = var[bilan::POD][ts];
+    cur[bilan::POV] = var[bilan::POV][ts];
+    cur[bilan::PVN] = var[bilan::PVN][ts];
+    cur[bilan::VYP] = var[bilan::VYP][ts];
+  }
+}
+
+/**
+ * - copies output variables of current time step into columns, all of them are computed in each time step
+ */
+template <class REAL>
+void bil_kernel<REAL>::store_outputs()
+{
+  var[bilan::RM][ts] = cur[bilan::RM];
+  var[bilan::BF][ts] = cur[bilan::BF];
+  var[bilan::DS][ts] = cur[bilan::DS]; //I for monthly type
+  var[bilan::DR][ts] = cur[bilan::DR];
+  var[bilan::ET][ts] = cur[bilan::ET];
+  var[bilan::SW][ts] = cur[bilan::SW];
+  var[bilan::SS][ts] = cur[bilan::SS];
+  var[bilan::GS][ts] = cur[bilan::GS];
+  var[bilan::INF][ts] = cur[bilan::INF];
+  var[bilan::PERC][ts] = cur[bilan::PERC];
+  var[bilan::RC][ts] = cur[bilan::RC];
+}
+
+/**
+ * - daily Bilan - winter surface balance
+ * @param prev_snow snow in previous time step
+ */
+template <class REAL>
+void bil_kernel<REAL>::winter_daily(double prev_snow)
+{
+  cur[bilan::INF] = 0;
+  cur[bilan::SS] = prev_snow + cur[bilan::P] - cur[bilan::PET];
+  if (cur[bilan::SS] < 0) {
+    cur[bilan::SS] = 0;
+    cur[bilan::ET] = prev_snow + cur[bilan::P];
+  }
+  else {
+    cur[bilan::ET] = cur[bilan::PET];
+  }
+}
+
+/**
+ * - monthly Bilan - winter surface balance
+ * @param prev_snow snow in previous time step
+ */
+template <class REAL>
+void bil_kernel<REAL>::winter_monthly(double prev_snow)
+{
+  cur[bilan::DR] = 0;
+  cur[bilan::ET] = cur[bilan::PET];
+
+  if (cur[bilan::T] > T_KRIT) {
+    double pom_pot = (cur[bilan::T] - T_KRIT) * param[bilan::Dgw].value;
+    double pom_akt = prev_snow + cur[bilan::P] - cur[bilan::PET];
+    if (pom_akt > pom_pot) {
+      cur[bilan::INF] = pom_pot;
+      cur[bilan::SS] = pom_akt - cur[bilan::INF];
+    }
+    else {
+      cur[bilan::SS] = 0;
+      if (pom_akt > 0)
+        cur[bilan::INF] = pom_akt;
+      else {
+        cur[bilan::INF] = 0;
+        cur[bilan::ET] = cur[bilan::P] + prev_snow;
+      }
+    }
+  }
+  else {
+    cur[bilan::SS] = prev_snow + cur[bilan::P] - cur[bilan::PET];
+    cur[bilan::INF] = 0;
+  }
+}
+
+/**
+ * - daily Bilan - surface melting
+ * @param prev_snow snow in previous time step
+ */
+template <class REAL>
+void bil_kernel<REAL>::melt_daily(double prev_snow)
+{
+  double pom, melt_snow;
+
+  /*co roztaje*/
+  pom = cur[bilan::T] * param[bilan::Dgmd].value;
+  if (pom >= prev_snow) { /*roztaje vsechno*/
+    melt_snow = prev_snow;
+    cur[bilan::SS] = 0;
+  }
+  else { /*roztaje jen co muze*/
+    melt_snow = pom;
+    cur[bilan::SS] = prev_snow - melt_snow;
+  }
+
+  /*co se vypaří a infiltruje*/
+  if (cur[bilan::P] > cur[bilan::PET]) {
+    cur[bilan::INF] = melt_snow + cur[bilan::P] - cur[bilan::PET]; /*infiltruje vsechno roztaly a zbytek srazky*/
+    cur[bilan::ET] = cur[bilan::PET]; /*vypar co to jde, jen ze srazek*/
+  }
+  else {
+    cur[bilan::INF] = melt_snow; /*vsechen roztaly snih na infiltraci*/
+    cur[bilan::ET] = cur[bilan::P]; /*veskera srazka na vypar - proc nejde na vypar i snih???*/
+  }
+}
+
+/**
+ * - monthly Bilan - surface melting
+ * @param prev_snow snow in previous time step
+ */
+template <class REAL>
+void bil_kernel<REAL>::melt_monthly(double prev_snow)
+{
+  double pom_pot, pom_akt;
+
+  cur[bilan::DR] = 0;
+  cur[bilan::ET] = cur[bilan::PET];
+
+  pom_pot = cur[bilan::T] * param[bilan::Dgm].value + cur[bilan::P];
+  pom_akt = prev_snow + cur[bilan::P] - cur[bilan::PET];
+  if (pom_akt >= pom_pot) {
+    cur[bilan::INF] = pom_pot;
+    cur[bilan::SS] = pom_akt - cur[bilan::INF];
+  }
+  else {
+    cur[bilan::SS] = 0;
+    if (pom_akt > 0) {
+      cur[bilan::INF] = pom_akt;
+    }
+    else {
+      cur[bilan::INF] = 0;
+      cur[bilan::ET] = cur[bilan::P] + prev_snow;
+    }
+  }
+}
+
+/**
+ * - Bilan - soil water balance in winter
+ * @param prev_W soil storage in previous time step
+ */
+template <class REAL>
+void bil_kernel<REAL>::winter_balance(double prev_W)
+{
+  cur[bilan::SW] = prev_W + cur[bilan::INF];
+  if (cur[bilan::SW] >= param[bilan::Spa].value) { /*je plno, co je navic, odtece*/
+    cur[bilan::PERC] = cur[bilan::SW] - param[bilan::Spa].value;
+    cur[bilan::SW] = param[bilan::Spa].value;
+  }
+  else /*neni plno a neodtejka*/
+    cur[bilan::PERC] = 0;
+}
+
+/**
+ * - Bilan - surface and soil water balance in summer
+ * @param prev_W soil storage in previous time step
+ */
+template <class REAL>
+void bil_kernel<REAL>::summer_balance(double prev_W)
+{
+  cur[bilan::SS] = 0;
+
+  switch (type) {
+    case bilan::DAILY:
+      cur[bilan::DR] = 0.0;
+      break;
+    case bilan::MONTHLY:
+      cur[bilan::DR] = param[bilan::Alf].value * pow(cur[bilan::P], 2) * prev_W / param[bilan::Spa].value;
+      if (cur[bilan::DR] > cur[bilan::P])
+        cur[bilan::DR] = cur[bilan::P];
+      break;
+    default:
+      break;
+  }
+  cur[bilan::INF] = cur[bilan::P] - cur[bilan::DR]; /*vsechna srazka infiltruje*/
+  if (cur[bilan::INF] < cur[bilan::PET]) { /*velka EP, vypari se vsechno, co naprsi, a jeste navic z pudy*/
+    cur[bilan::SW] = prev_W * pow((double)M_E, (double)((cur[bilan::INF] - cur[bilan::PET]) / param[bilan::Spa].value));
+    cur[bilan::ET] = cur[bilan::INF] + prev_W - cur[bilan::SW];
+    cur[bilan::PERC] = 0;
+  }
+  else {
+    cur[bilan::ET] = cur[bilan::PET];
+    cur[bilan::SW] = prev_W + cur[bilan::INF] - cur[bilan::ET]; /*pudni zasoba se zvetsi o to, co se nevypari*/
+    if (cur[bilan::SW] > param[bilan::Spa].value) { /*kdyz je pudni nadrz plna, pretece*/
+      cur[bilan::PERC] = cur[bilan::SW] - param[bilan::Spa].value;
+      cur[bilan::SW] = param[bilan::Spa].value;
+    }
+    else
+      cur[bilan::PERC] = 0;
+  }
+}
+
+/**
+ * - includes withdrawals and release to groundwater storage and total runoff
+ */
+template <class REAL>
+void bil_kernel<REAL>::include_water_use()
+{
+  if (water_use) {
+    cur[bilan::GS] -= cur[bilan::POD];
+    cur[bilan::RM] -= cur[bilan::POV] - cur[bilan::PVN] + cur[bilan::VYP];
+    if (cur[bilan::GS] < 0)
+      cur[bilan::GS] = 0;
+    if (cur[bilan::RM] < 0)
+      cur[bilan::RM] = 0;
+  }
+}
+
+/**
+ * - daily Bilan - runoff divider for all modes
+ * @param mode model mode based on season
+ * @param prev_DS direct runoff storage in previous time step
+ * @param prev_RB groundwater storage in previous time step
+ */
+template <class REAL>
+void bil_kernel<REAL>::divide_daily(int mode, double prev_DS, double prev_RB)
+{
+  switch (mode) {
+    case bilan::TANI:
+      cur[bilan::DR] = param[bilan::Mecd].value * pow(cur[bilan::PERC], 2); //část na přímý odtok
+      if (cur[bilan::DR] > cur[bilan::PERC])
+        cur[bilan::DR] = cur[bilan::PERC];
+      cur[bilan::RC] = cur[bilan::PERC] - cur[bilan::DR]; //část do podzemní vody
+      break;
+    case bilan::LETNI:
+      cur[bilan::DR] = param[bilan::Socd].value * pow(cur[bilan::PERC], 2);
+      if (cur[bilan::DR] > cur[bilan::PERC])
+        cur[bilan::DR] = cur[bilan::PERC];
+      cur[bilan::RC] = cur[bilan::PERC] - cur[bilan::DR];
+      break;
+    case bilan::ZIMNI:
+      cur[bilan::DR] = 0;  //pro zimní tam nic neteče
+      cur[bilan::RC] = 0;
+      break;
+    default:
+      break;
+  }
+  if (cur[bilan::RC] < 0) //aby nebyl záporný přítok a nebralo se z nádrže
+    cur[bilan::RC] = 0;
+
+  cur[bilan::BF] = param[bilan::Grdd].value * prev_RB; //baseflow
+  cur[bilan::GS] = cur[bilan::RC] + prev_RB - cur[bilan::BF]; //change in groundwater storage
+  cur[bilan::DS] = cur[bilan::DR] + (1 - param[bilan::Alfd].value) * prev_DS; //change in direct runoff storage
+  cur[bilan::DR] = param[bilan::Alfd].value * cur[bilan::DS];
+  cur[bilan::RM] = cur[bilan::BF] + cur[bilan::DR]; //total runoff consisting of baseflow and direct runoff
+
+  include_water_use();
+}
+
+/**
+ * - monthly Bilan - runoff divider for all modes
+ * @param mode model mode based on season
+ * @param prev_RB groundwater storage in previous time step
+ */
+template <class REAL>
+void bil_kernel<REAL>::divide_monthly(int mode, double prev_RB)
+{
+  double pom_koef;
+  switch (mode) {
+    case bilan::TANI:
+      pom_koef = param[bilan::Mec].value;
+      break;
+    case bilan::ZIMNI:
+      pom_koef = param[bilan::Wic].value;
+      break;
+    case bilan::LETNI:
+      pom_koef = param[bilan::Soc].value;
+      break;
+    default:
+      throw bil_err("Unknown seasonal mode.");
+      break;
+  }
+  cur[bilan::RC] = cur[bilan::PERC] * (1 - pom_koef);
+  cur[bilan::BF] = param[bilan::Grd].value * prev_RB;
+  cur[bilan::GS] = cur[bilan::RC] + prev_RB - cur[bilan::BF];
+  cur[bilan::I] = pom_koef * cur[bilan::PERC];
+  cur[bilan::RM] = cur[bilan::BF] + cur[bilan::I] + cur[bilan::DR];
+
+  include_water_use();
+}
+
+/**
+ * - Bilan computation of several parameter sets (lanes) in lockstep over the same input series
+ * - only in scoring mode, modelled runoff and baseflow of each lane are added to criterion sums
+ *   (evapotranspiration and other outputs not affecting storages are not computed)
+ * - all seasonal modes and their branches are computed for every lane and the results are selected by conditions,
+ *   so that loops over lanes have no branches, the exponential of summer soil balance is evaluated before
+ *   in a separate loop only for lanes that need it
+ * - the loops over lanes can be vectorized for double or float REAL if the compiler may evaluate floating-point
+ *   operations of both alternatives (e.g. GCC with -fno-trapping-math), otherwise lanes still run independently
+ * - the operations are the same as in bil_kernel, results of a lane are equal to the run of bil_kernel with its parameters
+ */
+template <class REAL>
+class bil_kernel_batch
+{
+  public:
+    bil_kernel_batch(REAL **var, bilan::bilan_type type, bool water_use); //!< creates kernel over given columns
+
+    void set_lane(unsigned lane, const parameter *param, double init_GS); //!< sets parameters and initial storages of a lane
+    void run(unsigned ts_begin, unsigned ts_end, bil_crit_lanes *sum_RM, bil_crit_lanes *sum_BF, REAL * const *RM_out); //!< runs all lanes for a period of time steps
+
+  private:
+    REAL **var; //!< observed and modelled variables (+variable, +time step)
+    bilan::bilan_type type; //!< daily or monthly
+    bool water_use; //!< whether to use variables of water use
+
+    //!@{
+    /** @name
+     *  parameters of lanes, coefficients of runoff divider for melting, summer and winter mode
+     *  (Spa, Dgmd or Dgm, Dgw, Alf, Mecd or Mec, Socd or Soc, Wic, Grdd or Grd, Alfd)
+     */
+    double Spa[BIL_LANES], melt_coef[BIL_LANES], Dgw[BIL_LANES], Alf[BIL_LANES];
+    double div_TANI[BIL_LANES], div_LETNI[BIL_LANES], div_ZIMNI[BIL_LANES], Grd[BIL_LANES], Alfd[BIL_LANES];
+    //!@}
+    //!@{
+    /** @name
+     *  seasonal mode and storages of previous time step (snow, soil, direct runoff, groundwater)
+     */
+    int64_t season[BIL_LANES];
+    double prev_SS[BIL_LANES], prev_SW[BIL_LANES], prev_DS[BIL_LANES], prev_GS[BIL_LANES];
+    //!@}
+    double evap_fact[BIL_LANES]; //!< factor of soil storage decrease in dry summer time step
+    REAL SS_wint[BIL_LANES]; //!< snow storage after winter surface balance of current time step (monthly)
+    REAL INF_wint[BIL_LANES]; //!< infiltration after winter surface balance of current time step (monthly)
+    REAL RM[BIL_LANES]; //!< modelled runoff of current time step
+    REAL BF[BIL_LANES]; //!< modelled baseflow of current time step
+
+    void set_season(REAL T); //!< seasonal mode of current time step for all lanes
+    void step_daily(unsigned ts); //!< one time step of daily Bilan for all lanes
+    void step_monthly(unsigned ts); //!< one time step of monthly Bilan for all lanes
+    void winter_monthly(REAL P, REAL T, REAL PET); //!< winter surface balance of monthly Bilan for all lanes
+    void include_water_use(REAL& GS, REAL& RM, REAL POD, REAL use_RM, REAL use_min); //!< includes withdrawals and release of one lane
+};
+
+/**
+ * - creates kernel, lanes are then set by set_lane (unused lanes may repeat any parameters)
+ * @param var columns of variables with input data
+ * @param type daily or monthly model type
+ * @param water_use whether to use variables of water use
+ */
+template <class REAL>
+bil_kernel_batch<REAL>::bil_kernel_batch(REAL **var, bilan::bilan_type type, bool water_use)
+  : var(var), type(type), water_use(water_use)
+{
+
+}
+
+/**
+ * - copies parameters needed for the model type and sets initial state as in bilan::run_crit
+ * @param lane lane number
+ * @param param model parameters
+ * @param init_GS initial groundwater storage
+ */
+template <class REAL>
+void bil_kernel_batch<REAL>::set_lane(unsigned lane, const parameter *param, double init_GS)
+{
+  Spa[lane] = param[bilan::Spa].value;
+  if (type == bilan::DAILY) {
+    melt_coef[lane] = param[bilan::Dgmd].value;
+    Dgw[lane] = 0;
+    Alf[lane] = 0;
+    div_TANI[lane] = param[bilan::Mecd].value;
+    div_LETNI[lane] = param[bilan::Socd].value;
+    div_ZIMNI[lane] = 0;
+    Grd[lane] = param[bilan::Grdd].value;
+    Alfd[lane] = param[bilan::Alfd].value;
+  }
+  else {
+    melt_coef[lane] = param[bilan::Dgm].value;
+    Dgw[lane] = param[bilan::Dgw].value;
+    Alf[lane] = param[bilan::Alf].value;
+    div_TANI[lane] = param[bilan::Mec].value;
+    div_LETNI[lane] = param[bilan::Soc].value;
+    div_ZIMNI[lane] = param[bilan::Wic].value;
+    Grd[lane] = param[bilan::Grd].value;
+    Alfd[lane] = 0;
+  }
+
+  season[lane] = bilan::LETNI;
+  prev_SS[lane] = 0;
+  prev_SW[lane] = Spa[lane];
+  prev_DS[lane] = 0;
+  prev_GS[lane] = init_GS;
+  evap_fact[lane] = 0;
+}
+
+/**
+ * - runs the Bilan model for all lanes in daily or monthly step for time steps from ts_begin to ts_end - 1
+ * @param ts_begin the first time step
+ * @param ts_end time step after the last one
+ * @param sum_RM sums for observed and modelled runoff
+ * @param sum_BF sums for observed baseflow and modelled baseflow, null if not used
+ * @param RM_out column where modelled runoff is written for each lane (null for lanes not written), null if not needed
+ */
+template <class REAL>
+void bil_kernel_batch<REAL>::run(unsigned ts_begin, unsigned ts_end, bil_crit_lanes *sum_RM, bil_crit_lanes *sum_BF, REAL * const *RM_out)
+{
+  for (unsigned ts = ts_begin; ts < ts_end; ts++) {
+    if (type == bilan::DAILY)
+      step_daily(ts);
+    else
+      step_monthly(ts);
+
+    sum_RM->add(ts, RM);
+    if (sum_BF)
+      sum_BF->add(ts, BF);
+    if (RM_out) {
+      for (unsigned lane = 0; lane < BIL_LANES; lane++) {
+        if (RM_out[lane])
+          RM_out[lane][ts] = RM[lane];
+      }
+    }
+  }
+}
+
+/**
+ * - changes seasonal mode of previous time step to the current one, first previous is assumed to be summer
+ * @param T temperature
+ */
+template <class REAL>
+void bil_kernel_batch<REAL>::set_season(REAL T)
+{
+  bool is_warm = T >= 0;
+  for (unsigned lane = 0; lane < BIL_LANES; lane++) {
+    bool is_melt = (season[lane] == bilan::ZIMNI) | ((season[lane] == bilan::TANI) & (prev_SS[lane] > 0));
+    season[lane] = is_warm ? (is_melt ? bilan::TANI : bilan::LETNI) : bilan::ZIMNI;
+  }
+}
+
+/**
+ * - daily Bilan for all lanes - surface balance (melt_daily, winter_daily),
+ *   soil balance (winter_balance, summer_balance) and runoff divider (divide_daily) of bil_kernel
+ * @param ts current time step
+ */
+template <class REAL>
+void bil_kernel_batch<REAL>::step_daily(unsigned ts)
+{
+  REAL P = var[bilan::P][ts], T = var[bilan::T][ts], PET = var[bilan::PET][ts];
+  REAL POD = water_use ? var[bilan::POD][ts] : 0;
+  REAL use_RM = water_use ? var[bilan::POV][ts] - var[bilan::PVN][ts] + var[bilan::VYP][ts] : 0;
+  REAL use_min = water_use ? 0 : -numeric_limits<REAL>::infinity();
+  REAL INF_summ = P; //no direct runoff in daily type
+  bool is_dry = INF_summ < PET;
+  REAL P_melt = P > PET ? P : 0, PET_melt = P > PET ? PET : 0; //without rain only melted snow infiltrates
+  unsigned lane;
+
+  set_season(T);
+  if (is_dry) {
+    for (lane = 0; lane < BIL_LANES; lane++)
+      if (season[lane] == bilan::LETNI)
+        evap_fact[lane] = pow((double)M_E, (double)((INF_summ - PET) / Spa[lane]));
+  }
+
+  for (lane = 0; lane < BIL_LANES; lane++) {
+    double prev_snow = prev_SS[lane], prev_W = prev_SW[lane];
+    REAL max_W = Spa[lane];
+    bool is_melt = season[lane] == bilan::TANI, is_summer = season[lane] == bilan::LETNI;
+
+    //melting
+    double pom = T * melt_coef[lane];
+    bool is_all_melt = pom >= prev_snow;
+    double melt_snow = is_all_melt ? prev_snow : pom;
+    REAL SS_melt = prev_snow - melt_snow; //zero if all melts
+    REAL INF_melt = melt_snow + P_melt - PET_melt;
+
+    //winter surface
+    REAL SS_wint = prev_snow + P - PET;
+    SS_wint = SS_wint < 0 ? 0 : SS_wint;
+
+    //winter soil balance
+    REAL SW_wint = prev_W + (is_melt ? INF_melt : 0);
+    REAL PERC_wint = SW_wint - Spa[lane];
+    bool is_full = SW_wint >= Spa[lane];
+    PERC_wint = is_full ? PERC_wint : 0;
+    SW_wint = is_full ? max_W : SW_wint;
+
+    //summer soil balance
+    REAL SW_dry = prev_W * evap_fact[lane];
+    REAL SW_wet = prev_W + INF_summ - PET;
+    REAL PERC_wet = SW_wet - Spa[lane];
+    bool is_over = SW_wet > Spa[lane];
+    PERC_wet = is_over ? PERC_wet : 0;
+    SW_wet = is_over ? max_W : SW_wet;
+
+    REAL SS = is_summer ? 0 : (is_melt ? SS_melt : SS_wint);
+    REAL SW = is_summer ? (is_dry ? SW_dry : SW_wet) : SW_wint;
+    REAL PERC = is_summer ? (is_dry ? 0 : PERC_wet) : PERC_wint;
+
+    //runoff divider
+    REAL DR = (is_melt ? div_TANI[lane] : div_LETNI[lane]) * pow(PERC, 2);
+    DR = DR > PERC ? PERC : DR;
+    REAL RC = PERC - DR;
+    bool is_wint = !is_melt & !is_summer;
+    DR = is_wint ? 0 : DR;
+    RC = is_wint ? 0 : RC;
+    RC = RC < 0 ? 0 : RC;
+
+    REAL tmp_BF = Grd[lane] * prev_GS[lane];
+    REAL GS = RC + prev_GS[lane] - tmp_BF;
+    REAL DS = DR + (1 - Alfd[lane]) * prev_DS[lane];
+    DR = Alfd[lane] * DS;
+    REAL tmp_RM = tmp_BF + DR;
+    include_water_use(GS, tmp_RM, POD, use_RM, use_min);
+
+    BF[lane] = tmp_BF;
+    RM[lane] = tmp_RM;
+    prev_SS[lane] = SS;
+    prev_SW[lane] = SW;
+    prev_DS[lane] = DS;
+    prev_GS[lane] = GS;
+  }
+}
+
+/**
+ * - monthly Bilan for all lanes - surface balance (melt_monthly, winter_monthly),
+ *   soil balance (winter_balance, summer_balance) and runoff divider (divide_monthly) of bil_kernel
+ * @param ts current time step
+ */
+template <class REAL>
+void bil_kernel_batch<REAL>::step_monthly(unsigned ts)
+{
+  REAL P = var[bilan::P][ts], T = var[bilan::T][ts], PET = var[bilan::PET][ts];
+  REAL POD = water_use ? var[bilan::POD][ts] : 0;
+  REAL use_RM = water_use ? var[bilan::POV][ts] - var[bilan::PVN][ts] + var[bilan::VYP][ts] : 0;
+  REAL use_min = water_use ? 0 : -numeric_limits<REAL>::infinity();
+  unsigned lane;
+
+  set_season(T);
+  winter_monthly(P, T, PET);
+  for (lane = 0; lane < BIL_LANES; lane++) {
+    if (season[lane] == bilan::LETNI) {
+      REAL DR_summ = Alf[lane] * pow(P, 2) * prev_SW[lane] / Spa[lane];
+      if (DR_summ > P)
+        DR_summ = P;
+      REAL INF_summ = P - DR_summ;
+      if (INF_summ < PET)
+        evap_fact[lane] = pow((double)M_E, (double)((INF_summ - PET) / Spa[lane]));
+    }
+  }
+
+  for (lane = 0; lane < BIL_LANES; lane++) {
+    double prev_snow = prev_SS[lane], prev_W = prev_SW[lane];
+    REAL max_W = Spa[lane];
+    bool is_melt = season[lane] == bilan::TANI, is_summer = season[lane] == bilan::LETNI;
+
+    //melting
+    double pom_akt = prev_snow + P - PET;
+    double pom_pot = T * melt_coef[lane] + P;
+    bool is_pot = pom_akt >= pom_pot;
+    REAL INF_pot = pom_pot, INF_akt = pom_akt;
+    INF_akt = pom_akt > 0 ? INF_akt : 0;
+    REAL INF_melt = is_pot ? INF_pot : INF_akt;
+    REAL SS_melt = pom_akt - (is_pot ? INF_pot : pom_akt); //zero if not all can infiltrate
+
+    //winter soil balance
+    REAL SW_wint = prev_W + (is_melt ? INF_melt : INF_wint[lane]);
+    REAL PERC_wint = SW_wint - Spa[lane];
+    bool is_full = SW_wint >= Spa[lane];
+    PERC_wint = is_full ? PERC_wint : 0;
+    SW_wint = is_full ? max_W : SW_wint;
+
+    //summer soil balance with direct runoff
+    REAL DR_summ = Alf[lane] * pow(P, 2) * prev_W / Spa[lane];
+    DR_summ = DR_summ > P ? P : DR_summ;
+    REAL INF_summ = P - DR_summ;
+    bool is_dry = INF_summ < PET;
+    REAL SW_dry = prev_W * evap_fact[lane];
+    REAL SW_wet = prev_W + INF_summ - PET;
+    REAL PERC_wet = SW_wet - Spa[lane];
+    bool is_over = SW_wet > Spa[lane];
+    PERC_wet = is_over ? PERC_wet : 0;
+    SW_wet = is_over ? max_W : SW_wet;
+
+    REAL SS = is_summer ? 0 : (is_melt ? SS_melt : SS_wint[lane]);
+    REAL SW = is_summer ? (is_dry ? SW_dry : SW_wet) : SW_wint;
+    REAL PERC = is_summer ? (is_dry ? 0 : PERC_wet) : PERC_wint;
+    REAL DR = is_summer ? DR_summ : 0;
+
+    //runoff divider
+    double pom_koef = is_melt ? div_TANI[lane] : (is_summer ? div_LETNI[lane] : div_ZIMNI[lane]);
+    REAL RC = PERC * (1 - pom_koef);
+    REAL tmp_BF = Grd[lane] * prev_GS[lane];
+    REAL GS = RC + prev_GS[lane] - tmp_BF;
+    REAL I = pom_koef * PERC;
+    REAL tmp_RM = tmp_BF + I + DR;
+    include_water_use(GS, tmp_RM, POD, use_RM, use_min);
+
+    BF[lane] = tmp_BF;
+    RM[lane] = tmp_RM;
+    prev_SS[lane] = SS;
+    prev_SW[lane] = SW;
+    prev_GS[lane] = GS;
+  }
+}
+
+/**
+ * - monthly Bilan - winter surface balance (winter_monthly of bil_kernel) for all lanes
+ * - separated from the time step, so that the branch by temperature common for all lanes is outside of loops over lanes
+ * @param P precipitation
+ * @param T temperature
+ * @param PET potential evapotranspiration
+ */
+template <class REAL>
+void bil_kernel_batch<REAL>::winter_monthly(REAL P, REAL T, REAL PET)
+{
+  unsigned lane;
+  if (T > T_KRIT) {
+    for (lane = 0; lane < BIL_LANES; lane++) {
+      double pom_pot = (T - T_KRIT) * Dgw[lane];
+      double pom_akt = prev_SS[lane] + P - PET;
+      bool is_pot = pom_akt > pom_pot;
+      REAL INF_pot = pom_pot, INF_akt = pom_akt;
+      INF_akt = pom_akt > 0 ? INF_akt : 0;
+      INF_wint[lane] = is_pot ? INF_pot : INF_akt;
+      SS_wint[lane] = pom_akt - (is_pot ? INF_pot : pom_akt); //zero if not all can infiltrate
+    }
+  }
+  else {
+    for (lane = 0; lane < BIL_LANES; lane++) {
+      SS_wint[lane] = prev_SS[lane] + P - PET;
+      INF_wint[lane] = 0;
+    }
+  }
+}
+
+/**
+ * - includes withdrawals and release to groundwater storage and total runoff of one lane
+ * - computed always so that the loop over lanes has no branch, without water use the values are zero
+ *   and the lower limit is minus infinity, so that storage and runoff are not changed
+ * @param GS groundwater storage
+ * @param RM total runoff
+ * @param POD withdrawal from groundwater
+ * @param use_RM withdrawal from and release to surface water (POV - PVN + VYP)
+ * @param use_min lower limit below which storage and runoff are set to zero
+ */
+template <class REAL>
+inline void bil_kernel_batch<REAL>::include_water_use(REAL& GS, REAL& RM, REAL POD, REAL use_RM, REAL use_min)
+{
+  GS = GS - POD;
+  RM = RM - use_RM;
+  GS = GS < use_min ? 0 : GS;
+  RM = RM < use_min ? 0 : RM;
+}
+
+#endif // BIL_KERNEL_H_INCLUDED
@@ -1,4 +1,5 @@
 #include "bil_model.h"
+#include "bil_kernel.h"
 
 using namespace std;
 
@@ -199,6 +200,64 @@ bil_state::bil_state() : calen()
     st_var[sv] = 0;
 }
 
+/**
+ * - calculates mean of observed values and denominator of NS and LNNS criteria and normalization of weights
+ * - the same operations in the same order as when calculated together with the criterion
+ * @param crit_type type of optimization criterion
+ * @param var_obs observed variable
+ * @param obs observed series
+ * @param wei series of weights
+ * @param time_steps number of time steps
+ * @param use_weights whether to use weights for time steps
+ * @param sum_weights sum of weights for all time steps
+ */
+void bil_obs_stats::calc(unsigned crit_type, unsigned var_obs, const bil_real *obs, const bil_real *wei, unsigned time_steps, bool use_weights, long double sum_weights)
+{
+  this->crit_type = crit_type;
+  this->var_obs = var_obs;
+  this->time_steps = time_steps;
+  this->use_weights = use_weights;
+  this->sum_weights = sum_weights;
+  mean_weight = sum_weights / time_steps;
+  mean = 0;
+  jmen = 0;
+  log_obs.clear();
+
+  unsigned ts;
+  if ((crit_type == optimizer_gen<bilan_fcd*>::NS) || (crit_type == optimizer_gen<bilan_fcd*>::LNNS)) {
+    const bil_real *tmp_obs = obs;
+    if (crit_type == optimizer_gen<bilan_fcd*>::LNNS) {
+      log_obs.resize(time_steps);
+      for (ts = 0; ts < time_steps; ts++)
+        log_obs[ts] = log(obs[ts]); //natural logarithm
+      tmp_obs = &log_obs[0];
+    }
+    for (ts = 0; ts < time_steps; ts++)
+      mean = mean + tmp_obs[ts];
+    mean = mean / time_steps;
+
+    for (ts = 0; ts < time_steps; ts++) {
+      if (use_weights && wei[ts] < NUMERIC_EPS && wei[ts] > -NUMERIC_EPS)
+        continue;
+      jmen = jmen + pow(tmp_obs[ts] - mean, 2);
+    }
+  }
+  is_valid = true;
+}
+
+/**
+ * - checks whether statistics are valid and calculated for given settings
+ * @param crit_type type of optimization criterion
+ * @param var_obs observed variable
+ * @param use_weights whether to use weights for time steps
+ * @param sum_weights sum of weights for all time steps
+ * @return true if statistics can be used
+ */
+bool bil_obs_stats::is_valid_for(unsigned crit_type, unsigned var_obs, bool use_weights, long double sum_weights)
+{
+  return is_valid && this->crit_type == crit_type && this->var_obs == var_obs && this->use_weights == use_weights && this->sum_weights == sum_weights;
+}
+
 /**
  * - returns init date of time-series in yyyy-mm-dd format
  * @return initial date or "NA" in case of no data
@@ -335,29 +394,21 @@ bilan::bilan(const bilan& orig)
 
   unsigned v, m;
   if (orig.var != 0) {
-    var = new long double*[time_steps];
-    for (unsigned ts = 0; ts < time_steps; ts++) {
-      var[ts] = new long double[var_count];
-      for (v = 0; v < var_count; v++)
-        var[ts][v] = orig.var[ts][v];
-    }
+    var = new_columns(var_count, time_steps);
+    copy(orig.var[0], orig.var[0] + var_count * time_steps, var[0]);
   }
   else
     var = 0;
   if (orig.var_mon != 0) {
-    var_mon = new long double*[months];
-    for (m = 0; m < months; m++) {
-      var_mon[m] = new long double[var_count];
-      for (v = 0; v < var_count; v++)
-        var_mon[m][v] = orig.var_mon[m][v];
-    }
+    var_mon = new_columns(var_count, months);
+    copy(orig.var_mon[0], orig.var_mon[0] + var_count * months, var_mon[0]);
   }
   else
     var_mon = 0;
   if (orig.char_mon != 0) {
-    char_mon = new long double*[months_in_year];
+    char_mon = new bil_real*[months_in_year];
     for (m = 0; m < months_in_year; m++) {
-      char_mon[m] = new long double[var_count * 3];
+      char_mon[m] = new bil_real[var_count * 3];
       for (v = 0; v < var_count * 3; v++)
         char_mon[m][v] = orig.char_mon[m][v];
     }
@@ -409,19 +460,9 @@ bilan::bilan(const bilan& orig)
 bilan& bilan::operator=(const bilan& orig)
 {
   if (this != &orig) {
-    if (var) {
-      for (ts = 0; ts < time_steps; ts++) {
-        delete[] var[ts];
-      }
-      delete[] var;
-    }
+    delete_columns(var);
+    delete_columns(var_mon);
     unsigned m;
-    if (var_mon) {
-      for (m = 0; m < months; m++) {
-        delete[] var_mon[m];
-      }
-      delete[] var_mon;
-    }
     if (char_mon) {
       for (m = 0; m < months_in_year; m++) {
         delete[] char_mon[m];
@@ -451,29 +492,21 @@ bilan& bilan::operator=(const bilan& orig)
 
     unsigned v;
     if (orig.var != 0) {
-      var = new long double*[time_steps];
-      for (unsigned ts = 0; ts < time_steps; ts++) {
-        var[ts] = new long double[var_count];
-        for (v = 0; v < var_count; v++)
-          var[ts][v] = orig.var[ts][v];
-      }
+      var = new_columns(var_count, time_steps);
+      copy(orig.var[0], orig.var[0] + var_count * time_steps, var[0]);
     }
     else
       var = 0;
     if (orig.var_mon != 0) {
-      var_mon = new long double*[months];
-      for (m = 0; m < months; m++) {
-        var_mon[m] = new long double[var_count];
-        for (v = 0; v < var_count; v++)
-          var_mon[m][v] = orig.var_mon[m][v];
-      }
+      var_mon = new_columns(var_count, months);
+      copy(orig.var_mon[0], orig.var_mon[0] + var_count * months, var_mon[0]);
     }
     else
       var_mon = 0;
     if (orig.char_mon != 0) {
-      char_mon = new long double*[months_in_year];
+      char_mon = new bil_real*[months_in_year];
       for (m = 0; m < months_in_year; m++) {
-        char_mon[m] = new long double[var_count * 3];
+        char_mon[m] = new bil_real[var_count * 3];
         for (v = 0; v < var_count * 3; v++)
           char_mon[m][v] = orig.char_mon[m][v];
       }
@@ -508,6 +541,7 @@ bilan& bilan::operator=(const bilan& orig)
     sum_weights = orig.sum_weights;
     input_file = orig.input_file;
     are_chars = orig.are_chars;
+    clear_obs_stats();
     type = orig.type;
     prev_state = orig.prev_state;
     water_use = orig.water_use;
@@ -523,19 +557,9 @@ bilan& bilan::operator=(const bilan& orig)
 
 bilan::~bilan()
 {
-  if (var) {
-    for (ts = 0; ts < time_steps; ts++) {
-      delete[] var[ts];
-    }
-    delete[] var;
-  }
+  delete_columns(var);
+  delete_columns(var_mon);
   unsigned m;
-  if (var_mon) {
-    for (m = 0; m < months; m++) {
-      delete[] var_mon[m];
-    }
-    delete[] var_mon;
-  }
   if (char_mon) {
     for (m = 0; m < months_in_year; m++) {
       delete[] char_mon[m];
@@ -554,19 +578,10 @@ bilan::~bilan()
  */
 void bilan::change_type()
 {
-  if (var) {
-    for (ts = 0; ts < time_steps; ts++) {
-      delete[] var[ts];
-    }
-    delete[] var;
-  }
+  delete_columns(var);
+  if (type == DAILY)
+    delete_columns(var_mon);
   unsigned m;
-  if (type == DAILY && var_mon) {
-    for (m = 0; m < months; m++) {
-      delete[] var_mon[m];
-    }
-    delete[] var_mon;
-  }
   if (char_mon) {
     for (m = 0; m < months_in_year; m++) {
       delete[] char_mon[m];
@@ -587,6 +602,7 @@ void bilan::change_type()
   calen = 0;
   time_steps = months = 0;
   are_chars = false;
+  clear_obs_stats();
 
   switch (type) {
     case MONTHLY:
@@ -625,32 +641,21 @@ void bilan::set_water_use(bool water_use)
     this->water_use = water_use;
 
     bool *tmp_is_input;
-    long double **tmp_var;
+    bil_real **tmp_var;
     bool empty_var = true;
     unsigned var_count_orig = var_count, v;
 
     if (var) {
       empty_var = false;
       tmp_is_input = new bool[var_count];
-      tmp_var = new long double*[time_steps];
       for (v = 0; v < var_count; v++) {
         tmp_is_input[v] = var_is_input[v];
       }
-      for (ts = 0; ts < time_steps; ts++) {
-        tmp_var[ts] = new long double[var_count];
-        for (v = 0; v < var_count; v++)
-          tmp_var[ts][v] = var[ts][v];
-        delete[] var[ts];
-      }
-      delete[] var;
+      tmp_var = var; //columns kept until copied to the new allocation
     }
+    if (type == DAILY)
+      delete_columns(var_mon);
     unsigned m;
-    if (type == DAILY && var_mon) {
-      for (m = 0; m < months; m++) {
-        delete[] var_mon[m];
-      }
-      delete[] var_mon;
-    }
     if (char_mon) {
       for (m = 0; m < months_in_year; m++) {
         delete[] char_mon[m];
@@ -695,18 +700,41 @@ void bilan::set_water_use(bool water_use)
 
       for (v = 0; v < var_count_used; v++)
         var_is_input[v] = tmp_is_input[v];
-      for (ts = 0; ts < time_steps; ts++) {
-        for (v = 0; v < var_count_used; v++)
-          var[ts][v] = tmp_var[ts][v];
-      }
-      for (ts = 0; ts < time_steps; ts++)
-        delete[] tmp_var[ts];
-      delete[] tmp_var;
+      copy(tmp_var[0], tmp_var[0] + var_count_used * time_steps, var[0]); //columns are contiguous
+      delete_columns(tmp_var);
       delete[] tmp_is_input;
     }
   }
 }
 
+/**
+ * - allocates columns of variables in one contiguous buffer
+ * - the buffer begins with the first column, cols[0] is therefore used for its deletion
+ * @param col_count number of columns (variables)
+ * @param row_count number of rows (time steps)
+ * @return array of pointers to columns
+ */
+bil_real** bilan::new_columns(unsigned col_count, unsigned row_count)
+{
+  bil_real **cols = new bil_real*[col_count];
+  bil_real *buffer = new bil_real[col_count * row_count];
+  for (unsigned c = 0; c < col_count; c++)
+    cols[c] = buffer + c * row_count;
+  return cols;
+}
+
+/**
+ * - deletes columns allocated by new_columns, null pointer allowed
+ * @param cols array of pointers to columns
+ */
+void bilan::delete_columns(bil_real **cols)
+{
+  if (cols) {
+    delete[] cols[0];
+    delete[] cols;
+  }
+}
+
 /**
  * - initializes parameters according to model type
  */
@@ -790,20 +818,13 @@ void bilan::init_par(std::map<std::string, double>& par_inits, param_type par_ty
  */
 void bilan::init_var(unsigned new_time_steps)
 {
-  if (var) {
-    for (ts = 0; ts < time_steps; ts++) {
-      delete[] var[ts];
-    }
-    delete[] var;
-  }
+  delete_columns(var);
 
   this->time_steps = new_time_steps;
 
-  var = new long double*[time_steps];
-  for (ts = 0; ts < time_steps; ts++) {
-    var[ts] = new long double[var_count];
-    var[ts][WEI] = 1;
-  }
+  var = new_columns(var_count, time_steps);
+  for (ts = 0; ts < time_steps; ts++)
+    var[WEI][ts] = 1;
   for (unsigned v = 0; v < var_count; v++) {
     if (v != WEI)
       set_var_na(v);
@@ -897,10 +918,9 @@ void bilan::check_vars_for_optim(bool is_weight_BF)
 }
 
 /**
- * - runs the Bilan model in daily or monthly step
- * @param init_GS initial groundwater storage
+ * - checks if variables and parameters needed for model run are available
  */
-void bilan::run(long double init_GS)
+void bilan::check_vars_for_run()
 {
   if (!var)
     throw bil_err("Variables are not initialized for model run.");
@@ -910,448 +930,307 @@ void bilan::run(long double init_GS)
     throw bil_err("Variables needed for model run are not complete (P, T, PET required).");
   if (water_use && !(var_is_input[POD] && var_is_input[POV] && var_is_input[PVN] && var_is_input[VYP]))
     throw bil_err("Variables of water use needed for model run are not complete (POD, POV, PVN, VYP required).");
-  are_chars = false;
-
-  int akt_typ = LETNI; //seasonal mode for the current and previous time step
-  int predch_typ;
-
-  double predch_snih, predch_W, predch_DS, predch_RB; //hodnoty pro den - 1, takhle zvlášť kvůli ošetření prvního řádku
-
-  unsigned ts_begin;
-  if (prev_state.is_active_set)
-    ts_begin = prev_state.ts + 1;
-  else
-    ts_begin = 0;
-
-  for (ts = ts_begin; ts < time_steps; ts++) {
-    //previous state variables and dealing with both the first time and specified state
-    if (ts == ts_begin) {
-      if (prev_state.is_active_set) {
-        predch_typ = prev_state.season;
-        predch_snih = prev_state.st_var[bil_state::stSS];
-        predch_W = prev_state.st_var[bil_state::stSW];
-        predch_DS = prev_state.st_var[bil_state::stDS];
-        predch_RB = prev_state.st_var[bil_state::stGS];
-      }
-      else {
-        predch_typ = LETNI;
-        predch_snih = 0;
-        predch_W = param[Spa].value;
-        predch_DS = 0;
-        predch_RB = init_GS;
-      }
-    }
-    else {
-      predch_typ = akt_typ;
-      predch_snih = var[ts - 1][SS];
-      predch_W = var[ts - 1][SW];
-      predch_RB = var[ts - 1][GS];
-      if (type == DAILY)
-        predch_DS = var[ts - 1][DS];
-      else
-        predch_DS = 0;
-    }
-    //seasonal model, first previous is assumed to be summer
-    if (var[ts][T] >= 0) {
-      if (predch_typ == ZIMNI || (predch_typ == TANI && predch_snih > 0)) //previous winter => melting, previous melting and snow available => melting
-        akt_typ = TANI;
-      else //previous summer => summer, previous melting and no snow => summer
-        akt_typ = LETNI;
-    }
-    else
-      akt_typ = ZIMNI; //winter for negative temperature
-
-    switch (type) {
-      case DAILY:
-        switch (akt_typ) {
-          case TANI:
-            melt_daily(predch_snih);
-            winter_balance(predch_W);
-            divide_daily(akt_typ, predch_DS, predch_RB);
-            break;
-          case LETNI:
-            summer_balance(predch_W);
-            divide_daily(akt_typ, predch_DS, predch_RB);
-            break;
-          case ZIMNI:
-            winter_daily(predch_snih);
-            winter_balance(predch_W);
-            divide_daily(akt_typ, predch_DS, predch_RB);
-            break;
-          default:
-            break;
-        }
-        break;
-      case MONTHLY:
-        switch (akt_typ) {
-          case TANI:
-            melt_monthly(predch_snih);
-            winter_balance(predch_W);
-            divide_monthly(akt_typ, predch_RB);
-            break;
-          case LETNI:
-            summer_balance(predch_W);
-            divide_monthly(akt_typ, predch_RB);
-            break;
-          case ZIMNI:
-            winter_monthly(predch_snih);
-            winter_balance(predch_W);
-            divide_monthly(akt_typ, predch_RB);
-            break;
-          default:
-            break;
-        }
-        break;
-      default:
-        break;
-    }
-    if (prev_state.is_active_get && ts == prev_state.ts) {
-      prev_state.season = akt_typ;
-      prev_state.st_var[bil_state::stSS] = var[ts][SS];
-      prev_state.st_var[bil_state::stSW] = var[ts][SW];
-      prev_state.st_var[bil_state::stGS] = var[ts][GS];
-      if (type == DAILY) {
-        prev_state.st_var[bil_state::stDS] = var[ts][DS];
-      }
-    }
-  }
 }
 
 /**
- * - daily Bilan - winter surface balance
- * @param prev_snow snow in previous time step
+ * - runs the Bilan model in daily or monthly step
+ * @param init_GS initial groundwater storage
  */
-void bilan::winter_daily(double prev_snow)
+void bilan::run(long double init_GS)
 {
-  var[ts][INF] = 0;
-  var[ts][SS] = prev_snow + var[ts][P] - var[ts][PET];
-  if (var[ts][SS] < 0) {
-    var[ts][SS] = 0;
-    var[ts][ET] = prev_snow + var[ts][P];
+  check_vars_for_run();
+  are_chars = false;
+
+  int prev_season;
+  double prev_st[bil_state::st_var_count];
+  unsigned ts_begin;
+  if (prev_state.is_active_set) {
+    ts_begin = prev_state.ts + 1;
+    prev_season = prev_state.season;
+    for (unsigned s = 0; s < bil_state::st_var_count; s++)
+      prev_st[s] = prev_state.st_var[s];
   }
   else {
-    var[ts][ET] = var[ts][PET];
+    ts_begin = 0;
+    prev_season = LETNI;
+    prev_st[bil_state::stSS] = 0;
+    prev_st[bil_state::stSW] = param[Spa].value;
+    prev_st[bil_state::stGS] = init_GS;
+    prev_st[bil_state::stDS] = 0;
   }
-}
 
-/**
- * - monthly Bilan - winter surface balance
- * @param prev_snow snow in previous time step
- */
-void bilan::winter_monthly(double prev_snow)
-{
-  var[ts][DR] = 0;
-  var[ts][ET] = var[ts][PET];
-
-  if (var[ts][T] > T_KRIT) {
-    double pom_pot = (var[ts][T] - T_KRIT) * param[Dgw].value;
-    double pom_akt = prev_snow + var[ts][P] - var[ts][PET];
-    if (pom_akt > pom_pot) {
-      var[ts][INF] = pom_pot;
-      var[ts][SS] = pom_akt - var[ts][INF];
-    }
-    else {
-      var[ts][SS] = 0;
-      if (pom_akt > 0)
-        var[ts][INF] = pom_akt;
-      else {
-        var[ts][INF] = 0;
-        var[ts][ET] = var[ts][P] + prev_snow;
-      }
-    }
-  }
-  else {
-    var[ts][SS] = prev_snow + var[ts][P] - var[ts][PET];
-    var[ts][INF] = 0;
+  bil_kernel<bil_real> kernel(var, param, type, water_use);
+  if (prev_state.is_active_get) {
+    //state is stored after its time step and the run continues from storages in variables
+    prev_season = kernel.run(ts_begin, prev_state.ts + 1, prev_season, prev_st);
+    ts = prev_state.ts;
+    prev_state.season = prev_season;
+    prev_state.st_var[bil_state::stSS] = var[SS][ts];
+    prev_state.st_var[bil_state::stSW] = var[SW][ts];
+    prev_state.st_var[bil_state::stGS] = var[GS][ts];
+    if (type == DAILY)
+      prev_state.st_var[bil_state::stDS] = var[DS][ts];
+
+    ts_begin = ts + 1;
+    prev_st[bil_state::stSS] = var[SS][ts];
+    prev_st[bil_state::stSW] = var[SW][ts];
+    prev_st[bil_state::stGS] = var[GS][ts];
+    prev_st[bil_state::stDS] = type == DAILY ? (double)var[DS][ts] : 0;
   }
+  kernel.run(ts_begin, time_steps, prev_season, prev_st);
+  ts = time_steps;
 }
 
 /**
- * - daily Bilan - surface melting
- * @param prev_snow snow in previous time step
+ * - runs the model in working precision (bil_real) and in long double on copies of the same inputs
+ * - regression check of reduced precision, deviations are zero when bil_real is long double
+ * @param init_GS initial groundwater storage
+ * @param max_dev maximum absolute deviation for each variable, NA values are skipped (+variable)
  */
-void bilan::melt_daily(double prev_snow)
+void bilan::calc_precision_dev(long double init_GS, long double *max_dev)
 {
-  double pom, melt_snow;
+  run(init_GS);
 
-  /*co roztaje*/
-  pom = var[ts][T] * param[Dgmd].value;
-  if (pom >= prev_snow) { /*roztaje vsechno*/
-    melt_snow = prev_snow;
-    var[ts][SS] = 0;
-  }
-  else { /*roztaje jen co muze*/
-    melt_snow = pom;
-    var[ts][SS] = prev_snow - melt_snow;
-  }
+  vector<long double> ref_buffer(var[0], var[0] + var_count * time_steps);
+  vector<long double*> ref_var(var_count);
+  for (unsigned v = 0; v < var_count; v++)
+    ref_var[v] = &ref_buffer[0] + v * time_steps;
 
-  /*co se vypaří a infiltruje*/
-  if (var[ts][P] > var[ts][PET]) {
-    var[ts][INF] = melt_snow + var[ts][P] - var[ts][PET]; /*infiltruje vsechno roztaly a zbytek srazky*/
-    var[ts][ET] = var[ts][PET]; /*vypar co to jde, jen ze srazek*/
-  }
-  else {
-    var[ts][INF] = melt_snow; /*vsechen roztaly snih na infiltraci*/
-    var[ts][ET] = var[ts][P]; /*veskera srazka na vypar - proc nejde na vypar i snih???*/
+  double prev_st[bil_state::st_var_count];
+  prev_st[bil_state::stSS] = 0;
+  prev_st[bil_state::stSW] = param[Spa].value;
+  prev_st[bil_state::stGS] = init_GS;
+  prev_st[bil_state::stDS] = 0;
+  bil_kernel<long double> ref_kernel(&ref_var[0], param, type, water_use);
+  ref_kernel.run(0, time_steps, LETNI, prev_st);
+
+  long double tmp_dev;
+  for (unsigned v = 0; v < var_count; v++) {
+    max_dev[v] = 0;
+    for (ts = 0; ts < time_steps; ts++) {
+      if (var[v][ts] < -900 || ref_var[v][ts] < -900)
+        continue;
+      tmp_dev = fabs(ref_var[v][ts] - (long double)var[v][ts]);
+      if (tmp_dev > max_dev[v])
+        max_dev[v] = tmp_dev;
+    }
   }
 }
 
 /**
- * - monthly Bilan - surface melting
- * @param prev_snow snow in previous time step
+ * - calculates optimization criterion for observed and modelled runoff and baseflow
+ * - NS and LNNS are residuals to 1 (to be minimized)
+ * @param crit_type type of optimization criterion
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights for time steps of runoff
+ * @return value of the criterion
  */
-void bilan::melt_monthly(double prev_snow)
+long double bilan::calc_crit_RM_BF(unsigned crit_type, double weight_BF, bool use_weights)
 {
-  double pom_pot, pom_akt;
-
-  var[ts][DR] = 0;
-  var[ts][ET] = var[ts][PET];
+  long double ok = calc_crit(crit_type, R, RM, use_weights);
 
-  pom_pot = var[ts][T] * param[Dgm].value + var[ts][P];
-  pom_akt = prev_snow + var[ts][P] - var[ts][PET];
-  if (pom_akt >= pom_pot) {
-    var[ts][INF] = pom_pot;
-    var[ts][SS] = pom_akt - var[ts][INF];
-  }
-  else {
-    var[ts][SS] = 0;
-    if (pom_akt > 0) {
-      var[ts][INF] = pom_akt;
-    }
-    else {
-      var[ts][INF] = 0;
-      var[ts][ET] = var[ts][P] + prev_snow;
-    }
+  if (weight_BF > NUMERIC_EPS) {
+    ok = (1 - weight_BF) * ok + weight_BF * calc_crit(crit_type, B, BF, use_weights);
   }
+  return ok;
 }
 
 /**
- * - Bilan - soil water balance in winter
- * @param prev_W soil storage in previous time step
+ * - calculates optimization criterion for observed and modelled runoff, optionally using weights
+ * - NS and LNNS are residuals to 1 (to be minimized)
+ * @param crit_type type of optimization criterion
+ * @param var_obs observed variable
+ * @param var_mod modelled variable
+ * @param use_weights whether to use weights for time steps of runoff
+ * @return value of the criterion
  */
-void bilan::winter_balance(double prev_W)
+long double bilan::calc_crit(unsigned crit_type, unsigned var_obs, unsigned var_mod, bool use_weights)
 {
-  var[ts][SW] = prev_W + var[ts][INF];
-  if (var[ts][SW] >= param[Spa].value) { /*je plno, co je navic, odtece*/
-    var[ts][PERC] = var[ts][SW] - param[Spa].value;
-    var[ts][SW] = param[Spa].value;
-  }
-  else /*neni plno a neodtejka*/
-    var[ts][PERC] = 0;
+  bil_crit_sum sums(get_obs_stats(crit_type, var_obs, use_weights), var[var_obs], var[WEI]);
+
+  for (ts = 0; ts < time_steps; ts++)
+    sums.add(ts, var[var_mod][ts]);
+
+  return sums.get();
 }
 
 /**
- * - Bilan - surface and soil water balance in summer
- * @param prev_W soil storage in previous time step
+ * - gets statistics of observed variable, calculates them only if data or settings changed
+ * @param crit_type type of optimization criterion
+ * @param var_obs observed variable
+ * @param use_weights whether to use weights for time steps
+ * @return statistics of observed variable
  */
-void bilan::summer_balance(double prev_W)
+const bil_obs_stats& bilan::get_obs_stats(unsigned crit_type, unsigned var_obs, bool use_weights)
 {
-  var[ts][SS] = 0;
+  bil_obs_stats &stats = obs_stats[var_obs == R ? 0 : 1];
+  if (!stats.is_valid_for(crit_type, var_obs, use_weights, sum_weights))
+    stats.calc(crit_type, var_obs, var[var_obs], var[WEI], time_steps, use_weights, sum_weights);
 
-  switch (type) {
-    case DAILY:
-      var[ts][DR] = 0.0;
-      break;
-    case MONTHLY:
-      var[ts][DR] = param[Alf].value * pow(var[ts][P], 2) * prev_W / param[Spa].value;
-      if (var[ts][DR] > var[ts][P])
-        var[ts][DR] = var[ts][P];
-      break;
-    default:
-      break;
-  }
-  var[ts][INF] = var[ts][P] - var[ts][DR]; /*vsechna srazka infiltruje*/
-  if (var[ts][INF] < var[ts][PET]) { /*velka EP, vypari se vsechno, co naprsi, a jeste navic z pudy*/
-    var[ts][SW] = prev_W * pow((double)M_E, (double)((var[ts][INF] - var[ts][PET]) / param[Spa].value));
-    var[ts][ET] = var[ts][INF] + prev_W - var[ts][SW];
-    var[ts][PERC] = 0;
-  }
-  else {
-    var[ts][ET] = var[ts][PET];
-    var[ts][SW] = prev_W + var[ts][INF] - var[ts][ET]; /*pudni zasoba se zvetsi o to, co se nevypari*/
-    if (var[ts][SW] > param[Spa].value) { /*kdyz je pudni nadrz plna, pretece*/
-      var[ts][PERC] = var[ts][SW] - param[Spa].value;
-      var[ts][SW] = param[Spa].value;
-    }
-    else
-      var[ts][PERC] = 0;
-  }
+  return stats;
 }
 
 /**
- * - includes withdrawals and release to groundwater storage and total runoff
+ * - runs the model and calculates optimization criterion for observed and modelled runoff and baseflow in one pass
+ * - output variables are not written (except optionally modelled runoff), only for calibration
+ * - NS and LNNS are residuals to 1 (to be minimized)
+ * - only reads the model when statistics of observed data are prepared, so it can be called concurrently with private parameters and runoff column
+ * @param init_GS initial groundwater storage
+ * @param crit_type type of optimization criterion
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights for time steps of runoff
+ * @param run_param parameters for the run, null for parameters of model
+ * @param RM_out column where modelled runoff is written, null if not needed
+ * @param crit_BF criterion of baseflow alone (calculated for any weight_BF), null if not needed
+ * @return value of the criterion
  */
-void bilan::include_water_use()
+long double bilan::run_crit(long double init_GS, unsigned crit_type, double weight_BF, bool use_weights, const parameter *run_param, bil_real *RM_out, long double *crit_BF)
 {
-  if (water_use) {
-    var[ts][GS] -= var[ts][POD];
-    var[ts][RM] -= var[ts][POV] - var[ts][PVN] + var[ts][VYP];
-    if (var[ts][GS] < 0)
-      var[ts][GS] = 0;
-    if (var[ts][RM] < 0)
-      var[ts][RM] = 0;
+  check_vars_for_run();
+  if (!run_param)
+    run_param = param;
+
+  double prev_st[bil_state::st_var_count];
+  prev_st[bil_state::stSS] = 0;
+  prev_st[bil_state::stSW] = run_param[Spa].value;
+  prev_st[bil_state::stGS] = init_GS;
+  prev_st[bil_state::stDS] = 0;
+
+  bool is_BF = weight_BF > NUMERIC_EPS || crit_BF;
+  bil_crit_sum sum_RM(get_obs_stats(crit_type, R, use_weights), var[R], var[WEI]);
+  bil_crit_sum sum_BF;
+  if (is_BF)
+    sum_BF = bil_crit_sum(get_obs_stats(crit_type, B, use_weights), var[B], var[WEI]);
+
+  bil_kernel<bil_real> kernel(var, run_param, type, water_use);
+  kernel.set_scoring(&sum_RM, is_BF ? &sum_BF : 0, RM_out);
+  kernel.run(0, time_steps, LETNI, prev_st);
+
+  long double ok = sum_RM.get(), ok_BF;
+  if (is_BF) {
+    ok_BF = sum_BF.get();
+    if (weight_BF > NUMERIC_EPS)
+      ok = (1 - weight_BF) * ok + weight_BF * ok_BF;
+    if (crit_BF)
+      *crit_BF = ok_BF;
   }
+  return ok;
 }
 
 /**
- * - daily Bilan - runoff divider for all modes
- * @param mode model mode based on season
- * @param prev_DS direct runoff storage in previous time step
- * @param prev_RB groundwater storage in previous time step
+ * - runs the model from the beginning with given parameters and writes selected output variables to separate columns,
+ *   variables of the model are not written and state settings are not used
+ * - only reads the model, so it can be called concurrently with private parameters and columns
+ * @param init_GS initial groundwater storage
+ * @param run_param parameters for the run, null for parameters of model
+ * @param out_vars output variables to be written
+ * @param out_count number of output variables
+ * @param out_cols column for each output variable (of length of time steps)
  */
-void bilan::divide_daily(int mode, double prev_DS, double prev_RB)
+void bilan::run_vars(long double init_GS, const parameter *run_param, const unsigned *out_vars, unsigned out_count, bil_real **out_cols)
 {
-  switch (mode) {
-    case TANI:
-      var[ts][DR] = param[Mecd].value * pow(var[ts][PERC], 2); //část na přímý odtok
-      if (var[ts][DR] > var[ts][PERC])
-        var[ts][DR] = var[ts][PERC];
-      var[ts][RC] = var[ts][PERC] - var[ts][DR]; //část do podzemní vody
-      break;
-    case LETNI:
-      var[ts][DR] = param[Socd].value * pow(var[ts][PERC], 2);
-      if (var[ts][DR] > var[ts][PERC])
-        var[ts][DR] = var[ts][PERC];
-      var[ts][RC] = var[ts][PERC] - var[ts][DR];
-      break;
-    case ZIMNI:
-      var[ts][DR] = 0;  //pro zimní tam nic neteče
-      var[ts][RC] = 0;
-      break;
-    default:
-      break;
+  check_vars_for_run();
+  for (unsigned o = 0; o < out_count; o++) {
+    if (!is_output_var(out_vars[o]))
+      throw bil_err("Only output variables of the model can be written.");
   }
-  if (var[ts][RC] < 0) //aby nebyl záporný přítok a nebralo se z nádrže
-    var[ts][RC] = 0;
-
-  var[ts][BF] = param[Grdd].value * prev_RB; //baseflow
-  var[ts][GS] = var[ts][RC] + prev_RB - var[ts][BF]; //change in groundwater storage
-  var[ts][DS] = var[ts][DR] + (1 - param[Alfd].value) * prev_DS; //change in direct runoff storage
-  var[ts][DR] = param[Alfd].value * var[ts][DS];
-  var[ts][RM] = var[ts][BF] + var[ts][DR]; //total runoff consisting of baseflow and direct runoff
-
-  include_water_use();
+  if (!run_param)
+    run_param = param;
+
+  double prev_st[bil_state::st_var_count];
+  prev_st[bil_state::stSS] = 0;
+  prev_st[bil_state::stSW] = run_param[Spa].value;
+  prev_st[bil_state::stGS] = init_GS;
+  prev_st[bil_state::stDS] = 0;
+
+  bil_kernel<bil_real> kernel(var, run_param, type, water_use);
+  kernel.set_outputs(out_vars, out_count, out_cols);
+  kernel.run(0, time_steps, LETNI, prev_st);
 }
 
 /**
- * - monthly Bilan - runoff divider for all modes
- * @param mode model mode based on season
- * @param prev_RB groundwater storage in previous time step
+ * - checks whether variable is calculated by the model
+ * @param var_n variable number
+ * @return whether variable is an output
  */
-void bilan::divide_monthly(int mode, double prev_RB)
+bool bilan::is_output_var(unsigned var_n)
 {
-  double pom_koef;
-  switch (mode) {
-    case TANI:
-      pom_koef = param[Mec].value;
-      break;
-    case ZIMNI:
-      pom_koef = param[Wic].value;
-      break;
-    case LETNI:
-      pom_koef = param[Soc].value;
-      break;
+  switch (var_n) {
+    case RM: case BF: case DS: case DR: case ET: case SW: case SS: case GS: case INF: case PERC: case RC:
+      return true;
     default:
-      throw bil_err("Unknown seasonal mode.");
-      break;
+      return false;
   }
-  var[ts][RC] = var[ts][PERC] * (1 - pom_koef);
-  var[ts][BF] = param[Grd].value * prev_RB;
-  var[ts][GS] = var[ts][RC] + prev_RB - var[ts][BF];
-  var[ts][I] = pom_koef * var[ts][PERC];
-  var[ts][RM] = var[ts][BF] + var[ts][I] + var[ts][DR];
-
-  include_water_use();
 }
 
 /**
- * - calculates optimization criterion for observed and modelled runoff and baseflow
- * - NS and LNNS are residuals to 1 (to be minimized)
+ * - runs the model for several parameter sets and calculates optimization criterion of each in one pass as run_crit
+ * - parameter sets are run by batch kernel in groups of BIL_LANES, the last group is completed by repeating the last set,
+ *   or its sets are run one by one if they would not fill even half of the lanes
+ * - only reads the model when statistics of observed data are prepared, so it can be called concurrently
+ * @param init_GS initial groundwater storage
  * @param crit_type type of optimization criterion
  * @param weight_BF weight for baseflow
  * @param use_weights whether to use weights for time steps of runoff
- * @return value of the criterion
+ * @param run_params parameters for each run
+ * @param run_count number of parameter sets
+ * @param crits values of the criterion for parameter sets
+ * @param crits_BF values of criterion of baseflow alone (calculated for any weight_BF), null if not needed
+ * @param RM_out columns where modelled runoff of each parameter set is written, null if not needed
  */
-long double bilan::calc_crit_RM_BF(unsigned crit_type, double weight_BF, bool use_weights)
+void bilan::run_crit_batch(long double init_GS, unsigned crit_type, double weight_BF, bool use_weights, const parameter * const *run_params, unsigned run_count, long double *crits, long double *crits_BF, bil_real **RM_out)
 {
-  long double ok = calc_crit(crit_type, R, RM, use_weights);
-
-  if (weight_BF > NUMERIC_EPS) {
-    ok = (1 - weight_BF) * ok + weight_BF * calc_crit(crit_type, B, BF, use_weights);
+  check_vars_for_run();
+
+  bool is_BF = weight_BF > NUMERIC_EPS || crits_BF;
+  const bil_obs_stats &stats_RM = get_obs_stats(crit_type, R, use_weights);
+  const bil_obs_stats *stats_BF = is_BF ? &get_obs_stats(crit_type, B, use_weights) : 0;
+
+  bil_kernel_batch<bil_real> kernel(var, type, water_use);
+  for (unsigned run_first = 0; run_first < run_count; run_first += BIL_LANES) {
+    unsigned lane_count = min(run_count - run_first, static_cast<unsigned>(BIL_LANES));
+    if (lane_count < BIL_LANES / 2) {
+      for (unsigned lane = 0; lane < lane_count; lane++)
+        crits[run_first + lane] = run_crit(init_GS, crit_type, weight_BF, use_weights, run_params[run_first + lane], RM_out ? RM_out[run_first + lane] : 0, crits_BF ? crits_BF + run_first + lane : 0);
+      continue;
+    }
+    for (unsigned lane = 0; lane < BIL_LANES; lane++)
+      kernel.set_lane(lane, run_params[run_first + min(lane, lane_count - 1)], init_GS);
+
+    bil_crit_lanes sum_RM(stats_RM, var[R], var[WEI]);
+    bil_crit_lanes sum_BF;
+    if (is_BF)
+      sum_BF = bil_crit_lanes(*stats_BF, var[B], var[WEI]);
+    bil_real *lane_RM[BIL_LANES];
+    for (unsigned lane = 0; lane < BIL_LANES; lane++)
+      lane_RM[lane] = RM_out && lane < lane_count ? RM_out[run_first + lane] : 0;
+    kernel.run(0, time_steps, &sum_RM, is_BF ? &sum_BF : 0, RM_out ? lane_RM : 0);
+
+    for (unsigned lane = 0; lane < lane_count; lane++) {
+      long double ok = sum_RM.get(lane), ok_BF;
+      if (is_BF) {
+        ok_BF = sum_BF.get(lane);
+        if (weight_BF > NUMERIC_EPS)
+          ok = (1 - weight_BF) * ok + weight_BF * ok_BF;
+        if (crits_BF)
+          crits_BF[run_first + lane] = ok_BF;
+      }
+      crits[run_first + lane] = ok;
+    }
   }
-  return ok;
 }
 
 /**
- * - calculates optimization criterion for observed and modelled runoff, optionally using weights
- * - NS and LNNS are residuals to 1 (to be minimized)
+ * - calculates statistics of observed runoff and baseflow in advance, criterion can be then calculated without changing the model
  * @param crit_type type of optimization criterion
- * @param var_obs observed variable
- * @param var_mod modelled variable
+ * @param weight_BF weight for baseflow
  * @param use_weights whether to use weights for time steps of runoff
- * @return value of the criterion
  */
-long double bilan::calc_crit(unsigned crit_type, unsigned var_obs, unsigned var_mod, bool use_weights)
+void bilan::prepare_obs_stats(unsigned crit_type, double weight_BF, bool use_weights)
 {
-  long double cit, jmen;
-  long double ok = 0, mean = 0; //TDD otestovat NS
-
-  if ((crit_type == optimizer<bilan_fcd*>::NS) || (crit_type == optimizer<bilan_fcd*>::LNNS)) {
-    cit = 0;
-    jmen = 0;
-    mean = 0;
-
-    for (ts = 0; ts < time_steps; ts++) {
-      if (crit_type == optimizer<bilan_fcd*>::NS)
-        mean = mean + var[ts][var_obs];
-      else
-        mean = mean + log(var[ts][var_obs]); //natural logarithm
-    }
-    mean = mean / time_steps;
-  }
-
-  long double tmp_weight;
-  for (ts = 0; ts < time_steps; ts++) {
-    if (use_weights) {
-      if (var[ts][WEI] < NUMERIC_EPS && var[ts][WEI] > -NUMERIC_EPS)
-        continue;
-      tmp_weight = var[ts][WEI] / (sum_weights / time_steps);
-    }
-    else
-      tmp_weight = 1;
-
-    switch (crit_type) {
-      case optimizer<bilan_fcd*>::MSE:
-        ok = ok + tmp_weight * pow((var[ts][var_obs] - var[ts][var_mod]), 2); //standard error
-        break;
-      case optimizer<bilan_fcd*>::MAE:
-        ok = ok + tmp_weight * abs(var[ts][var_obs] - var[ts][var_mod]); //mean absolute error
-        break;
-      case optimizer<bilan_fcd*>::MAPE:
-        ok = ok + tmp_weight * abs(var[ts][var_obs] - var[ts][var_mod]) / var[ts][var_obs]; //mean absolute percentage error
-        break;
-      case optimizer<bilan_fcd*>::NS: //Nash-Sutcliffe efficiency
-        cit = cit + tmp_weight * pow(var[ts][var_obs] - var[ts][var_mod], 2);
-        jmen = jmen + pow(var[ts][var_obs] - mean, 2);
-        break;
-      case optimizer<bilan_fcd*>::LNNS: //logarithmic Nash-Sutcliffe efficiency
-        cit = cit + tmp_weight * pow(log(var[ts][var_obs]) - log(var[ts][var_mod]), 2);
-        jmen = jmen + pow(log(var[ts][var_obs]) - mean, 2);
-        break;
-      default:
-        break;
-    }
-  }
-
-  if ((crit_type == optimizer<bilan_fcd*>::MSE) || (crit_type == optimizer<bilan_fcd*>::MAE) || (crit_type == optimizer<bilan_fcd*>::MAPE))
-    ok = ok / time_steps;
-  else if ((crit_type == optimizer<bilan_fcd*>::NS) || (crit_type == optimizer<bilan_fcd*>::LNNS))
-    ok = cit / jmen;
-
-  if (ok == numeric_limits<long double>::infinity()) //zero modelled value matters for LNNS
-    throw bil_err("Optimization criterion value is infinity (probably due to zero observed or modelled value).");
-
-  return ok;
+  get_obs_stats(crit_type, R, use_weights);
+  if (weight_BF > NUMERIC_EPS)
+    get_obs_stats(crit_type, B, use_weights);
 }
 
 /**
@@ -1379,15 +1258,16 @@ void bilan_fcd::check_vars_for_optim(bool is_weight_BF)
  */
 double bilan_fcd::get_param(unsigned par_n, optimizer_gen<bilan_fcd*>::param_type par_type)
 {
+  parameter *tmp_param = wrk_param ? wrk_param : pbil->param;
   switch (par_type) {
   case parameter::INIT:
-      return pbil->param[par_n].initial;
+      return tmp_param[par_n].initial;
     case parameter::CURR:
-      return pbil->param[par_n].value;
+      return tmp_param[par_n].value;
     case parameter::LOWER:
-      return pbil->param[par_n].lower;
+      return tmp_param[par_n].lower;
     case parameter::UPPER:
-      return pbil->param[par_n].upper;
+      return tmp_param[par_n].upper;
     default:
       throw bil_err("Undefined parameter type.");
       break;
@@ -1402,18 +1282,19 @@ double bilan_fcd::get_param(unsigned par_n, optimizer_gen<bilan_fcd*>::param_typ
  */
 void bilan_fcd::set_param(unsigned par_n, optimizer_gen<bilan_fcd*>::param_type par_type, double value)
 {
+  parameter *tmp_param = wrk_param ? wrk_param : pbil->param;
   switch (par_type) {
     case parameter::INIT:
-      pbil->param[par_n].initial = value;
+      tmp_param[par_n].initial = value;
       break;
     case parameter::CURR:
-      pbil->param[par_n].value = value;
+      tmp_param[par_n].value = value;
       break;
     case parameter::LOWER:
-      pbil->param[par_n].lower = value;
+      tmp_param[par_n].lower = value;
       break;
     case parameter::UPPER:
-      pbil->param[par_n].upper = value;
+      tmp_param[par_n].upper = value;
       break;
     default:
       break;
@@ -1453,6 +1334,8 @@ std::string bilan_fcd::get_param_name(unsigned par_n)
  */
 void bilan_fcd::run(long double init_GS)
 {
+  if (wrk_param)
+    throw bil_err("Worker functoid cannot run the model with outputs.");
   pbil->run(init_GS);
 }
 
@@ -1465,5 +1348,181 @@ void bilan_fcd::run(long double init_GS)
  */
 long double bilan_fcd::calc_crit(unsigned crit, double weight_BF, bool use_weights)
 {
+  if (wrk_param)
+    throw bil_err("Worker functoid cannot calculate criterion from outputs.");
   return pbil->calc_crit_RM_BF(crit, weight_BF, use_weights);
 }
+
+/**
+ * - runs the model and calculates optimization criterion value without storing output variables
+ * @param init_GS initial groundwater storage
+ * @param crit criterion type
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights
+ * @return criterion value
+ */
+long double bilan_fcd::run_crit(long double init_GS, unsigned crit, double weight_BF, bool use_weights)
+{
+  return pbil->run_crit(init_GS, crit, weight_BF, use_weights, wrk_param, 0);
+}
+
+/**
+ * - runs the model for parameters of several models and stores criterion value of each in the last row
+ * - parameters not given by models are taken from the model (or from the worker)
+ * @param init_GS initial groundwater storage
+ * @param crit criterion type
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights
+ * @param models parameters of models and their criterion in the last row - matrix(par_count+1, number of models)
+ * @param model_first index of the first model to run
+ * @param model_count number of models to run
+ * @param crits criterion values of the models in full precision, null if not needed
+ * @param RM_out columns for modelled runoff of the models (each of length of time steps), null if not needed
+ */
+void bilan_fcd::run_crit_batch(long double init_GS, unsigned crit, double weight_BF, bool use_weights, double **models, unsigned model_first, unsigned model_count, long double *crits, bil_real **RM_out)
+{
+  if (model_count == 0)
+    return;
+  unsigned par_count = pbil->par_count;
+  const parameter *tmp_param = wrk_param ? wrk_param : pbil->param;
+  vector<parameter> batch_param(model_count * par_count);
+  vector<const parameter*> run_params(model_count);
+  vector<long double> batch_crits(model_count);
+  for (unsigned m = 0; m < model_count; m++) {
+    for (unsigned par = 0; par < par_count; par++) {
+      batch_param[m * par_count + par] = tmp_param[par];
+      batch_param[m * par_count + par].value = models[par][model_first + m];
+    }
+    run_params[m] = &batch_param[m * par_count];
+  }
+  pbil->run_crit_batch(init_GS, crit, weight_BF, use_weights, &run_params[0], model_count, &batch_crits[0], 0, RM_out);
+  for (unsigned m = 0; m < model_count; m++) {
+    models[par_count][model_first + m] = batch_crits[m];
+    if (crits)
+      crits[m] = batch_crits[m];
+  }
+}
+
+/**
+ * - runs the model for parameters of several models and stores criteria of runoff and baseflow of each in the last two rows
+ * - both criteria are calculated from one run, for multi-objective optimization
+ * @param init_GS initial groundwater storage
+ * @param crit criterion type
+ * @param use_weights whether to use weights
+ * @param models parameters of models and their criteria of runoff and baseflow in the last rows - matrix(par_count+2, number of models)
+ * @param model_first index of the first model to run
+ * @param model_count number of models to run
+ */
+void bilan_fcd::run_objs_batch(long double init_GS, unsigned crit, bool use_weights, double **models, unsigned model_first, unsigned model_count)
+{
+  if (model_count == 0)
+    return;
+  unsigned par_count = pbil->par_count;
+  const parameter *tmp_param = wrk_param ? wrk_param : pbil->param;
+  vector<parameter> batch_param(model_count * par_count);
+  vector<const parameter*> run_params(model_count);
+  vector<long double> batch_crits(model_count), batch_crits_BF(model_count);
+  for (unsigned m = 0; m < model_count; m++) {
+    for (unsigned par = 0; par < par_count; par++) {
+      batch_param[m * par_count + par] = tmp_param[par];
+      batch_param[m * par_count + par].value = models[par][model_first + m];
+    }
+    run_params[m] = &batch_param[m * par_count];
+  }
+  pbil->run_crit_batch(init_GS, crit, 0, use_weights, &run_params[0], model_count, &batch_crits[0], &batch_crits_BF[0]);
+  for (unsigned m = 0; m < model_count; m++) {
+    models[par_count][model_first + m] = batch_crits[m];
+    models[par_count + 1][model_first + m] = batch_crits_BF[m];
+  }
+}
+
+/**
+ * - runs the model for parameters of several models one by one and writes selected outputs of each to separate columns
+ * - models are not changed, criterion values are not calculated
+ * @param init_GS initial groundwater storage
+ * @param models parameters of models - matrix(par_count, number of models) at least
+ * @param model_first index of the first model to run
+ * @param model_count number of models to run
+ * @param out_vars output variables to be written
+ * @param out_cols columns for outputs of the models, out_vars.size() consecutive columns for each model (each of length of time steps)
+ */
+void bilan_fcd::run_vars_batch(long double init_GS, double **models, unsigned model_first, unsigned model_count, const vector<unsigned> &out_vars, bil_real **out_cols)
+{
+  if (out_vars.empty())
+    return;
+  unsigned par_count = pbil->par_count, out_count = out_vars.size();
+  const parameter *tmp_param = wrk_param ? wrk_param : pbil->param;
+  vector<parameter> run_param(tmp_param, tmp_param + par_count);
+  for (unsigned m = 0; m < model_count; m++) {
+    for (unsigned par = 0; par < par_count; par++)
+      run_param[par].value = models[par][model_first + m];
+    pbil->run_vars(init_GS, &run_param[0], &out_vars[0], out_count, out_cols + m * out_count);
+  }
+}
+
+/**
+ * - runs the model for parameters of several models one by one and writes modelled runoff of each to a separate column
+ * @param init_GS initial groundwater storage
+ * @param models parameters of models - matrix(par_count, number of models) at least
+ * @param model_first index of the first model to run
+ * @param model_count number of models to run
+ * @param RM_out columns for modelled runoff of the models (each of length of time steps)
+ */
+void bilan_fcd::run_RM_batch(long double init_GS, double **models, unsigned model_first, unsigned model_count, bil_real **RM_out)
+{
+  run_vars_batch(init_GS, models, model_first, model_count, vector<unsigned>(1, bilan::RM), RM_out);
+}
+
+/**
+ * - gets number of time steps of a model run, used to estimate the cost of optimization
+ * @return number of time steps
+ */
+unsigned bilan_fcd::get_time_steps()
+{
+  return pbil->time_steps;
+}
+
+/**
+ * - invalidates statistics of observed data, they are calculated again at first criterion calculation
+ */
+void bilan_fcd::clear_obs_stats()
+{
+  pbil->clear_obs_stats();
+}
+
+/**
+ * - calculates statistics of observed data, needed before the model is evaluated by several threads
+ * @param crit criterion type
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights
+ */
+void bilan_fcd::prepare_obs_stats(unsigned crit, double weight_BF, bool use_weights)
+{
+  pbil->prepare_obs_stats(crit, weight_BF, use_weights);
+}
+
+/**
+ * - creates functoid for a worker thread, it has its own copy of parameters and shares input data with the model
+ * - worker can only set parameters and run the model with criterion calculation (statistics of observed data have to be prepared)
+ * @return new functoid to be deleted by delete_worker
+ */
+bilan_fcd* bilan_fcd::new_worker()
+{
+  bilan_fcd *worker = new bilan_fcd(pbil);
+  worker->wrk_param = new parameter[pbil->par_count];
+  for (unsigned par = 0; par < pbil->par_count; par++)
+    worker->wrk_param[par] = pbil->param[par];
+  return worker;
+}
+
+/**
+ * - deletes functoid of worker thread
+ * @param worker functoid created by new_worker
+ */
+void bilan_fcd::delete_worker(bilan_fcd *worker)
+{
+  if (worker) {
+    delete[] worker->wrk_param;
+    delete worker;
+  }
+}
@@ -30,6 +30,14 @@ class bil_err
     std::string descr; //!< description of the error
 };
 
+#ifndef BIL_REAL
+//! floating-point type of model variables, states and criterion sums - can be set to double or float by -DBIL_REAL
+#define BIL_REAL long double
+#endif
+
+//! working precision of the simulation core
+typedef BIL_REAL bil_real;
+
 #include "bil_optim.h" //at least due to enum param_type in optimizer which cannot be forward declared
 
 //to be uncommented for R interface
@@ -46,6 +54,18 @@ class bil_err
 //! epsilon related to machine precision
 #define NUMERIC_EPS numeric_limits<long double>::epsilon()
 
+#ifndef BIL_LANES
+//! number of parameter sets run in lockstep by batch kernel (vector width) - can be changed by -DBIL_LANES
+#define BIL_LANES 8
+#endif
+
+//!@{
+//! name of working precision type as a string
+#define BIL_STRINGIFY(x) #x
+#define BIL_EXPAND_NAME(x) BIL_STRINGIFY(x)
+#define BIL_REAL_NAME BIL_EXPAND_NAME(BIL_REAL)
+//!@}
+
 /**
  * - day, month and year
  */
@@ -102,6 +122,30 @@ class parameter
     double initial; //!< initial value
 };
 
+/**
+ * - read-only contents of a whole file, memory-mapped where available (otherwise read into a buffer)
+ */
+class bil_mapped_file
+{
+  public:
+    bil_mapped_file(std::string file_name); //!< maps given file
+    ~bil_mapped_file();
+
+    //! gets contents of the file
+    const char* get_data() const { return data; };
+    //! gets size of the file in bytes
+    size_t get_size() const { return size; };
+
+  private:
+    const char *data; //!< contents of the file
+    size_t size; //!< size of the file in bytes
+    bool is_mapped; //!< whether the file is memory-mapped
+    std::vector<char> buffer; //!< contents of the file if not mapped
+
+    bil_mapped_file(const bil_mapped_file&); //!< not to be copied
+    bil_mapped_file& operator=(const bil_mapped_file&); //!< not to be assigned
+};
+
 /**
  * - properties of input file
  * - allows to separate reading of header
@@ -116,7 +160,10 @@ class input_file_info
     bool old_style; //!< if old style format of file is used
     string rows[4]; //!< the first two or four (old style) header lines
 
-    void read_header(string file_name); //!< reads header from given file
+    void read_header(const bil_mapped_file &file, string file_name); //!< reads header from contents of given file
+    static const char* find_line_end(const char *line, const char *end); //!< finds end of line
+    static bool is_blank(const char *line, const char *line_end); //!< whether line contains only white characters
+    static bool parse_number(const char *&pos, const char *line_end, long double &value); //!< parses the next number in line
 
 	private:
 
@@ -140,7 +187,35 @@ class bil_state
     //! names of state variables, DS unused for monthly type
     enum state_var_names {stSS, stSW, stGS, stDS};
     static const unsigned st_var_count = 4; //!< number of state variables
-    long double st_var[st_var_count]; //!< state variables (reservoir storages)
+    bil_real st_var[st_var_count]; //!< state variables (reservoir storages)
+
+	private:
+
+};
+
+/**
+ * - statistics of observed series used by optimization criteria
+ * - depend only on observed data and weights, so they are kept until the data change
+ */
+class bil_obs_stats
+{
+  public:
+    bil_obs_stats() : is_valid(false), crit_type(0), var_obs(0), time_steps(0), use_weights(false), sum_weights(0), mean(0), mean_weight(0), jmen(0) {};
+    ~bil_obs_stats() {};
+
+    void calc(unsigned crit_type, unsigned var_obs, const bil_real *obs, const bil_real *wei, unsigned time_steps, bool use_weights, long double sum_weights); //!< calculates statistics for given criterion and series
+    bool is_valid_for(unsigned crit_type, unsigned var_obs, bool use_weights, long double sum_weights); //!< whether calculated for given settings
+
+    bool is_valid; //!< whether statistics are calculated and data unchanged
+    unsigned crit_type; //!< criterion type of statistics
+    unsigned var_obs; //!< observed variable
+    unsigned time_steps; //!< number of time steps
+    bool use_weights; //!< whether weights were used
+    long double sum_weights; //!< sum of weights used for calculation
+    bil_real mean; //!< mean of observed values (of their logarithms for LNNS)
+    long double mean_weight; //!< mean weight for normalization of weights
+    bil_real jmen; //!< sum of squared deviations from mean - denominator of NS and LNNS
+    std::vector<bil_real> log_obs; //!< logarithms of observed values (LNNS only)
 
 	private:
 
@@ -155,9 +230,9 @@ class bilan;
 class bilan_fcd
 {
   public:
-    bilan_fcd() { pbil = 0; };
+    bilan_fcd() { pbil = 0; wrk_param = 0; };
     //! creation of functoid for bilan
-    bilan_fcd(bilan *bil) { pbil = bil; };
+    bilan_fcd(bilan *bil) { pbil = bil; wrk_param = 0; };
     //! sets pointer to bilan
     void set(bilan *bil) { pbil = bil; };
     void calc_sum_weights(); //!< calculates sum of weights for optimization
@@ -169,9 +244,22 @@ class bilan_fcd
     std::string get_param_name(unsigned par_n); //!< gets name of parameter
     void run(long double init_GS); //!< runs the model
     long double calc_crit(unsigned crit, double weight_BF, bool use_weights); //!< calculates optimization criterion value
+    long double run_crit(long double init_GS, unsigned crit, double weight_BF, bool use_weights); //!< runs the model and calculates criterion in one pass
+    void run_crit_batch(long double init_GS, unsigned crit, double weight_BF, bool use_weights, double **models, unsigned model_first, unsigned model_count, long double *crits = 0, bil_real **RM_out = 0); //!< runs a batch of parameter sets and calculates their criteria
+    void run_objs_batch(long double init_GS, unsigned crit, bool use_weights, double **models, unsigned model_first, unsigned model_count); //!< runs a batch of parameter sets and calculates criteria of runoff and baseflow
+    void run_vars_batch(long double init_GS, double **models, unsigned model_first, unsigned model_count, const std::vector<unsigned> &out_vars, bil_real **out_cols); //!< runs a batch of parameter sets and writes their selected outputs
+    void run_RM_batch(long double init_GS, double **models, unsigned model_first, unsigned model_count, bil_real **RM_out); //!< runs a batch of parameter sets and writes their modelled runoff
+    //! number of parameter sets run together by run_crit_batch
+    unsigned get_batch_size() { return BIL_LANES; };
+    unsigned get_time_steps(); //!< gets number of time steps of a model run
+    void clear_obs_stats(); //!< invalidates statistics of observed data
+    void prepare_obs_stats(unsigned crit, double weight_BF, bool use_weights); //!< calculates statistics of observed data before parallel evaluation
+    bilan_fcd* new_worker(); //!< creates functoid with private parameters for a worker thread
+    void delete_worker(bilan_fcd *worker); //!< deletes functoid of a worker thread
 
   private:
     bilan* pbil; //!< pointer to a model
+    parameter *wrk_param; //!< private parameters of worker functoid (null for functoid using parameters of model)
 };
 
 /**
@@ -211,6 +299,8 @@ class bilan
     void read_file(std::string file_name, unsigned input_var[], unsigned input_var_count); //!< reads observed data from a file
     void read_file_header(unsigned& nrow, unsigned& ncol, bool& old_style, ifstream& in_stream, stringstream& st_stream); //!< reads header of input file
     void read_params_file(std::string file_name); //!< reads parameters from output file
+    void read_binary(std::string file_name); //!< reads observed data from a binary columnar file
+    void write_binary(std::string file_name); //!< writes input variables into a binary columnar file
     //! type of output file (series according to model type, daily series, monthly series, characteristics)
     enum output_type {SERIES, SERIES_DAILY, SERIES_MONTHLY, CHARS};
     void write_file(std::string file_name, output_type out_type); //!< writes results into a file
@@ -218,15 +308,7 @@ class bilan
     bil_state get_state(long double init_GS, date st_date); //!< get state variables of given date
     void run_from_state(const bil_state& state); //!< run model starting from given state
     void run(long double init_GS); //!< runs daily or monthly Bilan model
-    void winter_daily(double prev_snow); //!< winter surface balance - daily
-    void winter_monthly(double prev_snow); //!< winter surface balance - monthly
-    void melt_daily(double prev_snow); //!< snow melting - daily
-    void melt_monthly(double prev_snow); //!< snow melting - monthly
-    void winter_balance(double prev_W); //!< winter soil balance
-    void summer_balance(double prev_W); //!< summer soil balance
-    void divide_daily(int mode, double prev_DS, double prev_RB); //!< runoff divider - daily
-    void divide_monthly(int mode, double prev_RB); //!< runoff divider - monthly
-    void include_water_use(); //!< includes withdrawals and release
+    void calc_precision_dev(long double init_GS, long double *max_dev); //!< deviations of variables from long double reference run
 
     void pet_estim_tab(); //!< PET using tables for vegetation zones
     void pet_estim_tab_zone(int veg_zone); //!< PET for chosen vegetation zone
@@ -235,10 +317,18 @@ class bilan
     optimizer_gen<bilan_fcd*> *optim; //!< optimization settings and variables (gradient or DE method)
     long double calc_crit(unsigned crit_type, unsigned var_obs, unsigned var_mod, bool use_weights); //!< calculates optimization criterion for given variable
     long double calc_crit_RM_BF(unsigned crit_type, double weight_BF, bool use_weights); //!< calculates optimization criterion for runoff and baseflow
+    long double run_crit(long double init_GS, unsigned crit_type, double weight_BF, bool use_weights, const parameter *run_param, bil_real *RM_out, long double *crit_BF = 0); //!< runs model and calculates criterion without writing outputs
+    void run_crit_batch(long double init_GS, unsigned crit_type, double weight_BF, bool use_weights, const parameter * const *run_params, unsigned run_count, long double *crits, long double *crits_BF = 0, bil_real **RM_out = 0); //!< runs model for several parameter sets in lockstep and calculates their criteria
+    void run_vars(long double init_GS, const parameter *run_param, const unsigned *out_vars, unsigned out_count, bil_real **out_cols); //!< runs model and writes selected outputs to separate columns
+    static bool is_output_var(unsigned var_n); //!< whether variable is an output of the model
+    void prepare_obs_stats(unsigned crit_type, double weight_BF, bool use_weights); //!< calculates statistics of observed data needed for criterion
+    const bil_obs_stats& get_obs_stats(unsigned crit_type, unsigned var_obs, bool use_weights); //!< gets statistics of observed variable for criterion
+    void clear_obs_stats(); //!< invalidates statistics of observed data after their change
     std::string get_param_name(unsigned par); //! returns name of given parameter
     std::string get_var_name(unsigned var); //!< returns name of given variable
     long double get_var_sum(unsigned var); //!< returns sum of given variable
     long double get_flow_m3s1(unsigned ts, unsigned var_n); //!< flow value to cubic meters per second
+    long double get_flow_m3s1(bil_real value); //!< converts value of runoff to cubic meters per second
     long double get_optim_ok(); //!< gets optimization criterion value
     std::string get_init_date(); //!< gets initial date
     unsigned get_var_pos(const std::string& var_name); //!< gets index of variable
@@ -247,6 +337,7 @@ class bilan
     void set_calendar(unsigned init_year, unsigned init_month, unsigned init_day); //!< sets calendar values according to the initial date
     void calc_years_count(date *calen, unsigned months); //!< find out init_m and number of years
 
+    bil_real* get_var_col(unsigned var_n); //!< gets time-series (column) of given variable
     void set_var_na(unsigned var_n); //!< sets all variable values to NA
     bool is_var_na(unsigned var_n); //!< checks if any value in variable is NA
     bool is_value_na(unsigned ts, unsigned var_n); //!< checks if variable value is NA
@@ -258,9 +349,9 @@ class bilan
     unsigned par_count, par_fix_count, var_count;
     //!@}
     parameter *param; //!< model parameters
-    long double **var; //!< observed and modelled variables (+time step, +variable)
-    long double **var_mon; //!< monthly series of observed and modelled variables (daily version only) (+month, +variable)
-    long double **char_mon; //!< monthly characteristics (+month, +variable - min/mean/max)
+    bil_real **var; //!< observed and modelled variables as columns of one contiguous buffer starting at var[0] (+variable, +time step)
+    bil_real **var_mon; //!< monthly series of observed and modelled variables (daily version only), contiguous columns as var (+variable, +month)
+    bil_real **char_mon; //!< monthly characteristics (+month, +variable - min/mean/max)
     bool *var_is_input; //!< if variable was loaded as input data - for check before run (+variable)
     unsigned months; //!< number of complete months (daily version only)
     date *calen; //!< calendar of dates of time-series (initialized and deleted together with variables)
@@ -306,9 +397,14 @@ class bilan
     static const double T_veg_zone[]; //!< temperatures for vegetation zones
     enum {TUNDRA, JEHL, SMIS, LIST, LESOSTEP, STEP}; //!< vegetation zones for PET estimation
 
-    void write_series_file(std::ofstream& out_stream, long double **var, unsigned time_steps); //!< writes daily or monthly time-series into a stream
+    void check_vars_for_run(); //!< checks if variables and parameters needed for model run are available
+    static bil_real** new_columns(unsigned col_count, unsigned row_count); //!< allocates columns in one contiguous buffer
+    static void delete_columns(bil_real **cols); //!< deletes columns allocated by new_columns
+    void write_series_file(std::ofstream& out_stream, bil_real **var, unsigned time_steps); //!< writes daily or monthly time-series into a stream
     void write_chars_file(std::ofstream& out_stream); //!< writes monthly characteristics into a stream
 
+    bil_obs_stats obs_stats[2]; //!< cached statistics of observed runoff and of other observed variable (usually baseflow)
+
     unsigned init_m; //!< time step of monthly series for the first beginning of hydrological year
     unsigned years; //!< number of complete hydrological years in time-series
 };
@@ -339,6 +435,29 @@ inline std::string bilan::get_var_name(unsigned var)
     return var_names_daily[var];
 }
 
+/**
+ * - returns pointer to contiguous time-series of given variable
+ */
+inline bil_real* bilan::get_var_col(unsigned var_n)
+{
+  if (var_n >= var_count)
+    throw bil_err("Bad variable position.");
+  if (!var)
+    throw bil_err("Variables are not initialized.");
+
+  clear_obs_stats(); //data can be changed by the caller
+  return var[var_n];
+}
+
+/**
+ * - invalidates cached statistics of observed data
+ */
+inline void bilan::clear_obs_stats()
+{
+  obs_stats[0].is_valid = false;
+  obs_stats[1].is_valid = false;
+}
+
 /**
  * - sets given variable to NA
  */
@@ -347,8 +466,9 @@ inline void bilan::set_var_na(unsigned var_n)
   if (var_n >= var_count)
     throw bil_err("Bad variable position.");
 
+  clear_obs_stats();
   for (ts = 0; ts < time_steps; ts++)
-    var[ts][var_n] = -999;
+    var[var_n][ts] = -999;
 }
 
 /**
@@ -360,7 +480,7 @@ inline bool bilan::is_var_na(unsigned var_n)
     throw bil_err("Bad variable position.");
 
   for (unsigned ts = 0; ts < time_steps; ts++) {
-    if (var[ts][var_n] < -900)
+    if (var[var_n][ts] < -900)
       return true;
   }
   return false;
@@ -374,7 +494,7 @@ inline bool bilan::is_value_na(unsigned ts, unsigned var_n)
   if (var_n >= var_count || ts >= time_steps)
     throw bil_err("Bad variable or time step position.");
 
-  if (var[ts][var_n] < -900)
+  if (var[var_n][ts] < -900)
     return true;
   else
     return false;
@@ -390,7 +510,7 @@ inline long double bilan::get_var_sum(unsigned var_n)
 
   long double sum = 0;
   for (ts = 0; ts < time_steps; ts++) {
-    sum += var[ts][var_n];
+    sum += var[var_n][ts];
   }
   return sum;
 }
@@ -411,7 +531,17 @@ inline bool date::is_leap()
  */
 inline long double bilan::get_flow_m3s1(unsigned ts, unsigned var_n)
 {
-  long double flow = var[ts][var_n] * area / 24 / 3.6;
+  return get_flow_m3s1(var[var_n][ts]);
+}
+
+/**
+ * - converts runoff value (in mm per time step) to cubic meters per second
+ * @param value runoff value
+ * @return flow value
+ */
+inline long double bilan::get_flow_m3s1(bil_real value)
+{
+  long double flow = value * area / 24 / 3.6;
   if (type == MONTHLY)
     flow /= 30;
   return flow;
@@ -15,12 +15,238 @@
 #include <iostream>
 #include <iomanip>
 #include <limits>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <exception>
+#include <stdint.h>
+#include <cstdio>
+#include <ctime>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 //! epsilon related to machine precision
 #define NUMERIC_EPS numeric_limits<long double>::epsilon()
 
 class bil_err;
 
+/**
+ * - functoids of worker threads with private parameters, shared by optimizers and analyses evaluating many models
+ * - workers are deleted with the pool, also when evaluation is interrupted by an exception
+ */
+template <class FCD>
+class bil_workers
+{
+  public:
+    bil_workers() : fcd(0) {};
+    ~bil_workers() { clear(); };
+    void create(FCD functoid, unsigned n_threads); //!< creates workers if more threads are required and available
+    void clear(); //!< deletes workers
+    //! whether models are evaluated only by functoid of the model
+    bool empty() const { return workers.empty(); };
+    //! gets number of workers
+    unsigned size() const { return workers.size(); };
+    //! gets worker of given thread
+    FCD operator[](unsigned thread) const { return workers[thread]; };
+    template <class TASK>
+    void run(const TASK &task, unsigned model_count); //!< evaluates models by a task in batches, concurrently by workers if available
+
+  private:
+    FCD fcd; //!< functoid of the model which creates and deletes workers
+    std::vector<FCD> workers; //!< functoids of worker threads, empty for serial evaluation
+    bil_workers(const bil_workers &orig); //!< workers are owned by one pool, so it is not copied
+    bil_workers& operator=(const bil_workers &orig); //!< not assigned for the same reason
+};
+
+/**
+ * - deletes previous workers and creates functoids with private parameters for worker threads if more threads are required and available
+ * - statistics of observed data have to be prepared before the workers are used because they only read the model
+ * @param functoid functoid of the model
+ * @param n_threads number of threads
+ */
+template <class FCD>
+void bil_workers<FCD>::create(FCD functoid, unsigned n_threads)
+{
+  clear();
+  fcd = functoid;
+#ifdef _OPENMP
+  if (n_threads > 1) {
+    for (unsigned t = 0; t < n_threads; t++)
+      workers.push_back(fcd->new_worker());
+  }
+#else
+  (void) n_threads;
+#endif
+}
+
+/**
+ * - deletes functoids of worker threads
+ */
+template <class FCD>
+void bil_workers<FCD>::clear()
+{
+  for (unsigned t = 0; t < workers.size(); t++)
+    fcd->delete_worker(workers[t]);
+  workers.clear();
+}
+
+/**
+ * - evaluates models in batches by given task, concurrently by workers if they were created, otherwise by one call with the functoid of the model
+ * - batches are not larger than needed to keep all workers busy, so results of a model must not depend on its batch
+ * - exceptions cannot leave parallel region, so they are caught in workers and the last one is thrown after all batches finish
+ * @param task functoid of the task, task(eval_fcd, model_first, model_count) evaluates given range of models by given functoid
+ * @param model_count number of models
+ */
+template <class FCD>
+template <class TASK>
+void bil_workers<FCD>::run(const TASK &task, unsigned model_count)
+{
+  if (workers.empty()) {
+    task(fcd, 0, model_count);
+    return;
+  }
+
+#ifdef _OPENMP
+  unsigned worker_count = workers.size();
+  unsigned batch_size = std::min(fcd->get_batch_size(), (model_count + worker_count - 1) / worker_count);
+  if (batch_size == 0)
+    batch_size = 1;
+  unsigned batch_count = (model_count + batch_size - 1) / batch_size;
+  bool is_err = false;
+  std::string err_descr;
+  #pragma omp parallel for schedule(dynamic) num_threads(worker_count)
+  for (int b = 0; b < static_cast<int>(batch_count); b++) {
+    unsigned model_first = b * batch_size;
+    try {
+      task(workers[omp_get_thread_num()], model_first, std::min(batch_size, model_count - model_first));
+    }
+    catch (bil_err &error) {
+      #pragma omp critical(bil_eval_err)
+      {
+        is_err = true;
+        err_descr = error.descr;
+      }
+    }
+    catch (std::exception &exc) { //e.g. allocation failure
+      #pragma omp critical(bil_eval_err)
+      {
+        is_err = true;
+        err_descr = exc.what();
+      }
+    }
+  }
+  if (is_err)
+    throw bil_err(err_descr);
+#endif
+}
+
+/**
+ * - task of worker pool calculating criterion of models
+ */
+template <class FCD>
+struct bil_crit_task
+{
+  long double init_GS; //!< initial groundwater storage
+  unsigned crit; //!< criterion type
+  double weight_BF; //!< weight for baseflow
+  bool use_weights; //!< whether to use weights for time steps of runoff
+  double **models; //!< parameters of models and their criterion in the last row - matrix(par_count+1, number of models)
+  long double *crits; //!< criterion values of the models in full precision, null if not needed
+
+  //! evaluates given range of models by given functoid
+  void operator()(FCD eval_fcd, unsigned model_first, unsigned model_count) const
+  {
+    eval_fcd->run_crit_batch(init_GS, crit, weight_BF, use_weights, models, model_first, model_count, crits ? crits + model_first : 0);
+  }
+};
+
+/**
+ * - task of worker pool calculating criteria of runoff and baseflow of models, for multi-objective optimization
+ * - if the batch fails, its models are evaluated one by one and those which fail get undefined criteria
+ */
+template <class FCD>
+struct bil_objs_task
+{
+  long double init_GS; //!< initial groundwater storage
+  unsigned crit; //!< criterion type
+  bool use_weights; //!< whether to use weights for time steps of runoff
+  double **models; //!< parameters of models and their criteria in the last two rows - matrix(par_count+2, number of models)
+  unsigned par_count; //!< number of parameters
+  unsigned models_first; //!< index of the first model evaluated by the task
+
+  //! evaluates given range of models by given functoid
+  void operator()(FCD eval_fcd, unsigned model_first, unsigned model_count) const
+  {
+    try {
+      eval_fcd->run_objs_batch(init_GS, crit, use_weights, models, models_first + model_first, model_count);
+    }
+    catch (bil_err &) {
+      for (unsigned m = models_first + model_first; m < models_first + model_first + model_count; m++) {
+        try {
+          eval_fcd->run_objs_batch(init_GS, crit, use_weights, models, m, 1);
+        }
+        catch (bil_err &) {
+          models[par_count][m] = models[par_count + 1][m] = std::numeric_limits<double>::quiet_NaN();
+        }
+      }
+    }
+  }
+};
+
+/**
+ * - task of worker pool calculating criterion of models and storing their modelled runoff in the same run, for Monte Carlo analysis
+ * - if the batch fails, its models are evaluated one by one and those which fail get undefined criterion
+ */
+template <class FCD>
+struct bil_crit_RM_task
+{
+  long double init_GS; //!< initial groundwater storage
+  unsigned crit; //!< criterion type
+  double weight_BF; //!< weight for baseflow
+  bool use_weights; //!< whether to use weights for time steps of runoff
+  double **models; //!< parameters of models and their criterion in the last row - matrix(par_count+1, number of models)
+  unsigned par_count; //!< number of parameters
+  bil_real **RM_cols; //!< columns for modelled runoff of the models, null if not needed
+
+  //! evaluates given range of models by given functoid
+  void operator()(FCD eval_fcd, unsigned model_first, unsigned model_count) const
+  {
+    try {
+      eval_fcd->run_crit_batch(init_GS, crit, weight_BF, use_weights, models, model_first, model_count, 0, RM_cols ? RM_cols + model_first : 0);
+    }
+    catch (bil_err &) {
+      for (unsigned m = model_first; m < model_first + model_count; m++) {
+        try {
+          eval_fcd->run_crit_batch(init_GS, crit, weight_BF, use_weights, models, m, 1, 0, RM_cols ? RM_cols + m : 0);
+        }
+        catch (bil_err &) {
+          models[par_count][m] = std::numeric_limits<double>::quiet_NaN();
+        }
+      }
+    }
+  }
+};
+
+/**
+ * - task of worker pool running models and storing their selected outputs, for ensemble simulation
+ */
+template <class FCD>
+struct bil_vars_task
+{
+  long double init_GS; //!< initial groundwater storage
+  double **models; //!< parameters of models - matrix(par_count, number of models)
+  unsigned models_first; //!< index of the first model run by the task
+  const std::vector<unsigned> *out_vars; //!< output variables
+  bil_real **out_cols; //!< columns for outputs of the models (out_vars.size() columns for each model, starting with the first model of the task)
+
+  //! runs given range of models by given functoid
+  void operator()(FCD eval_fcd, unsigned model_first, unsigned model_count) const
+  {
+    eval_fcd->run_vars_batch(init_GS, models, models_first + model_first, model_count, *out_vars, out_cols + model_first * out_vars->size());
+  }
+};
+
 /**
  * - general optimization settings
  */
@@ -34,9 +260,10 @@ class optimizer_gen
     virtual optimizer_gen& operator=(const optimizer_gen& orig);
     void set_functoid(FCD functoid); //!< functoid setter
     //! optimization type
-    enum optim_type {BS, DE};
+    enum optim_type {BS, DE, MO};
     void init(); //!< arrays allocation
     void set(unsigned crit_type, double weight_BF, bool use_weights, long double init_GS); //!< general settings
+    void set_n_threads(unsigned n_threads); //!< sets number of threads for evaluation of models
     //! performs optimization
     virtual void optimize() = 0;
     virtual std::map<std::string, std::string> get_settings(); //!< gets general settings
@@ -67,6 +294,7 @@ class optimizer_gen
     unsigned crit_type; //!< optimization criterion type
     double weight_BF; //!< weight for criterion of baseflow modelled and observed (between 0 and 1, complement to 1 is weight for runoff)
     bool use_weights; //!< whether to use weights for time steps of runoff
+    unsigned n_threads; //!< number of threads for evaluation of models (used only if compiled with OpenMP)
 
   protected:
     long double ok; //!< optimization criterion value
@@ -74,6 +302,12 @@ class optimizer_gen
     static const unsigned crit_count = 5; //!< number of optimization criteria
     static const std::string crit_names[]; //!< names of optimization criteria
     FCD fcd; //!< functoid to get access to bilan or bil_system member functions
+    bil_workers<FCD> workers; //!< functoids of worker threads with private parameters, empty for serial evaluation
+
+    void new_workers(unsigned crit); //!< creates functoids for worker threads
+    void delete_workers(); //!< deletes functoids of worker threads
+    void eval_models(double **models, unsigned model_count, long double *crits = 0); //!< evaluates criterion for a set of models, in parallel by workers if available
+    void eval_models(double **models, unsigned model_count, FCD eval_fcd, long double *crits = 0); //!< evaluates criterion for a set of models by given functoid
 };
 
 /**
@@ -90,6 +324,8 @@ class optimizer : public optimizer_gen<FCD>
     void init(); //!< array initialization
     virtual ~optimizer();
     void set(unsigned crit_part1, unsigned crit_part2, double weight_BF, bool use_weights, unsigned max_iter, long double init_GS); //!< optimization settings
+    void set_probes(unsigned probes); //!< sets which probes of parameter changes are evaluated together
+    void set_cache_size(unsigned cache_size); //!< sets maximum number of cached criterion values
     bool opti(); //!< main optimization function
     virtual void optimize(); //!< calibrates model parameters
     virtual std::map<std::string, std::string> get_settings(); //!< gets optimization settings
@@ -101,10 +337,28 @@ class optimizer : public optimizer_gen<FCD>
 
     unsigned crit[2]; //!< optimization criterion for two parts of algorithm
     unsigned max_iter; //!< maximum number of iterations
+    //! probes evaluated together: one at a time, both for a parameter, all remaining in a sweep over parameters
+    enum probe_type {SERIAL, PARAM, SWEEP};
+    unsigned probes; //!< which probes of parameter changes are evaluated together
+    unsigned cache_size; //!< maximum number of criterion values cached for parameters already evaluated, zero for no cache
 
   private:
+    //! criterion values for parameters already evaluated, key is parameters as for the model with criterion type as the last item
+    typedef std::map<std::vector<double>, long double> crit_cache;
+
     bool sub_opti();
     void n210();
+    void new_probes(); //!< allocates arrays for probes evaluated in advance
+    void delete_probes(); //!< deletes arrays for probes evaluated in advance
+    void add_probe(const double *probe_ap); //!< adds parameters of a probe to be evaluated in advance
+    bool eval_probes(); //!< evaluates in advance the current probe and the following ones
+    bool find_probe(long double &crit_value); //!< finds criterion of current parameters among probes evaluated in advance
+    long double run_crit_curr(); //!< gets criterion for current parameters
+    void get_cache_key(std::vector<double> &key); //!< gets key of current parameters and criterion to the cache
+    void add_to_cache(const std::vector<double> &key, long double crit_value); //!< stores criterion value to the cache
+
+    static const unsigned probe_type_count = 3; //!< number of probe types
+    static const std::string probe_names[]; //!< names of probe types
 
     unsigned is_fix; //!< identifier of the second optimization part with some parameters fixed
     double *ap; //!< current values of parameters
@@ -148,8 +402,754 @@ class optimizer : public optimizer_gen<FCD>
     bool start, end;
     //!@}
     unsigned bisec_count; //!< number of bisections
+    double **spec_models; //!< probes evaluated in advance (parameters as for the model) - matrix(par_count+1, 2*par_count), allocated only during optimization
+    long double *spec_crits; //!< criterion values of probes evaluated in advance
+    unsigned spec_count; //!< number of probes evaluated in advance
+    crit_cache cache; //!< cached criterion values
+    std::queue<typename crit_cache::iterator> cache_order; //!< cached values in order of insertion, the oldest one is removed when the cache is full
+    //!@{
+    /** @name
+     *  number of criterion values found and not found in the cache during the last optimization
+     */
+    unsigned long cache_hits, cache_misses;
+    //!@}
 };
 
+/**
+ * - random number generator xoshiro128** (Blackman and Vigna), owned by each optimizer or analysis to allow independent streams for ensemble members
+ * - uses only 32-bit arithmetic, so the sequence is the same on all platforms
+ */
+class bil_rng
+{
+  public:
+    bil_rng() { seed(1); };
+    void seed(uint32_t value); //!< initializes state from a seed
+    uint32_t next(); //!< generates next random integer
+    double uniform(); //!< generates uniform random number between 0 and 1
+    unsigned below(unsigned n); //!< generates uniform random integer lower than n
+    void draw_distinct(unsigned *randoms, unsigned size, unsigned upper_limit, unsigned forbidden); //!< generates random integers without repetition
+    void jump(); //!< advances state by 2^64 numbers to start independent stream
+    void get_state(uint32_t *state) const; //!< copies current state (4 words)
+    void set_state(const uint32_t *state); //!< restores state (4 words)
+
+  private:
+    uint32_t st[4]; //!< current state, not all zero
+    static uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }; //!< rotation to left
+};
+
+/**
+ * - initializes state of the generator, state words are created from the seed by mixing function of MurmurHash3
+ * @param value seed
+ */
+inline void bil_rng::seed(uint32_t value)
+{
+  for (unsigned w = 0; w < 4; w++) {
+    uint32_t z = (value += 0x9E3779B9u);
+    z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+    z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+    st[w] = z ^ (z >> 16);
+  }
+  if (st[0] == 0 && st[1] == 0 && st[2] == 0 && st[3] == 0)
+    st[0] = 1;
+}
+
+/**
+ * - generates next random integer
+ * @return random number between 0 and 2^32 - 1
+ */
+inline uint32_t bil_rng::next()
+{
+  const uint32_t result = rotl(st[1] * 5, 7) * 9;
+  const uint32_t t = st[1] << 9;
+
+  st[2] ^= st[0];
+  st[3] ^= st[1];
+  st[1] ^= st[2];
+  st[0] ^= st[3];
+  st[2] ^= t;
+  st[3] = rotl(st[3], 11);
+
+  return result;
+}
+
+/**
+ * - uniform random double number generator
+ * @return random number between 0 and 1 (excluding 1)
+ */
+inline double bil_rng::uniform()
+{
+  uint32_t high = next() >> 5, low = next() >> 6; //53 random bits for mantissa
+  return (high * 67108864.0 + low) / 9007199254740992.0; //divided by 2^53 to exclude upper limit (number 1)
+}
+
+/**
+ * - uniform random unsigned integer number generator
+ * @param n upper limit for generated values (excluded)
+ * @return random number
+ */
+inline unsigned bil_rng::below(unsigned n)
+{
+  uint32_t threshold = (0u - n) % n; //2^32 modulo n, lower values are rejected to avoid bias
+  uint32_t rnd;
+  do {
+    rnd = next();
+  } while (rnd < threshold);
+
+  return rnd % n;
+}
+
+/**
+ * - fills given array by a sequence of random unsigned integers without repetitions
+ * - each number is drawn from values not used yet, so no draws are rejected
+ * - checks if array has sufficient length for filling
+ * @param randoms array to be filled
+ * @param size array size
+ * @param upper_limit limit for generated numbers (excluded)
+ * @param forbidden one value forbidden to be generated
+ */
+inline void bil_rng::draw_distinct(unsigned *randoms, unsigned size, unsigned upper_limit, unsigned forbidden)
+{
+  if (size >= upper_limit - 1) //-1 is due to one forbidden value
+    throw bil_err("The limit does not allow to store unique randoms to given array.");
+  std::vector<unsigned> used(1, forbidden); //forbidden and already generated values in ascending order
+  unsigned tmp_rand, r, u;
+  for (r = 0; r < size; r++) {
+    tmp_rand = below(upper_limit - used.size()); //position among values not used
+    for (u = 0; u < used.size() && used[u] <= tmp_rand; u++)
+      tmp_rand++;
+    randoms[r] = tmp_rand;
+    used.insert(used.begin() + u, tmp_rand);
+  }
+}
+
+/**
+ * - advances the state as if next() was called 2^64 times, streams of ensemble members are separated by jumps
+ */
+inline void bil_rng::jump()
+{
+  static const uint32_t JUMP[] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+
+  uint32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for (unsigned j = 0; j < 4; j++) {
+    for (unsigned b = 0; b < 32; b++) {
+      if (JUMP[j] & (static_cast<uint32_t>(1) << b)) {
+        s0 ^= st[0];
+        s1 ^= st[1];
+        s2 ^= st[2];
+        s3 ^= st[3];
+      }
+      next();
+    }
+  }
+  st[0] = s0;
+  st[1] = s1;
+  st[2] = s2;
+  st[3] = s3;
+}
+
+/**
+ * - copies current state of the generator, e.g. to store it in a checkpoint
+ * @param state array of 4 words to be filled
+ */
+inline void bil_rng::get_state(uint32_t *state) const
+{
+  for (unsigned w = 0; w < 4; w++)
+    state[w] = st[w];
+}
+
+/**
+ * - restores state of the generator obtained by get_state
+ * @param state array of 4 words
+ */
+inline void bil_rng::set_state(const uint32_t *state)
+{
+  for (unsigned w = 0; w < 4; w++)
+    st[w] = state[w];
+}
+
+/**
+ * - binary checkpoint of ensemble DE optimization allowing to resume interrupted run
+ * - state of each ensemble member (population, best model, best fitness after shuffles, number of model evaluations and random number generator) is stored after each shuffle,
+ *   results are stored when the member is finished
+ * - file is written in native binary representation, so it can be read only on the same platform and with the same optimization settings
+ */
+class DE_checkpoint
+{
+  public:
+    enum member_status {NOT_STARTED, STARTED, DONE};
+    DE_checkpoint(std::string file_name, const std::vector<double> &settings, unsigned ens_count, unsigned n_parof, unsigned n_rows, unsigned popul_size, unsigned maxn_shuffles);
+    bool read(); //!< reads checkpoint file if it exists
+    void write(); //!< writes checkpoint file
+    void init_member(unsigned ens, const bil_rng &rng); //!< sets member as not started with its initial generator
+    member_status get_status(unsigned ens) { return members[ens].status; }; //!< gets status of member
+    bil_rng get_rng(unsigned ens); //!< gets stored generator of member
+    void set_member(unsigned ens, unsigned shuffle, unsigned model_eval, const bil_rng &rng, double **popul_parent, const double *best_model, const std::vector<double> &shuffle_best); //!< stores state of member and writes file
+    unsigned get_member(unsigned ens, unsigned &model_eval, bil_rng &rng, double **popul_parent, double *best_model, std::vector<double> &shuffle_best); //!< restores state of member
+    void set_result(unsigned ens, const double *resul); //!< stores results of finished member and writes file
+    void get_result(unsigned ens, double *resul); //!< gets results of finished member
+
+  private:
+    static const char* magic() { return "BILDECKP"; }; //!< identification of file type
+    static uint32_t version() { return 1; }; //!< version of file format
+
+    //! state of one ensemble member
+    struct member_state {
+      member_status status; //!< whether member is finished
+      unsigned shuffle; //!< number of finished shuffles
+      unsigned model_eval; //!< number of model evaluations
+      uint32_t rng_state[4]; //!< state of random number generator
+      std::vector<double> popul_parent; //!< parent population (n_rows * popul_size)
+      std::vector<double> best_model; //!< best model (n_parof)
+      std::vector<double> shuffle_best; //!< best fitness of initial population and after each shuffle (maxn_shuffles + 1)
+      std::vector<double> resul; //!< results of finished member (n_parof + 2)
+    };
+
+    std::string file_name; //!< name of checkpoint file
+    std::vector<double> settings; //!< optimization settings which must match when resuming
+    unsigned n_parof; //!< number of parameters + 1
+    unsigned n_rows; //!< number of rows of population (n_parof and control parameters of self-adaptive DE)
+    unsigned popul_size; //!< population size
+    unsigned maxn_shuffles; //!< maximum number of shuffles
+    std::vector<member_state> members; //!< states of ensemble members
+
+    void update(unsigned ens, const member_state &state); //!< replaces state of member and writes file
+};
+
+/**
+ * - checkpoint of given settings, all members are not started
+ * @param file_name name of checkpoint file
+ * @param settings optimization settings, checked when checkpoint is read
+ * @param ens_count number of ensemble members
+ * @param n_parof number of parameters + 1
+ * @param n_rows number of rows of population
+ * @param popul_size population size
+ * @param maxn_shuffles maximum number of shuffles
+ */
+inline DE_checkpoint::DE_checkpoint(std::string file_name, const std::vector<double> &settings, unsigned ens_count, unsigned n_parof, unsigned n_rows, unsigned popul_size, unsigned maxn_shuffles)
+  : file_name(file_name), settings(settings), n_parof(n_parof), n_rows(n_rows), popul_size(popul_size), maxn_shuffles(maxn_shuffles), members(ens_count)
+{
+  for (unsigned ens = 0; ens < ens_count; ens++) {
+    members[ens].status = NOT_STARTED;
+    members[ens].shuffle = members[ens].model_eval = 0;
+    for (unsigned w = 0; w < 4; w++)
+      members[ens].rng_state[w] = 0;
+    members[ens].popul_parent.resize(n_rows * popul_size);
+    members[ens].best_model.resize(n_parof);
+    members[ens].shuffle_best.resize(maxn_shuffles + 1);
+    members[ens].resul.resize(n_parof + 2);
+  }
+}
+
+/**
+ * - reads checkpoint file
+ * - checks that the file was created with the same settings
+ * @return false if file does not exist
+ */
+inline bool DE_checkpoint::read()
+{
+  std::ifstream in_stream(file_name.c_str(), std::ios::binary);
+  if (!in_stream)
+    return false;
+
+  char file_magic[8];
+  uint32_t file_version, sizes[6];
+  in_stream.read(file_magic, 8);
+  in_stream.read(reinterpret_cast<char*>(&file_version), sizeof(file_version));
+  in_stream.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+  if (!in_stream || std::string(file_magic, 8) != magic() || file_version != version() || sizes[0] != sizeof(double))
+    throw bil_err("File '" + file_name + "' is not a valid checkpoint of DE optimization.");
+  if (sizes[1] != settings.size() || sizes[2] != members.size() || sizes[3] != n_parof || sizes[4] != popul_size || sizes[5] != maxn_shuffles)
+    throw bil_err("Checkpoint '" + file_name + "' was created with different optimization settings.");
+  std::vector<double> file_settings(settings.size());
+  in_stream.read(reinterpret_cast<char*>(&file_settings[0]), settings.size() * sizeof(double));
+  if (!in_stream)
+    throw bil_err("File '" + file_name + "' is not a valid checkpoint of DE optimization.");
+  if (file_settings != settings)
+    throw bil_err("Checkpoint '" + file_name + "' was created with different optimization settings.");
+
+  for (unsigned ens = 0; ens < members.size(); ens++) {
+    uint32_t counts[3];
+    in_stream.read(reinterpret_cast<char*>(counts), sizeof(counts));
+    in_stream.read(reinterpret_cast<char*>(members[ens].rng_state), sizeof(members[ens].rng_state));
+    in_stream.read(reinterpret_cast<char*>(&members[ens].popul_parent[0]), members[ens].popul_parent.size() * sizeof(double));
+    in_stream.read(reinterpret_cast<char*>(&members[ens].best_model[0]), members[ens].best_model.size() * sizeof(double));
+    in_stream.read(reinterpret_cast<char*>(&members[ens].shuffle_best[0]), members[ens].shuffle_best.size() * sizeof(double));
+    in_stream.read(reinterpret_cast<char*>(&members[ens].resul[0]), members[ens].resul.size() * sizeof(double));
+    if (!in_stream || counts[0] > DONE)
+      throw bil_err("File '" + file_name + "' is not a valid checkpoint of DE optimization.");
+    members[ens].status = static_cast<member_status>(counts[0]);
+    members[ens].shuffle = counts[1];
+    members[ens].model_eval = counts[2];
+  }
+  return true;
+}
+
+/**
+ * - writes checkpoint file
+ * - file is written to a temporary file first and then renamed over the existing one, so a valid checkpoint remains if writing is interrupted
+ *   (where rename cannot replace existing file, it is removed first and the checkpoint exists only as the temporary file for a moment)
+ */
+inline void DE_checkpoint::write()
+{
+  std::string tmp_name = file_name + ".tmp";
+  std::ofstream out_stream(tmp_name.c_str(), std::ios::binary);
+  if (!out_stream)
+    throw bil_err("The checkpoint file '" + tmp_name + "' cannot be used.");
+
+  uint32_t sizes[6] = { sizeof(double), static_cast<uint32_t>(settings.size()), static_cast<uint32_t>(members.size()), n_parof, popul_size, maxn_shuffles };
+  uint32_t file_version = version();
+  out_stream.write(magic(), 8);
+  out_stream.write(reinterpret_cast<const char*>(&file_version), sizeof(file_version));
+  out_stream.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+  out_stream.write(reinterpret_cast<const char*>(&settings[0]), settings.size() * sizeof(double));
+  for (unsigned ens = 0; ens < members.size(); ens++) {
+    uint32_t counts[3] = { static_cast<uint32_t>(members[ens].status), members[ens].shuffle, members[ens].model_eval };
+    out_stream.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+    out_stream.write(reinterpret_cast<const char*>(members[ens].rng_state), sizeof(members[ens].rng_state));
+    out_stream.write(reinterpret_cast<const char*>(&members[ens].popul_parent[0]), members[ens].popul_parent.size() * sizeof(double));
+    out_stream.write(reinterpret_cast<const char*>(&members[ens].best_model[0]), members[ens].best_model.size() * sizeof(double));
+    out_stream.write(reinterpret_cast<const char*>(&members[ens].shuffle_best[0]), members[ens].shuffle_best.size() * sizeof(double));
+    out_stream.write(reinterpret_cast<const char*>(&members[ens].resul[0]), members[ens].resul.size() * sizeof(double));
+  }
+  out_stream.close();
+  if (!out_stream)
+    throw bil_err("Error when writing checkpoint file '" + tmp_name + "'.");
+  if (std::rename(tmp_name.c_str(), file_name.c_str()) != 0) { //replaces existing file atomically on POSIX
+    std::remove(file_name.c_str()); //rename does not replace existing file on Windows
+    if (std::rename(tmp_name.c_str(), file_name.c_str()) != 0)
+      throw bil_err("The checkpoint file '" + file_name + "' cannot be used.");
+  }
+}
+
+/**
+ * - sets member as not started, the generator is used when the member starts
+ * @param ens index of ensemble member
+ * @param rng initial random number generator of the member
+ */
+inline void DE_checkpoint::init_member(unsigned ens, const bil_rng &rng)
+{
+  members[ens].status = NOT_STARTED;
+  members[ens].shuffle = members[ens].model_eval = 0;
+  rng.get_state(members[ens].rng_state);
+}
+
+/**
+ * - gets stored random number generator of member
+ * @param ens index of ensemble member
+ * @return generator, initial for member not started
+ */
+inline bil_rng DE_checkpoint::get_rng(unsigned ens)
+{
+  bil_rng rng;
+  rng.set_state(members[ens].rng_state);
+  return rng;
+}
+
+/**
+ * - stores state of member after finished shuffle and writes the checkpoint file
+ * @param ens index of ensemble member
+ * @param shuffle number of finished shuffles
+ * @param model_eval number of model evaluations
+ * @param rng random number generator of the member
+ * @param popul_parent parent population - matrix(n_rows, popul_size)
+ * @param best_model best model (n_parof)
+ * @param shuffle_best best fitness of initial population and after each finished shuffle
+ */
+inline void DE_checkpoint::set_member(unsigned ens, unsigned shuffle, unsigned model_eval, const bil_rng &rng, double **popul_parent, const double *best_model, const std::vector<double> &shuffle_best)
+{
+  member_state member = members[ens];
+  member.status = STARTED;
+  member.shuffle = shuffle;
+  member.model_eval = model_eval;
+  rng.get_state(member.rng_state);
+  for (unsigned par = 0; par < n_rows; par++)
+    std::copy(popul_parent[par], popul_parent[par] + popul_size, member.popul_parent.begin() + par * popul_size);
+  std::copy(best_model, best_model + n_parof, member.best_model.begin());
+  std::copy(shuffle_best.begin(), shuffle_best.end(), member.shuffle_best.begin());
+  update(ens, member);
+}
+
+/**
+ * - restores state of started member
+ * @param ens index of ensemble member
+ * @param model_eval number of model evaluations to be set
+ * @param rng random number generator to be set
+ * @param popul_parent parent population to be filled - matrix(n_rows, popul_size)
+ * @param best_model best model to be filled (n_parof)
+ * @param shuffle_best best fitness of initial population and after each finished shuffle to be set
+ * @return number of finished shuffles
+ */
+inline unsigned DE_checkpoint::get_member(unsigned ens, unsigned &model_eval, bil_rng &rng, double **popul_parent, double *best_model, std::vector<double> &shuffle_best)
+{
+  const member_state &member = members[ens];
+  model_eval = member.model_eval;
+  rng.set_state(member.rng_state);
+  for (unsigned par = 0; par < n_rows; par++)
+    std::copy(member.popul_parent.begin() + par * popul_size, member.popul_parent.begin() + (par + 1) * popul_size, popul_parent[par]);
+  std::copy(member.best_model.begin(), member.best_model.end(), best_model);
+  shuffle_best.assign(member.shuffle_best.begin(), member.shuffle_best.begin() + member.shuffle + 1);
+  return member.shuffle;
+}
+
+/**
+ * - stores results of finished member and writes the checkpoint file
+ * @param ens index of ensemble member
+ * @param resul best model parameters, criterion, number of model evaluations and reason for termination (n_parof + 2)
+ */
+inline void DE_checkpoint::set_result(unsigned ens, const double *resul)
+{
+  member_state member = members[ens];
+  member.status = DONE;
+  std::copy(resul, resul + n_parof + 2, member.resul.begin());
+  update(ens, member);
+}
+
+/**
+ * - replaces state of member and writes the checkpoint file, concurrent ensemble members write one by one
+ * @param ens index of ensemble member
+ * @param state new state of the member
+ */
+inline void DE_checkpoint::update(unsigned ens, const member_state &state)
+{
+  bool is_err = false;
+  std::string err_descr;
+  #pragma omp critical(bil_checkpoint)
+  {
+    members[ens] = state;
+    try {
+      write();
+    }
+    catch (bil_err &error) { //exceptions cannot leave critical section
+      is_err = true;
+      err_descr = error.descr;
+    }
+  }
+  if (is_err)
+    throw bil_err(err_descr);
+}
+
+/**
+ * - gets results of finished member
+ * @param ens index of ensemble member
+ * @param resul array to be filled (n_parof + 2)
+ */
+inline void DE_checkpoint::get_result(unsigned ens, double *resul)
+{
+  std::copy(members[ens].resul.begin(), members[ens].resul.end(), resul);
+}
+
+/**
+ * - surrogate of criterion used to skip evaluation of offsprings which are almost surely worse than their parents
+ * - criterion is predicted by inverse distance weighting of nearest evaluated models (parameters scaled by their bounds),
+ *   the archive of evaluated models is limited and the oldest models are replaced
+ * - error of the surrogate is estimated from offsprings evaluated after their criterion was predicted
+ */
+class DE_surrogate
+{
+  public:
+    DE_surrogate() : par_count(0), max_size(0), next(0), err_count(0), err_sum(0) { };
+    void init(unsigned par_count, const double *dm, const double *hm, unsigned max_size); //!< sets bounds and clears archive
+    void add(double **models, unsigned index); //!< adds evaluated model to archive
+    bool predict(double **models, unsigned index, double &fitness) const; //!< predicts fitness of model
+    void add_error(double error) { err_sum += error; err_count++; }; //!< adds absolute error of prediction
+    //! whether surrogate was verified by enough predictions
+    bool is_verified() const { return err_count > par_count; };
+    //! gets mean absolute error of predictions
+    double get_error() const { return err_count == 0 ? 0 : err_sum / err_count; };
+
+  private:
+    unsigned par_count; //!< number of parameters
+    unsigned max_size; //!< maximum number of models in archive
+    unsigned next; //!< position of the next model in full archive
+    std::vector<double> low; //!< lower bounds of parameters
+    std::vector<double> range; //!< ranges of parameters
+    std::vector<double> points; //!< scaled parameters of archived models (model by model)
+    std::vector<double> fitness; //!< fitness of archived models
+    unsigned err_count; //!< number of verified predictions
+    double err_sum; //!< sum of absolute errors of verified predictions
+};
+
+/**
+ * - sets bounds of parameters and clears archive and errors
+ * @param par_count number of parameters
+ * @param dm lower bounds of parameters
+ * @param hm upper bounds of parameters
+ * @param max_size maximum number of models in archive
+ */
+inline void DE_surrogate::init(unsigned par_count, const double *dm, const double *hm, unsigned max_size)
+{
+  this->par_count = par_count;
+  this->max_size = max_size;
+  low.assign(dm, dm + par_count);
+  range.resize(par_count);
+  for (unsigned par = 0; par < par_count; par++)
+    range[par] = hm[par] - dm[par] > 0 ? hm[par] - dm[par] : 1;
+  points.clear();
+  fitness.clear();
+  next = err_count = 0;
+  err_sum = 0;
+}
+
+/**
+ * - adds evaluated model to archive, models with infinite or undefined fitness are ignored
+ * @param models matrix of models - (par_count+1, model_count), last row fitness
+ * @param index index of model in matrix
+ */
+inline void DE_surrogate::add(double **models, unsigned index)
+{
+  double fit = models[par_count][index];
+  if (!(fit < std::numeric_limits<double>::max()) || max_size == 0)
+    return;
+  unsigned pos;
+  if (fitness.size() < max_size) {
+    pos = fitness.size();
+    fitness.push_back(fit);
+    points.resize(points.size() + par_count);
+  }
+  else {
+    pos = next;
+    next = (next + 1) % max_size;
+    fitness[pos] = fit;
+  }
+  for (unsigned par = 0; par < par_count; par++)
+    points[pos * par_count + par] = (models[par][index] - low[par]) / range[par];
+}
+
+/**
+ * - predicts fitness as inverse squared distance weighted mean of par_count+1 nearest archived models
+ * @param models matrix of models - (par_count+1, model_count)
+ * @param index index of model in matrix
+ * @param fitness predicted fitness
+ * @return false if there are not enough models in archive
+ */
+inline bool DE_surrogate::predict(double **models, unsigned index, double &fitness) const
+{
+  unsigned n_near = par_count + 1, count = this->fitness.size(), n, p, par;
+  if (count < 2 * n_near)
+    return false;
+
+  std::vector<double> point(par_count), near_dist(n_near, std::numeric_limits<double>::max());
+  std::vector<unsigned> near_pos(n_near, 0);
+  for (par = 0; par < par_count; par++)
+    point[par] = (models[par][index] - low[par]) / range[par];
+  for (p = 0; p < count; p++) {
+    double dist = 0;
+    for (par = 0; par < par_count; par++) {
+      double diff = points[p * par_count + par] - point[par];
+      dist += diff * diff;
+    }
+    if (dist >= near_dist[n_near - 1])
+      continue;
+    for (n = n_near - 1; n > 0 && near_dist[n - 1] > dist; n--) { //insertion into sorted nearest models
+      near_dist[n] = near_dist[n - 1];
+      near_pos[n] = near_pos[n - 1];
+    }
+    near_dist[n] = dist;
+    near_pos[n] = p;
+  }
+  if (near_dist[0] == 0) {
+    fitness = this->fitness[near_pos[0]];
+    return true;
+  }
+  double sum_weight = 0, sum_fit = 0;
+  for (n = 0; n < n_near; n++) {
+    sum_weight += 1 / near_dist[n];
+    sum_fit += this->fitness[near_pos[n]] / near_dist[n];
+  }
+  fitness = sum_fit / sum_weight;
+  return true;
+}
+
+/**
+ * - streaming estimates of quantiles of series for each time step, memory does not depend on number of added series
+ * - each quantile of each time step is estimated by P-square algorithm (Jain and Chlamtac, 1985) with five markers,
+ *   minimum and maximum are exact, quantiles are exact (interpolated as by R type 7) for up to five series
+ * - estimates depend on order of added series
+ */
+class bil_quantile_bands
+{
+  public:
+    bil_quantile_bands() : time_steps(0), count(0) { };
+    void init(unsigned time_steps, const std::vector<double> &probs); //!< sets time steps and probabilities (between 0 and 1) and clears estimates
+    template <class REAL>
+    void add(const REAL *series); //!< adds a series
+    //! gets number of added series
+    unsigned long get_count() const { return count; };
+    double get(unsigned ts, unsigned prob) const; //!< gets estimated quantile
+
+  private:
+    static const unsigned marker_count = 5; //!< number of markers for a quantile
+    unsigned time_steps; //!< length of series
+    unsigned long count; //!< number of added series
+    std::vector<double> probs; //!< probabilities of quantiles
+    std::vector<double> desired; //!< desired positions of markers for each probability (the same for all time steps)
+    std::vector<double> heights; //!< heights of markers for each time step and probability
+    std::vector<long> positions; //!< positions of markers for each time step and probability
+
+    void add_value(unsigned marker_first, unsigned prob, double value); //!< adds value to markers of one quantile
+};
+
+/**
+ * - sets length of series and probabilities of quantiles, clears estimates
+ * @param time_steps length of series
+ * @param probs probabilities of quantiles (between 0 and 1)
+ */
+inline void bil_quantile_bands::init(unsigned time_steps, const std::vector<double> &probs)
+{
+  this->time_steps = time_steps;
+  this->probs = probs;
+  count = 0;
+  desired.assign(probs.size() * marker_count, 0.0);
+  heights.assign(static_cast<size_t>(time_steps) * probs.size() * marker_count, 0.0);
+  positions.assign(heights.size(), 0);
+}
+
+/**
+ * - adds value to markers of one quantile by P-square algorithm, the first five values are stored in ascending order
+ * @param marker_first position of the first marker in heights and positions
+ * @param prob index of probability
+ * @param value added value
+ */
+inline void bil_quantile_bands::add_value(unsigned marker_first, unsigned prob, double value)
+{
+  double *q = &heights[marker_first];
+  long *n = &positions[marker_first];
+  int m;
+  if (count < marker_count) {
+    for (m = count; m > 0 && q[m - 1] > value; m--) //insertion to sorted values
+      q[m] = q[m - 1];
+    q[m] = value;
+    n[count] = count;
+    return;
+  }
+
+  int cell; //cell of value between markers
+  if (value < q[0]) {
+    q[0] = value;
+    cell = 0;
+  }
+  else if (value >= q[marker_count - 1]) {
+    q[marker_count - 1] = value;
+    cell = marker_count - 2;
+  }
+  else {
+    for (cell = 0; value >= q[cell + 1]; cell++) { }
+  }
+  for (m = cell + 1; m < static_cast<int>(marker_count); m++)
+    n[m]++;
+
+  const double *np = &desired[prob * marker_count];
+  for (m = 1; m < static_cast<int>(marker_count) - 1; m++) {
+    double d = np[m] - n[m];
+    if ((d >= 1 && n[m + 1] - n[m] > 1) || (d <= -1 && n[m - 1] - n[m] < -1)) {
+      int ds = d > 0 ? 1 : -1;
+      double parab = q[m] + ds / static_cast<double>(n[m + 1] - n[m - 1]) * ((n[m] - n[m - 1] + ds) * (q[m + 1] - q[m]) / (n[m + 1] - n[m])
+        + (n[m + 1] - n[m] - ds) * (q[m] - q[m - 1]) / (n[m] - n[m - 1]));
+      if (q[m - 1] < parab && parab < q[m + 1])
+        q[m] = parab;
+      else //linear prediction if parabolic one is not monotonic
+        q[m] += ds * (q[m + ds] - q[m]) / (n[m + ds] - n[m]);
+      n[m] += ds;
+    }
+  }
+}
+
+/**
+ * - adds a series, values of each time step update markers of all quantiles
+ * @param series values for all time steps
+ */
+template <class REAL>
+void bil_quantile_bands::add(const REAL *series)
+{
+  unsigned pr_count = probs.size(), pr;
+  if (count >= marker_count - 1) { //desired positions after adding the value
+    for (pr = 0; pr < pr_count; pr++) {
+      double p = probs[pr], *np = &desired[pr * marker_count];
+      if (count == marker_count - 1) {
+        np[0] = 0;
+        np[1] = 2 * p;
+        np[2] = 4 * p;
+        np[3] = 2 + 2 * p;
+        np[4] = 4;
+      }
+      else {
+        np[1] += p / 2;
+        np[2] += p;
+        np[3] += (1 + p) / 2;
+        np[4] += 1;
+      }
+    }
+  }
+  for (unsigned ts = 0; ts < time_steps; ts++) {
+    double value = static_cast<double>(series[ts]);
+    for (pr = 0; pr < pr_count; pr++)
+      add_value((ts * pr_count + pr) * marker_count, pr, value);
+  }
+  count++;
+}
+
+/**
+ * - gets estimated quantile for a time step, undefined value if no series was added
+ * @param ts time step
+ * @param prob index of probability
+ * @return quantile estimate
+ */
+inline double bil_quantile_bands::get(unsigned ts, unsigned prob) const
+{
+  if (count == 0)
+    return std::numeric_limits<double>::quiet_NaN();
+  const double *q = &heights[(ts * probs.size() + prob) * marker_count];
+  double p = probs[prob];
+  if (count <= marker_count) { //exact quantile of sorted values
+    double pos = p * (count - 1);
+    unsigned low = static_cast<unsigned>(pos);
+    if (low + 1 >= count)
+      return q[count - 1];
+    return q[low] + (pos - low) * (q[low + 1] - q[low]);
+  }
+  if (p == 0)
+    return q[0];
+  if (p == 1)
+    return q[marker_count - 1];
+  return q[2];
+}
+
+/**
+ * - wall clock time used for timing of tasks
+ * @return time in seconds from an arbitrary point
+ */
+inline double bil_wtime()
+{
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ * - progress and timing of one task of batch optimization, the task is one ensemble member of one optimizer
+ */
+struct bil_task_info
+{
+  unsigned optim_n; //!< index of optimizer (model) in the batch
+  unsigned ens; //!< index of ensemble member
+  double cost; //!< estimated cost (maximum number of model evaluations times number of time steps)
+  int thread; //!< thread which optimized the member
+  double start; //!< start of the task in seconds from start of the batch
+  double time; //!< duration of the task in seconds
+  unsigned model_eval; //!< number of model evaluations
+  bool is_done; //!< whether the task was finished successfully
+};
+
+/**
+ * - comparison of tasks for sorting from the most expensive
+ */
+inline bool compare_task_cost(const bil_task_info &a, const bil_task_info &b)
+{
+  return a.cost > b.cost;
+}
+
 //! auxiliary for array sorting according to criterion value
 typedef struct _model_index
 {
@@ -172,33 +1172,80 @@ class DE_optim : public optimizer_gen<FCD>
 
     void init(); //!< allocates arrays
     void set(unsigned crit_type, unsigned DE_type, unsigned n_comp, unsigned comp_size, double cross, double mutat_f, double mutat_k, unsigned maxn_shuffles, unsigned n_gen_comp, unsigned ens_count, int seed, double weight_BF, bool use_weights, long double init_GS); //!< change DE settings
+    void set_parallel_comp(bool parallel_comp); //!< sets whether complexes are evolved concurrently
+    void set_generational(bool generational); //!< sets whether offsprings are evaluated by generations
+    void set_checkpoint(std::string checkpoint_file, bool resume); //!< sets checkpoint file and whether to resume from it
+    void set_stopping(unsigned stop_shuffles, double stop_improv, double stop_spread, unsigned max_eval); //!< sets rules for early termination of members
+    void set_bound_handling(unsigned bound_handling); //!< sets handling of mutated parameters outside bounds
+    void set_surrogate(bool use_surrogate, double surrogate_factor, unsigned surrogate_size); //!< sets surrogate pre-screening of offsprings
     virtual void optimize(); //!< ensemble run
+    std::vector<unsigned> prepare_members(); //!< prepares ensemble run, gets members to be optimized
+    void optimize_member_copy(unsigned ens); //!< optimizes one ensemble member by a copy of optimizer
+    void finish_members(); //!< finishes ensemble run
+    double get_member_cost(); //!< gets estimated cost of optimization of a member
     virtual std::map<std::string, std::string> get_settings(); //!< gets optimization settings
     //! gets DE type
     virtual typename optimizer_gen<FCD>::optim_type get_type() { return optimizer_gen<FCD>::DE; };
     virtual unsigned get_ens_count(); //!< gets ensemble size
     virtual double** get_ens_resul(); //!< gets ensemble results
     virtual void write(std::string file_name); //!< writes ensemble_resul to a file
-    enum {BEST_ONE_BIN, BEST_TWO_BIN, RAND_TWO_BIN};
+    enum {BEST_ONE_BIN, BEST_TWO_BIN, RAND_TWO_BIN, JDE_BEST_ONE_BIN, JDE_RAND_ONE_BIN};
+    //! whether DE type adapts mutation and crossover parameters of each individual
+    bool is_adaptive() { return DE_type == JDE_BEST_ONE_BIN || DE_type == JDE_RAND_ONE_BIN; };
+    enum stop_type {STOP_SHUFFLES, STOP_IMPROV, STOP_SPREAD, STOP_MAX_EVAL};
+    static const unsigned stop_type_count = 4; //!< number of reasons for termination
+    static const std::string stop_names[]; //!< names of reasons for termination
+    enum bound_type {BOUND_REJECT, BOUND_NONE, BOUND_REFLECT, BOUND_MIDPOINT, BOUND_RANDOM, BOUND_CLAMP};
+    static const unsigned bound_type_count = 6; //!< number of types of bound handling
+    static const std::string bound_names[]; //!< names of types of bound handling
     unsigned DE_type; //!< type of differential evolution algorithm
-    double **ensemble_resul; //!< best models parameters, criterion and number of model evaluations for each ensemble (ensemble, n_parof+1)
+    double **ensemble_resul; //!< best models parameters, criterion, number of model evaluations and reason for termination for each ensemble (ensemble, n_parof+2)
 
   private:
     unsigned n_parof; //!< size of parameters + 1 (objective function) - initialized even if par_count is 0, used for allocation
-
-    bool reject_outside; //!< whether to reject the outside bounds individuals
+    unsigned n_rows; //!< number of rows of population matrices - n_parof and mutation and crossover parameters of self-adaptive types
+    static const unsigned ctrl_count = 2; //!< number of control parameters of individual for self-adaptive types (mutation F in row n_parof, crossover in row n_parof+1)
+    static const double jde_tau; //!< probability of new random control parameters of offspring (jDE)
+    static const double jde_f_lower; //!< lower bound of random mutation parameter (jDE)
+    static const double jde_f_upper; //!< upper bound of random mutation parameter (jDE)
+
+    unsigned bound_handling; //!< how mutated parameters outside bounds are handled
+    bool parallel_comp; //!< whether complexes are evolved concurrently, each of them with the best model from the beginning of shuffle
+    bool generational; //!< whether offsprings of a generation are evaluated together, otherwise each of them replaces its parent immediately
+    bil_rng rng; //!< random number generator of current ensemble member
+    std::vector<bil_rng> member_rngs; //!< initial random number generators of ensemble members
+    std::string checkpoint_file; //!< name of checkpoint file, empty for no checkpoints
+    bool resume; //!< whether to resume optimization from existing checkpoint file
+    DE_checkpoint *ckp; //!< checkpoint of current optimization, shared by copies of optimizer optimizing members concurrently
+
+    unsigned stop_shuffles; //!< number of shuffles for evaluation of relative improvement, 0 for no check
+    double stop_improv; //!< member is terminated if relative improvement of best fitness over stop_shuffles is not greater
+    double stop_spread; //!< member is terminated if spread of all parameters in population (relative to bounds) is lower, 0 for no check
+    unsigned max_eval; //!< maximum number of model evaluations for a member, 0 for no limit
+    std::vector<double> shuffle_best; //!< best fitness of initial population and after each shuffle of current member
+    unsigned stop_reason; //!< reason for termination of current member
+    bool use_surrogate; //!< whether offsprings are pre-screened by surrogate of criterion
+    double surrogate_factor; //!< offspring is not evaluated if predicted fitness is worse than its parent by more than this multiple of surrogate error
+    unsigned surrogate_size; //!< maximum number of models in archive of surrogate
+    DE_surrogate surrogate; //!< surrogate of criterion of current member built in each shuffle
+    //!@{
+    /** @name
+     *  number of offsprings created and not evaluated due to surrogate during the last optimization
+     */
+    unsigned long offspring_count, skipped_count;
+    //!@}
     double cross; //!< crossover param
     double mutat_f; //!< mutation param
     double mutat_k; //!< mutation param
 
     unsigned popul_size; //!< total population (sets of parameters) number
-    double **popul_parent; //!< population parameters and fitness - matrix(par_count+1, popul_size)
+    double **popul_parent; //!< population parameters, fitness and control parameters of adaptive types - matrix(n_rows, popul_size)
     double **popul_parent_tmp; //!< dtto temporal
     double *best_model; //!< best model param and fitness (par_count+1)
 
     unsigned n_comp; //!< the number of complexes to be shuffled
     unsigned comp_size; //!< number of population (sets of parameters) in one complex
-    double ***comp; //!< data in complexes 3d (par_count+1, comp_size, n_comp), last rows fitness
+    double ***comp; //!< data in complexes 3d (n_rows, comp_size, n_comp), row par_count fitness
     double **offsprings_tmp; //!< models of one complex - help variable
 
     unsigned model_eval; //!< number of model evaluations
@@ -224,16 +1271,199 @@ class DE_optim : public optimizer_gen<FCD>
     void make_comp_from_parent();//!< creates the complexes from parent matrix
     void make_parent_from_comp();//!< combines the complexes to the parents matrix
     void sort_param_parent();//!< sorts the parameters in parent matrix according to fitness
-    void get_randoms_without_rep(unsigned *randoms, unsigned size, unsigned upper_limit, unsigned forbidden); //!< generates random unsigned integers without repetition
-
-    unsigned rand_unsint(unsigned n);//!< random unsigned integer number generator
-    double randu_gen();//!< random uniform double generator
 
+    unsigned get_sp_rand_size(); //!< number of random members of complex used for mutation
+    unsigned get_u_rand_size(); //!< number of uniform random values for one offspring
+    void draw_DE_randoms(unsigned *sp_rand, double *u_rand); //!< generates random values for one generation in a complex
+    void make_offsprings(unsigned com, unsigned first, unsigned count, const unsigned *sp_rand, const double *u_rand, const double *best, double **offsprings); //!< creates offsprings of members of a complex
+    double handle_bounds(unsigned par, double value, double parent, double u); //!< gets value of mutated parameter according to bound handling
+    unsigned eval_offsprings(unsigned com, unsigned first, unsigned count, double **offsprings, DE_surrogate &sur, FCD eval_fcd); //!< evaluates offsprings not skipped by surrogate
+    void select_offsprings(unsigned com, unsigned first, unsigned count, double **offsprings, double *best); //!< replaces members of a complex by better offsprings
+    unsigned evolve_generation(unsigned com, const unsigned *sp_rand, const double *u_rand, double *best, double **offsprings, DE_surrogate &sur, FCD eval_fcd); //!< one generation of DE in a complex
     void DE(unsigned com); //!< differential evolution algorithm
-    void SCE_DE(); //!< SCE-DE algorithm
+    void DE_parallel(); //!< differential evolution algorithm for all complexes concurrently
+    void SCE_DE(unsigned ens, unsigned first_shuffle); //!< SCE-DE algorithm
+    bool is_stop(unsigned shuffle); //!< checks rules for termination of member
+    double get_popul_spread(); //!< gets maximum spread of parameters in population
+    std::vector<double> get_checkpoint_settings(); //!< settings identifying checkpoint
+    void optimize_member(unsigned ens, const bil_rng &member_rng); //!< SCE-DE run for one ensemble member
+};
+
+template<class FCD>
+std::vector<bil_task_info> DE_optimize_batch(const std::vector<DE_optim<FCD>*> &optims, unsigned n_threads, std::string log_file); //!< optimizes ensembles of several optimizers by a shared pool of threads
+
+/**
+ * - multi-objective optimization of criteria of runoff and baseflow (NSGA-II with differential evolution operators)
+ * - both criteria are calculated from one model run, result is the Pareto front (non-dominated parameter sets) of the final population
+ */
+template <class FCD>
+class MO_optim : public optimizer_gen<FCD>
+{
+  public:
+    MO_optim();
+    MO_optim(const MO_optim& orig);
+    MO_optim* clone() const; //!< "virtual copy constructor"
+    virtual optimizer_gen<FCD>& operator=(const optimizer_gen<FCD>& orig);
+    virtual ~MO_optim();
+
+    void set(unsigned crit_type, unsigned popul_size, unsigned n_gen, double cross, double mutat_f, int seed, double weight_BF, bool use_weights, long double init_GS); //!< changes MO settings
+    virtual void optimize(); //!< calibrates Pareto front
+    virtual std::map<std::string, std::string> get_settings(); //!< gets optimization settings
+    //! gets MO type
+    virtual typename optimizer_gen<FCD>::optim_type get_type() { return optimizer_gen<FCD>::MO; };
+    virtual unsigned get_ens_count(); //!< gets number of parameter sets in Pareto front
+    virtual double** get_ens_resul(); //!< gets Pareto front
+    virtual void write(std::string file_name); //!< writes Pareto front to a file
+
+  private:
+    static const unsigned obj_count = 2; //!< number of objectives (criteria of runoff and baseflow)
+    unsigned popul_size; //!< number of parameter sets in population
+    unsigned n_gen; //!< number of generations
+    double cross; //!< crossover parameter
+    double mutat_f; //!< mutation parameter
+    int seed; //!< seed for initialization of random number generator
+    bil_rng rng; //!< random number generator
+    unsigned model_eval; //!< number of model evaluations
+    unsigned front_count; //!< number of parameter sets in Pareto front
+    double **front_resul; //!< Pareto front - parameters, criterion of runoff, criterion of baseflow and number of model evaluations (front_count, par_count+3)
+    unsigned best_front; //!< member of Pareto front with the best criterion weighted by weight_BF, assigned to the model
+
+    bool dominates(double **popul, unsigned first, unsigned second); //!< whether the first model dominates the second one
+    void delete_front(); //!< deletes Pareto front
+    void eval_objs(double **models, unsigned model_first, unsigned model_count); //!< evaluates objectives for a set of models, in parallel by workers if available
+    void make_offsprings(double **popul); //!< creates offsprings of population by mutation and crossover
+    void sort_fronts(double **popul, unsigned count, std::vector<unsigned> &rank); //!< non-dominated sorting
+    void calc_crowding(double **popul, const std::vector<unsigned> &members, std::vector<double> &crowding); //!< crowding distance within one front
+    void select_popul(double **popul); //!< selects next population from parents and offsprings
+    void finish_front(double **popul); //!< stores Pareto front and assigns compromise parameters to the model
+};
+
+/**
+ * - global sensitivity analysis of optimization criterion to parameters within their limits
+ * - variance-based (Sobol) indices estimated from Saltelli design or elementary effects of Morris trajectories,
+ *   the whole design is evaluated by batched model runs, in parallel by worker functoids
+ */
+template <class FCD>
+class sens_analysis
+{
+  public:
+    sens_analysis();
+    void set_functoid(FCD functoid); //!< functoid setter
+    //! sensitivity method
+    enum sens_method {SOBOL, MORRIS};
+    void set(unsigned method, unsigned sample_count, unsigned levels, int seed, unsigned crit_type, double weight_BF, bool use_weights, long double init_GS, unsigned n_threads); //!< analysis settings
+    void analyze(); //!< creates and evaluates design and calculates indices
+    unsigned get_par_count() { return par_count; }; //!< gets number of analyzed parameters
+    unsigned get_eval_count() { return eval_count; }; //!< gets number of model evaluations
+    double** get_evals() { return eval_count > 0 ? &eval_rows[0] : 0; }; //!< gets parameters and criterion of evaluated models - matrix(par_count+1, eval_count)
+    unsigned get_index_count(); //!< gets number of indices for a parameter
+    std::string get_index_name(unsigned index); //!< gets name of index
+    double get_index(unsigned par, unsigned index) { return indices[par][index]; }; //!< gets index value of a parameter
+
+  private:
+    static const unsigned method_count = 2; //!< number of sensitivity methods
+    static const std::string sobol_names[]; //!< names of Sobol indices
+    static const std::string morris_names[]; //!< names of Morris indices
+
+    FCD fcd; //!< functoid to get access to bilan or bil_system member functions
+    unsigned method; //!< sensitivity method
+    unsigned sample_count; //!< number of base samples (Sobol) or trajectories (Morris)
+    unsigned levels; //!< number of levels of Morris grid
+    int seed; //!< seed for initialization of random number generator
+    unsigned crit_type; //!< criterion type
+    double weight_BF; //!< weight for criterion of baseflow
+    bool use_weights; //!< whether to use weights for time steps of runoff
+    long double init_GS; //!< initial groundwater storage
+    unsigned n_threads; //!< number of threads for evaluation of models (used only if compiled with OpenMP)
+    unsigned par_count; //!< number of analyzed parameters
+    unsigned eval_count; //!< number of model evaluations
+    bil_rng rng; //!< random number generator
+    bil_workers<FCD> workers; //!< functoids of worker threads with private parameters
+    std::vector<std::vector<double> > evals; //!< parameters and criterion of evaluated models in order of design
+    std::vector<double*> eval_rows; //!< rows of evaluated models to be used as matrix
+    std::vector<double> lower, upper; //!< limits of parameters
+    std::vector<unsigned> morris_par; //!< parameter changed by each step of Morris trajectories
+    std::vector<std::vector<double> > indices; //!< sensitivity indices for each parameter
+
+    void make_sobol_design(); //!< creates Saltelli design for Sobol indices
+    void make_morris_design(); //!< creates Morris trajectories
+    void eval_design(); //!< evaluates criterion of all models in design
+    void calc_sobol(); //!< calculates first and total order Sobol indices
+    void calc_morris(); //!< calculates statistics of elementary effects
+};
+
+/**
+ * - Monte Carlo sampling of parameters within their limits for GLUE uncertainty analysis
+ * - samples are evaluated in chunks, criterion of each sample is streamed to a file and modelled runoff of behavioral samples
+ *   to streaming quantile estimates, so memory does not depend on number of samples
+ */
+template <class FCD>
+class mc_analysis
+{
+  public:
+    mc_analysis();
+    void set_functoid(FCD functoid); //!< functoid setter
+    void set(unsigned long sample_count, int seed, bool use_threshold, double threshold, const std::vector<double> &probs, std::string out_file, unsigned crit_type, double weight_BF, bool use_weights, long double init_GS, unsigned n_threads); //!< analysis settings
+    void analyze(); //!< samples and evaluates parameter sets
+    unsigned get_par_count() { return par_count; }; //!< gets number of sampled parameters
+    unsigned long get_behav_count() { return behav_count; }; //!< gets number of behavioral samples
+    const std::vector<double>& get_best() { return best_model; }; //!< gets the best sample - parameters and criterion
+    const bil_quantile_bands& get_bands() { return bands; }; //!< gets quantiles of modelled runoff of behavioral samples
+
+  private:
+    FCD fcd; //!< functoid to get access to bilan member functions
+    unsigned long sample_count; //!< number of samples
+    int seed; //!< seed for initialization of random number generator
+    bool use_threshold; //!< whether only samples with criterion better than threshold are behavioral
+    double threshold; //!< threshold of criterion for behavioral samples
+    std::vector<double> probs; //!< probabilities of quantiles of modelled runoff, empty for no series
+    std::string out_file; //!< name of file where criterion of each sample is written, empty for no file
+    unsigned crit_type; //!< criterion type
+    double weight_BF; //!< weight for criterion of baseflow
+    bool use_weights; //!< whether to use weights for time steps of runoff
+    long double init_GS; //!< initial groundwater storage
+    unsigned n_threads; //!< number of threads for evaluation of models (used only if compiled with OpenMP)
+    unsigned par_count; //!< number of sampled parameters
+    unsigned long behav_count; //!< number of behavioral samples
+    std::vector<double> best_model; //!< parameters and criterion of the best sample
+    bil_quantile_bands bands; //!< quantiles of modelled runoff of behavioral samples
+    bil_rng rng; //!< random number generator
+    bil_workers<FCD> workers; //!< functoids of worker threads with private parameters
+
+    bool is_better(double crit, double than); //!< whether criterion value is better
+    void eval_chunk(double **models, unsigned chunk_count, bil_real **RM_cols); //!< evaluates criterion and modelled runoff of a chunk of samples
+};
+
+/**
+ * - simulation of an ensemble of parameter sets (e.g. results of DE optimization) summarized by quantiles of outputs for each time step
+ * - members are run concurrently in chunks and their outputs added to streaming quantile estimates,
+ *   so memory does not depend on number of members
+ */
+template <class FCD>
+class ens_simulation
+{
+  public:
+    ens_simulation();
+    void set_functoid(FCD functoid); //!< functoid setter
+    void set(const std::vector<unsigned> &out_vars, const std::vector<double> &probs, long double init_GS, unsigned n_threads); //!< simulation settings
+    void simulate(double **models, unsigned ens_count); //!< runs members and estimates quantiles of their outputs
+    //! gets quantiles of given output variable (in order of settings)
+    const bil_quantile_bands& get_bands(unsigned out_n) { return bands[out_n]; };
+
+  private:
+    FCD fcd; //!< functoid to get access to bilan member functions
+    std::vector<unsigned> out_vars; //!< output variables
+    std::vector<double> probs; //!< probabilities of quantiles
+    long double init_GS; //!< initial groundwater storage
+    unsigned n_threads; //!< number of threads for simulation of members (used only if compiled with OpenMP)
+    std::vector<bil_quantile_bands> bands; //!< quantiles for each output variable
 };
 
 #include "bil_optim_de.h"
+#include "bil_optim_mo.h"
+#include "bil_optim_sens.h"
+#include "bil_optim_mc.h"
+#include "bil_optim_ens.h"
 
 using namespace std;
 template<class FCD>
@@ -251,6 +1481,7 @@ optimizer_gen<FCD>::optimizer_gen() : ok(0)
   weight_BF = 0;
   use_weights = false;
   init_GS = 50;
+  n_threads = 1;
 }
 
 /**
@@ -275,6 +1506,7 @@ optimizer_gen<FCD>::optimizer_gen(const optimizer_gen& orig)
   weight_BF = orig.weight_BF;
   use_weights = orig.use_weights;
   init_GS = orig.init_GS;
+  n_threads = orig.n_threads;
   if (par_count != 0) {
     dm = new double[par_count];
     hm = new double[par_count];
@@ -309,6 +1541,7 @@ void optimizer_gen<FCD>::init()
 
   if (use_weights)
     fcd->calc_sum_weights();
+  fcd->clear_obs_stats(); //statistics of observed data calculated again at first evaluation
 
   fcd->check_vars_for_optim(weight_BF > NUMERIC_EPS);
 
@@ -339,6 +1572,75 @@ void optimizer_gen<FCD>::set(unsigned crit_type, double weight_BF, bool use_weig
   this->crit_type = crit_type;
 }
 
+/**
+ * - sets number of threads, models are evaluated in parallel by worker threads if greater than one
+ * @param n_threads number of threads
+ */
+template<class FCD>
+void optimizer_gen<FCD>::set_n_threads(unsigned n_threads)
+{
+  if (n_threads == 0)
+    throw bil_err("Number of threads cannot be zero.");
+
+  this->n_threads = n_threads;
+}
+
+/**
+ * - creates functoids with private parameters for worker threads if more threads are required and available
+ * - statistics of observed data are calculated before because workers only read the model
+ * @param crit optimization criterion type to be used by workers
+ */
+template<class FCD>
+void optimizer_gen<FCD>::new_workers(unsigned crit)
+{
+  workers.create(fcd, n_threads);
+  if (!workers.empty())
+    fcd->prepare_obs_stats(crit, weight_BF, use_weights);
+}
+
+/**
+ * - deletes functoids of worker threads
+ */
+template<class FCD>
+void optimizer_gen<FCD>::delete_workers()
+{
+  workers.clear();
+}
+
+/**
+ * - sets parameters of each model, runs it and stores criterion value
+ * - models are evaluated in batches (run in lockstep by a single model) concurrently by worker functoids if they were created, otherwise by functoid of the model
+ * - criterion of a model depends only on its parameters, so results do not depend on number of threads
+ * @param models parameters of models and their criterion in the last row - matrix(par_count+1, model_count)
+ * @param model_count number of models
+ * @param crits criterion values of the models in full precision, null if not needed
+ */
+template<class FCD>
+void optimizer_gen<FCD>::eval_models(double **models, unsigned model_count, long double *crits)
+{
+  if (workers.empty()) {
+    eval_models(models, model_count, fcd, crits);
+    return;
+  }
+
+  bil_crit_task<FCD> task = { init_GS, crit_type, weight_BF, use_weights, models, crits };
+  workers.run(task, model_count);
+}
+
+/**
+ * - sets parameters of each model, runs it by given functoid and stores criterion value
+ * - models are run together in batches if the functoid supports it (parameters of functoid are not changed then)
+ * @param models parameters of models and their criterion in the last row - matrix(par_count+1, model_count)
+ * @param model_count number of models
+ * @param eval_fcd functoid of the model or of a worker
+ * @param crits criterion values of the models in full precision, null if not needed
+ */
+template<class FCD>
+void optimizer_gen<FCD>::eval_models(double **models, unsigned model_count, FCD eval_fcd, long double *crits)
+{
+  eval_fcd->run_crit_batch(init_GS, crit_type, weight_BF, use_weights, models, 0, model_count, crits);
+}
+
 /**
  * - gets general optimization settings
  * @return settings as map with name of settings and value as a string
@@ -361,6 +1663,9 @@ map<string, string> optimizer_gen<FCD>::get_settings()
   os.str("");
   os << static_cast<double>(init_GS);
   sett.insert(pair<string, string>("init_GS", os.str()));
+  os.str("");
+  os << n_threads;
+  sett.insert(pair<string, string>("n_threads", os.str()));
 
   return sett;
 }
@@ -380,6 +1685,7 @@ optimizer_gen<FCD>& optimizer_gen<FCD>::operator=(const optimizer_gen<FCD>& orig
     weight_BF = orig.weight_BF;
     use_weights = orig.use_weights;
     init_GS = orig.init_GS;
+    n_threads = orig.n_threads;
     delete[] dm;
     delete[] hm;
     if (par_count != 0) {
@@ -404,10 +1710,28 @@ optimizer_gen<FCD>& optimizer_gen<FCD>::operator=(const optimizer_gen<FCD>& orig
 template<class FCD>
 optimizer_gen<FCD>::~optimizer_gen()
 {
+  delete_workers();
   delete[] dm;
   delete[] hm;
 }
 
+template<class FCD>
+const string optimizer<FCD>::probe_names[optimizer<FCD>::probe_type_count] = {"serial", "param", "sweep"};
+template<class FCD>
+const string DE_optim<FCD>::stop_names[DE_optim<FCD>::stop_type_count] = {"shuffles", "improvement", "spread", "evals"};
+template<class FCD>
+const string DE_optim<FCD>::bound_names[DE_optim<FCD>::bound_type_count] = {"reject", "none", "reflect", "midpoint", "random", "clamp"};
+template<class FCD>
+const string sens_analysis<FCD>::sobol_names[] = {"first", "total"};
+template<class FCD>
+const string sens_analysis<FCD>::morris_names[] = {"mu", "mu_star", "sigma"};
+template<class FCD>
+const double DE_optim<FCD>::jde_tau = 0.1;
+template<class FCD>
+const double DE_optim<FCD>::jde_f_lower = 0.1;
+template<class FCD>
+const double DE_optim<FCD>::jde_f_upper = 1.0;
+
 /**
  * - default optimization settings
  */
@@ -419,6 +1743,12 @@ optimizer<FCD>::optimizer() : is_fix(0), lc(0), prev_step(0), par(0), nsave(fals
   max_iter = 500;
   bisec_count = 30;
   par_fix_count = 0;
+  probes = SERIAL;
+  cache_size = 0;
+  spec_models = 0;
+  spec_crits = 0;
+  spec_count = 0;
+  cache_hits = cache_misses = 0;
   ap = fixp = ddelta = delta = prevp = tmpp = 0;
   is_close_low = is_close_upp = 0;
   nsign = les = 0;
@@ -435,6 +1765,13 @@ optimizer<FCD>::optimizer(const optimizer<FCD>& orig) : optimizer_gen<FCD>(orig)
   crit[0] = orig.crit[0];
   crit[1] = orig.crit[1];
   max_iter = orig.max_iter;
+  probes = orig.probes;
+  cache_size = orig.cache_size;
+  spec_models = 0;
+  spec_crits = 0;
+  spec_count = 0;
+  cache_hits = orig.cache_hits;
+  cache_misses = orig.cache_misses;
   is_fix = orig.is_fix;
   par_fix_count = orig.par_fix_count;
   unsigned p;
@@ -514,6 +1851,10 @@ optimizer_gen<FCD>& optimizer<FCD>::operator=(const optimizer_gen<FCD>& orig)
     crit[0] = tmp_orig.crit[0];
     crit[1] = tmp_orig.crit[1];
     max_iter = tmp_orig.max_iter;
+    probes = tmp_orig.probes;
+    cache_size = tmp_orig.cache_size;
+    cache_hits = tmp_orig.cache_hits;
+    cache_misses = tmp_orig.cache_misses;
     is_fix = tmp_orig.is_fix;
     par_fix_count = tmp_orig.par_fix_count;
     delete[] ap;
@@ -598,6 +1939,32 @@ void optimizer<FCD>::set(unsigned crit_part1, unsigned crit_part2, double weight
   this->max_iter = max_iter;
 }
 
+/**
+ * - sets which probes (changes of one parameter tried by sub_opti) are evaluated together
+ * - probes following the current one are evaluated in advance as if none of them improved the criterion,
+ *   they are then used while the algorithm actually tries them, so that results are the same as for serial evaluation
+ * @param probes SERIAL for one probe at a time, PARAM for both probes of a parameter, SWEEP for all remaining probes of a sweep over parameters
+ */
+template<class FCD>
+void optimizer<FCD>::set_probes(unsigned probes)
+{
+  if (probes >= probe_type_count)
+    throw bil_err("Unknown type of probes evaluation.");
+
+  this->probes = probes;
+}
+
+/**
+ * - sets maximum number of criterion values cached for parameters already evaluated
+ * - the algorithm often returns to the same parameters, their criterion is then taken from the cache instead of running the model
+ * @param cache_size maximum number of cached values, zero for no cache
+ */
+template<class FCD>
+void optimizer<FCD>::set_cache_size(unsigned cache_size)
+{
+  this->cache_size = cache_size;
+}
+
 /**
  * - optimization subfunction changing parameters
  * @return whether to terminate optimization and go to model run
@@ -844,6 +2211,7 @@ void optimizer<FCD>::init()
 template<class FCD>
 optimizer<FCD>::~optimizer()
 {
+  delete_probes();
   delete[] ap;
   delete[] fixp;
   delete[] ddelta;
@@ -856,6 +2224,202 @@ optimizer<FCD>::~optimizer()
   delete[] les;
 }
 
+/**
+ * - allocates arrays for probes evaluated in advance, at most two probes for each parameter
+ */
+template<class FCD>
+void optimizer<FCD>::new_probes()
+{
+  delete_probes();
+  spec_models = new double*[this->par_count + 1];
+  for (unsigned p = 0; p <= this->par_count; p++)
+    spec_models[p] = new double[2 * this->par_count];
+  spec_crits = new long double[2 * this->par_count];
+  spec_count = 0;
+}
+
+/**
+ * - deletes arrays for probes evaluated in advance
+ */
+template<class FCD>
+void optimizer<FCD>::delete_probes()
+{
+  if (spec_models) {
+    for (unsigned p = 0; p <= this->par_count; p++)
+      delete[] spec_models[p];
+    delete[] spec_models;
+  }
+  delete[] spec_crits;
+  spec_models = 0;
+  spec_crits = 0;
+  spec_count = 0;
+}
+
+/**
+ * - adds parameters of a probe to be evaluated in advance, fixed parameters are taken as in the model run
+ * @param probe_ap parameter values of the probe
+ */
+template<class FCD>
+void optimizer<FCD>::add_probe(const double *probe_ap)
+{
+  for (unsigned p = 0; p < this->par_count; p++)
+    spec_models[p][spec_count] = is_fix && p < par_fix_count ? fixp[p] : probe_ap[p];
+  spec_count++;
+}
+
+/**
+ * - evaluates the current probe and the probes sub_opti tries after it if they do not improve the criterion
+ * - the following probes are obtained by the same parameter changes as in sub_opti,
+ *   only for the current parameter (PARAM) or for the rest of the sweep over parameters (SWEEP)
+ * - probes are evaluated in parallel by workers if available, otherwise in batches by the functoid of the model
+ * @return whether the probes were evaluated, not if any of them failed (the current one is then run alone)
+ */
+template<class FCD>
+bool optimizer<FCD>::eval_probes()
+{
+  vector<double> probe_ap(ap, ap + this->par_count);
+  unsigned probe_par = par, probe_step = prev_step;
+  bool *iclose1, *iclose2;
+
+  spec_count = 0;
+  add_probe(&probe_ap[0]);
+  while (true) {
+    if (les[probe_par]) {
+      iclose1 = is_close_low;
+      iclose2 = is_close_upp;
+    }
+    else {
+      iclose1 = is_close_upp;
+      iclose2 = is_close_low;
+    }
+
+    if (probe_step == 0) {
+      if (les[probe_par])
+        probe_ap[probe_par] = probe_ap[probe_par] - delta[probe_par];
+      else
+        probe_ap[probe_par] = probe_ap[probe_par] + delta[probe_par];
+      if (!iclose1[probe_par]) {
+        probe_step = 1;
+        add_probe(&probe_ap[0]);
+        continue;
+      }
+    }
+    if (probe_step != 2) {
+      if (les[probe_par])
+        probe_ap[probe_par] = probe_ap[probe_par] + 2 * delta[probe_par];
+      else
+        probe_ap[probe_par] = probe_ap[probe_par] - 2 * delta[probe_par];
+      if (!iclose2[probe_par]) {
+        probe_step = 2;
+        add_probe(&probe_ap[0]);
+        continue;
+      }
+    }
+
+    if (les[probe_par])
+      probe_ap[probe_par] = probe_ap[probe_par] - delta[probe_par];
+    else
+      probe_ap[probe_par] = probe_ap[probe_par] + delta[probe_par];
+    probe_step = 0;
+    probe_par++;
+    if (probes == PARAM || probe_par >= this->par_count)
+      break;
+  }
+
+  try {
+    this->eval_models(spec_models, spec_count, spec_crits);
+  }
+  catch (bil_err &) { //a probe never tried by serial evaluation may fail
+    spec_count = 0;
+  }
+  //functoid may be used for evaluation, its parameters are set back to the current probe
+  for (unsigned p = 0; p < this->par_count; p++)
+    this->fcd->set_param(p, this->CURR, spec_models[p][0]);
+
+  return spec_count > 0;
+}
+
+/**
+ * - finds current parameters among probes evaluated in advance
+ * @param crit_value criterion value of the probe if found
+ * @return whether the probe was found
+ */
+template<class FCD>
+bool optimizer<FCD>::find_probe(long double &crit_value)
+{
+  for (unsigned m = 0; m < spec_count; m++) {
+    unsigned p;
+    for (p = 0; p < this->par_count; p++) {
+      if (spec_models[p][m] != (is_fix && p < par_fix_count ? fixp[p] : ap[p]))
+        break;
+    }
+    if (p == this->par_count) {
+      crit_value = spec_crits[m];
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * - gets key of current parameters set to the functoid and current criterion type to the cache
+ * @param key the key
+ */
+template<class FCD>
+void optimizer<FCD>::get_cache_key(vector<double> &key)
+{
+  key.resize(this->par_count + 1);
+  for (unsigned p = 0; p < this->par_count; p++)
+    key[p] = is_fix && p < par_fix_count ? fixp[p] : ap[p];
+  key[this->par_count] = crit[is_fix];
+}
+
+/**
+ * - stores criterion value to the cache, the oldest value is removed if the cache is full
+ * @param key parameters and criterion type
+ * @param crit_value criterion value
+ */
+template<class FCD>
+void optimizer<FCD>::add_to_cache(const vector<double> &key, long double crit_value)
+{
+  if (cache.size() >= cache_size) {
+    cache.erase(cache_order.front());
+    cache_order.pop();
+  }
+  cache_order.push(cache.insert(pair<vector<double>, long double>(key, crit_value)).first);
+}
+
+/**
+ * - gets criterion for current parameters set to the functoid
+ * - criterion of parameters already evaluated is taken from the cache if used
+ * - when probes are evaluated together, criterion of a probe is taken from probes evaluated in advance,
+ *   the current probe and the following ones are evaluated again if not found there (after a probe improved the criterion)
+ * @return criterion value
+ */
+template<class FCD>
+long double optimizer<FCD>::run_crit_curr()
+{
+  vector<double> key;
+  long double crit_value;
+  if (cache_size > 0) {
+    get_cache_key(key);
+    typename crit_cache::iterator it = cache.find(key);
+    if (it != cache.end()) {
+      cache_hits++;
+      return it->second;
+    }
+    cache_misses++;
+  }
+
+  bool is_probe = probes != SERIAL && !start && prev_step != 0;
+  if (!is_probe || !(find_probe(crit_value) || (eval_probes() && find_probe(crit_value))))
+    crit_value = this->fcd->run_crit(this->init_GS, crit[is_fix], this->weight_BF, this->use_weights);
+
+  if (cache_size > 0)
+    add_to_cache(key, crit_value);
+  return crit_value;
+}
+
 /**
  * - calibrates model parameters
  */
@@ -864,7 +2428,11 @@ void optimizer<FCD>::optimize()
 {
   unsigned p;
 
+  delete_probes(); //before number of parameters is changed
   init();
+  cache.clear();
+  cache_order = queue<typename crit_cache::iterator>();
+  cache_hits = cache_misses = 0;
 
   for (is_fix = 0; is_fix <= 1; is_fix++) { //the second part with some fixed parameters
     //initialization of parameters
@@ -875,14 +2443,18 @@ void optimizer<FCD>::optimize()
     }
     start = true;
     end = false;
+    if (probes != SERIAL) {
+      this->crit_type = crit[is_fix]; //used for evaluation of probes
+      this->new_workers(crit[is_fix]);
+      new_probes();
+    }
 
     while (true) {
       if (is_fix) {
         for (p = 0; p < par_fix_count; p++)
           this->fcd->set_param(p, this->CURR, fixp[p]);
       }
-      this->fcd->run(this->init_GS);
-      this->ok = this->fcd->calc_crit(crit[is_fix], this->weight_BF, this->use_weights);
+      this->ok = run_crit_curr();
 
       if (!start && end) {
         if (!is_fix) {
@@ -901,6 +2473,11 @@ void optimizer<FCD>::optimize()
     if (crit[is_fix] == this->NS || crit[is_fix] == this->LNNS)
       this->ok = 1 - this->ok;
   } //is_fix
+  this->delete_workers();
+  delete_probes();
+  cache.clear();
+  cache_order = queue<typename crit_cache::iterator>();
+  this->fcd->run(this->init_GS); //output variables for the final parameters
 }
 
 /**
@@ -918,6 +2495,16 @@ map<string, string> optimizer<FCD>::get_settings()
   sett.insert(pair<string, string>("crit_part2", this->crit_names[crit[1]]));
   os << setprecision(15) << max_iter;
   sett.insert(pair<string, string>("max_iter", os.str()));
+  sett.insert(pair<string, string>("probes", probe_names[probes]));
+  os.str("");
+  os << cache_size;
+  sett.insert(pair<string, string>("cache_size", os.str()));
+  os.str("");
+  os << cache_hits;
+  sett.insert(pair<string, string>("cache_hits", os.str()));
+  os.str("");
+  os << cache_misses;
+  sett.insert(pair<string, string>("cache_misses", os.str()));
 
   return sett;
 }
@@ -9,8 +9,7 @@ using namespace std;
 template<class FCD>
 DE_optim<FCD>::DE_optim()
 {
-  srand((unsigned) time(0));
-  n_comp = n_parof = 0;
+  n_comp = n_parof = n_rows = 0;
   cross = mutat_f = mutat_k = 0.0;
   model_eval = 0;
   DE_type = 0;
@@ -19,7 +18,18 @@ DE_optim<FCD>::DE_optim()
 
   popul_size = comp_size = 0;
   n_gen_comp = maxn_shuffles = ens_count = 0;
-  reject_outside = true;
+  bound_handling = BOUND_REJECT;
+  parallel_comp = false;
+  generational = false;
+  resume = false;
+  ckp = 0;
+  stop_shuffles = max_eval = 0;
+  stop_improv = stop_spread = 0;
+  stop_reason = STOP_SHUFFLES;
+  use_surrogate = false;
+  surrogate_factor = 2;
+  surrogate_size = 1000;
+  offspring_count = skipped_count = 0;
 
   best_model = 0;
   popul_parent = popul_parent_tmp = 0;
@@ -43,7 +53,23 @@ DE_optim<FCD>::DE_optim(const DE_optim<FCD>& orig) : optimizer_gen<FCD>(orig)
   sett_n_comp = orig.sett_n_comp;
   sett_ens_count = orig.sett_ens_count;
   n_parof = orig.n_parof;
-  reject_outside = orig.reject_outside;
+  n_rows = orig.n_rows;
+  bound_handling = orig.bound_handling;
+  parallel_comp = orig.parallel_comp;
+  generational = orig.generational;
+  checkpoint_file = orig.checkpoint_file;
+  resume = orig.resume;
+  ckp = 0;
+  stop_shuffles = orig.stop_shuffles;
+  stop_improv = orig.stop_improv;
+  stop_spread = orig.stop_spread;
+  max_eval = orig.max_eval;
+  use_surrogate = orig.use_surrogate;
+  surrogate_factor = orig.surrogate_factor;
+  surrogate_size = orig.surrogate_size;
+  offspring_count = orig.offspring_count;
+  skipped_count = orig.skipped_count;
+  stop_reason = orig.stop_reason;
   cross = orig.cross;
   mutat_f = orig.mutat_f;
   mutat_k = orig.mutat_k;
@@ -58,21 +84,22 @@ DE_optim<FCD>::DE_optim(const DE_optim<FCD>& orig) : optimizer_gen<FCD>(orig)
   if (ens_count != 0) {
     ensemble_resul = new double*[ens_count];
     for (unsigned ens = 0; ens < ens_count; ens++) {
-      ensemble_resul[ens] = new double[n_parof + 1];
-      for (par = 0; par < n_parof + 1; par++)
+      ensemble_resul[ens] = new double[n_parof + 2];
+      for (par = 0; par < n_parof + 2; par++)
         ensemble_resul[ens][par] = orig.ensemble_resul[ens][par];
     }
   }
   else
     ensemble_resul = 0;
 
-  if (n_parof != 0) {
-    popul_parent = new double*[n_parof];
-    popul_parent_tmp = new double*[n_parof];
-    offsprings_tmp = new double*[n_parof];
+  if (n_rows != 0) {
+    popul_parent = new double*[n_rows];
+    popul_parent_tmp = new double*[n_rows];
+    offsprings_tmp = new double*[n_rows];
     best_model = new double[n_parof];
-    for (par = 0; par < n_parof; par++) {
+    for (par = 0; par < n_parof; par++)
       best_model[par] = orig.best_model[par];
+    for (par = 0; par < n_rows; par++) {
       if (popul_size != 0) {
         popul_parent[par] = new double[popul_size];
         popul_parent_tmp[par] = new double[popul_size];
@@ -95,8 +122,8 @@ DE_optim<FCD>::DE_optim(const DE_optim<FCD>& orig) : optimizer_gen<FCD>(orig)
         offsprings_tmp[par] = 0;
       }
     }
-    comp = new double**[n_parof];
-    for (par = 0; par < n_parof; par++) {
+    comp = new double**[n_rows];
+    for (par = 0; par < n_rows; par++) {
       if (comp_size != 0) {
         comp[par] = new double*[comp_size];
         for (sp = 0; sp < comp_size; sp++) {
@@ -168,7 +195,7 @@ optimizer_gen<FCD>& DE_optim<FCD>::operator=(const optimizer_gen<FCD>& orig)
        delete[] ensemble_resul[ens];
     delete[] ensemble_resul;
 
-    for (par = 0; par < n_parof; par++) {
+    for (par = 0; par < n_rows; par++) {
       delete[] popul_parent[par];
       delete[] popul_parent_tmp[par];
       delete[] offsprings_tmp[par];
@@ -177,7 +204,7 @@ optimizer_gen<FCD>& DE_optim<FCD>::operator=(const optimizer_gen<FCD>& orig)
     delete[] popul_parent_tmp;
     delete[] offsprings_tmp;
 
-    for (par = 0; par < n_parof; par++) {
+    for (par = 0; par < n_rows; par++) {
       for (sp = 0; sp < comp_size; sp++)
         delete[] comp[par][sp];
       delete[] comp[par];
@@ -191,7 +218,22 @@ optimizer_gen<FCD>& DE_optim<FCD>::operator=(const optimizer_gen<FCD>& orig)
     ens_count = tmp_orig.ens_count;
     seed = tmp_orig.seed;
     n_parof = tmp_orig.n_parof;
-    reject_outside = tmp_orig.reject_outside;
+    n_rows = tmp_orig.n_rows;
+    bound_handling = tmp_orig.bound_handling;
+    parallel_comp = tmp_orig.parallel_comp;
+    generational = tmp_orig.generational;
+    checkpoint_file = tmp_orig.checkpoint_file;
+    resume = tmp_orig.resume;
+    stop_shuffles = tmp_orig.stop_shuffles;
+    stop_improv = tmp_orig.stop_improv;
+    stop_spread = tmp_orig.stop_spread;
+    max_eval = tmp_orig.max_eval;
+    use_surrogate = tmp_orig.use_surrogate;
+    surrogate_factor = tmp_orig.surrogate_factor;
+    surrogate_size = tmp_orig.surrogate_size;
+    offspring_count = tmp_orig.offspring_count;
+    skipped_count = tmp_orig.skipped_count;
+    stop_reason = tmp_orig.stop_reason;
     cross = tmp_orig.cross;
     mutat_f = tmp_orig.mutat_f;
     mutat_k = tmp_orig.mutat_k;
@@ -205,21 +247,22 @@ optimizer_gen<FCD>& DE_optim<FCD>::operator=(const optimizer_gen<FCD>& orig)
     if (ens_count != 0) {
       ensemble_resul = new double*[ens_count];
       for (ens = 0; ens < ens_count; ens++) {
-        ensemble_resul[ens] = new double[n_parof + 1];
-        for (par = 0; par < n_parof + 1; par++)
+        ensemble_resul[ens] = new double[n_parof + 2];
+        for (par = 0; par < n_parof + 2; par++)
           ensemble_resul[ens][par] = tmp_orig.ensemble_resul[ens][par];
       }
     }
     else
       ensemble_resul = 0;
 
-    if (n_parof != 0) {
-      popul_parent = new double*[n_parof];
-      popul_parent_tmp = new double*[n_parof];
-      offsprings_tmp = new double*[n_parof];
+    if (n_rows != 0) {
+      popul_parent = new double*[n_rows];
+      popul_parent_tmp = new double*[n_rows];
+      offsprings_tmp = new double*[n_rows];
       best_model = new double[n_parof];
-      for (par = 0; par < n_parof; par++) {
+      for (par = 0; par < n_parof; par++)
         best_model[par] = tmp_orig.best_model[par];
+      for (par = 0; par < n_rows; par++) {
         if (popul_size != 0) {
           popul_parent[par] = new double[popul_size];
           popul_parent_tmp[par] = new double[popul_size];
@@ -242,8 +285,8 @@ optimizer_gen<FCD>& DE_optim<FCD>::operator=(const optimizer_gen<FCD>& orig)
           offsprings_tmp[par] = 0;
         }
       }
-      comp = new double**[n_parof];
-      for (par = 0; par < n_parof; par++) {
+      comp = new double**[n_rows];
+      for (par = 0; par < n_rows; par++) {
         if (comp_size != 0) {
           comp[par] = new double*[comp_size];
           for (sp = 0; sp < comp_size; sp++) {
@@ -296,15 +339,15 @@ DE_optim<FCD>::~DE_optim()
   delete[] rand_indexes;
 
   unsigned par;
-  for (par = 0; par < n_parof; par++)
+  for (par = 0; par < n_rows; par++)
     delete[] popul_parent[par];
   delete[] popul_parent;
 
-  for (par = 0; par < n_parof; par++)
+  for (par = 0; par < n_rows; par++)
     delete[]  popul_parent_tmp[par];
   delete[] popul_parent_tmp;
 
-  for (par = 0; par < n_parof; par++) {
+  for (par = 0; par < n_rows; par++) {
     for (unsigned sp = 0; sp < comp_size; sp++)
       delete[] comp[par][sp];
     delete[] comp[par];
@@ -312,13 +355,14 @@ DE_optim<FCD>::~DE_optim()
   delete[] comp;
 
   delete[] models_for_comp;
-  for (par = 0; par < n_parof; par++)
+  for (par = 0; par < n_rows; par++)
     delete[]  offsprings_tmp[par];
   delete[] offsprings_tmp;
 
   for (unsigned ens = 0; ens < ens_count; ens++)
      delete[] ensemble_resul[ens];
   delete[] ensemble_resul;
+  delete ckp;
 }
 
 /**
@@ -337,15 +381,15 @@ void DE_optim<FCD>::init()
   delete[] best_model;
 
   unsigned par, sp, ens;
-  for (par = 0; par < n_parof; par++)
+  for (par = 0; par < n_rows; par++)
     delete[]  popul_parent[par];
   delete[] popul_parent;
 
-  for (par = 0; par < n_parof; par++)
+  for (par = 0; par < n_rows; par++)
     delete[]  popul_parent_tmp[par];
   delete[] popul_parent_tmp;
 
-  for (par = 0; par < n_parof; par++) {
+  for (par = 0; par < n_rows; par++) {
     for (sp = 0; sp < comp_size; sp++)
       delete[] comp[par][sp];
     delete[] comp[par];
@@ -355,7 +399,7 @@ void DE_optim<FCD>::init()
   delete[] rand_indexes;
   delete[] models_for_comp;
 
-  for (par = 0; par < n_parof; par++)
+  for (par = 0; par < n_rows; par++)
     delete[]  offsprings_tmp[par];
   delete[] offsprings_tmp;
 
@@ -364,6 +408,7 @@ void DE_optim<FCD>::init()
   delete[] ensemble_resul;
 
   n_parof = this->par_count + 1; //used for delete and now for allocate
+  n_rows = n_parof + (is_adaptive() ? ctrl_count : 0);
   ens_count = sett_ens_count;
   comp_size = sett_comp_size;
   n_comp = sett_n_comp;
@@ -375,20 +420,20 @@ void DE_optim<FCD>::init()
 
   ensemble_resul = new double*[ens_count];
   for (ens = 0; ens < ens_count; ens++) {
-  	ensemble_resul[ens] = new double[n_parof + 1];
-  	for (par = 0; par < n_parof + 1; par++)
+  	ensemble_resul[ens] = new double[n_parof + 2];
+  	for (par = 0; par < n_parof + 2; par++)
       ensemble_resul[ens][par] = 9999.99;
   }
 
-  popul_parent = new double*[n_parof];
-  for (par = 0; par < n_parof; par++){
+  popul_parent = new double*[n_rows];
+  for (par = 0; par < n_rows; par++){
   	popul_parent[par] = new double[popul_size];
   	for (sp = 0; sp < popul_size; sp++) {
   	    popul_parent[par][sp] = 99999.99;
   	}
   }
-  popul_parent_tmp = new double*[n_parof];
-  for (par = 0; par < n_parof; par++) {
+  popul_parent_tmp = new double*[n_rows];
+  for (par = 0; par < n_rows; par++) {
   	popul_parent_tmp[par] = new double[popul_size];
   	for (sp = 0; sp < popul_size; sp++) {
       popul_parent_tmp[par][sp] = 9999.99;
@@ -399,8 +444,8 @@ void DE_optim<FCD>::init()
   for (sp = 0; sp < popul_size; sp++)
     rand_indexes[sp] = 9999999;
 
-  comp = new double**[n_parof];
-  for (par = 0; par < n_parof; par++) {
+  comp = new double**[n_rows];
+  for (par = 0; par < n_rows; par++) {
     comp[par] = new double*[comp_size];
     for (sp = 0; sp < comp_size; sp++) {
       comp[par][sp] = new double[n_comp];
@@ -414,8 +459,8 @@ void DE_optim<FCD>::init()
     models_for_comp[sp].model_fitness = popul_parent[n_parof - 1][sp];
     models_for_comp[sp].model_index = sp;
   }
-  offsprings_tmp = new double*[n_parof];
-  for (par = 0; par < n_parof; par++) {
+  offsprings_tmp = new double*[n_rows];
+  for (par = 0; par < n_rows; par++) {
   	offsprings_tmp[par] = new double[comp_size];
   	for (sp = 0; sp < comp_size; sp++) {
       offsprings_tmp[par][sp] = 9999.99;
@@ -435,7 +480,7 @@ void DE_optim<FCD>::init()
  * @param maxn_shuffles number of shufflings
  * @param n_gen_comp maximum number of generations within a complex
  * @param ens_count number of optimization runs (the size of ensemble)
- * @param seed seed to initialize random number generator, if seed <= 0, no initialization done
+ * @param seed seed to initialize random number generator, if seed <= 0, generator is initialized by time
  * @param weight_BF criterion weight for baseflow
  * @param use_weights whether to use weights for time steps of runoff
  * @param init_GS initial groundwater storage
@@ -457,6 +502,98 @@ void DE_optim<FCD>::set(unsigned crit_type, unsigned DE_type, unsigned n_comp, u
   sett_comp_size = comp_size;
 }
 
+/**
+ * - sets whether complexes are evolved concurrently (by worker threads if available)
+ * - each complex then starts from the best model found before the shuffle and updates only its own copy, the best of complexes is taken after all of them finish;
+ *   results therefore do not depend on number of threads, but differ from sequential evolution of complexes
+ * @param parallel_comp whether complexes are evolved concurrently
+ */
+template<class FCD>
+void DE_optim<FCD>::set_parallel_comp(bool parallel_comp)
+{
+  this->parallel_comp = parallel_comp;
+}
+
+/**
+ * - sets whether offsprings of a generation in a complex are evaluated together (by worker threads if available)
+ * - in the default steady-state mode, offspring replaces its parent before the next offspring is created, models are evaluated one by one;
+ *   generational mode creates all offsprings from the complex at the beginning of the generation, so results differ from steady-state mode,
+ *   but they do not depend on number of threads
+ * @param generational whether offsprings are evaluated by generations
+ */
+template<class FCD>
+void DE_optim<FCD>::set_generational(bool generational)
+{
+  this->generational = generational;
+}
+
+/**
+ * - sets binary checkpoint of ensemble optimization, state of members is written after each shuffle and each finished member
+ * - resumed optimization continues from the state in the file and gives the same results as uninterrupted run,
+ *   the file must be created on the same platform with the same settings and parameter bounds
+ * @param checkpoint_file name of checkpoint file, empty for no checkpoints
+ * @param resume whether to resume from the file if it exists, otherwise the file is overwritten
+ */
+template<class FCD>
+void DE_optim<FCD>::set_checkpoint(string checkpoint_file, bool resume)
+{
+  this->checkpoint_file = checkpoint_file;
+  this->resume = resume;
+}
+
+/**
+ * - sets rules for early termination of ensemble members, they are checked before each shuffle
+ * - member is terminated when relative improvement of best fitness over last stop_shuffles shuffles is not greater than stop_improv,
+ *   when spread of each parameter in population relative to its bounds is lower than stop_spread,
+ *   or when the next shuffle would exceed max_eval model evaluations; maxn_shuffles is always the upper limit
+ * @param stop_shuffles number of shuffles for evaluation of improvement, 0 for no check
+ * @param stop_improv maximum relative improvement of best fitness leading to termination
+ * @param stop_spread spread of parameters leading to termination, 0 for no check
+ * @param max_eval maximum number of model evaluations for a member, 0 for no limit
+ */
+template<class FCD>
+void DE_optim<FCD>::set_stopping(unsigned stop_shuffles, double stop_improv, double stop_spread, unsigned max_eval)
+{
+  this->stop_shuffles = stop_shuffles;
+  this->stop_improv = stop_improv;
+  this->stop_spread = stop_spread;
+  this->max_eval = max_eval;
+}
+
+/**
+ * - sets surrogate pre-screening of offsprings
+ * - criterion of offspring is predicted from models evaluated in the current shuffle (and the population at its beginning),
+ *   offspring is not evaluated if the prediction is worse than criterion of its parent by more than surrogate_factor times the mean error of the surrogate
+ * @param use_surrogate whether offsprings are pre-screened
+ * @param surrogate_factor multiple of mean error of the surrogate, larger values skip fewer offsprings
+ * @param surrogate_size maximum number of models in archive of the surrogate
+ */
+template<class FCD>
+void DE_optim<FCD>::set_surrogate(bool use_surrogate, double surrogate_factor, unsigned surrogate_size)
+{
+  if (surrogate_factor < 0)
+    throw bil_err("Factor of surrogate error must not be negative.");
+
+  this->use_surrogate = use_surrogate;
+  this->surrogate_factor = surrogate_factor;
+  this->surrogate_size = surrogate_size;
+}
+
+/**
+ * - sets how parameters of offspring which get outside bounds by mutation are handled
+ * - rejection to the parent value (default), no handling, reflection from the bound, midpoint between the parent and the bound,
+ *   random value within bounds or clamping to the bound
+ * @param bound_handling type of bound handling
+ */
+template<class FCD>
+void DE_optim<FCD>::set_bound_handling(unsigned bound_handling)
+{
+  if (bound_handling >= bound_type_count)
+    throw bil_err("Unknown type of bound handling.");
+
+  this->bound_handling = bound_handling;
+}
+
 /**
  * - initializes all members of the population via Latin hypercube sampling
  * - runs the model first time
@@ -468,17 +605,17 @@ void DE_optim<FCD>::initialize_population()
   for (par = 0; par < this->par_count; par++) {
     random_perm();
   	for (sp = 0; sp < popul_size; sp++) {
-      popul_parent[par][sp] = ((this->hm[par] - this->dm[par]) * (static_cast<double>(rand_indexes[sp]) - randu_gen()) / (static_cast<double>(popul_size))) + this->dm[par];
+      popul_parent[par][sp] = ((this->hm[par] - this->dm[par]) * (static_cast<double>(rand_indexes[sp]) - rng.uniform()) / (static_cast<double>(popul_size))) + this->dm[par];
     }
   }
-  model_eval = 0;
-  for (sp = 0; sp < popul_size; sp++) {
-    for (par = 0; par < this->par_count; par++)
-      this->fcd->set_param(par, this->CURR, popul_parent[par][sp]);
-    this->fcd->run(this->init_GS);
-    model_eval++;
-    popul_parent[this->par_count][sp] = this->fcd->calc_crit(this->crit_type, this->weight_BF, this->use_weights);
+  if (is_adaptive()) {
+    for (sp = 0; sp < popul_size; sp++) {
+      popul_parent[n_parof][sp] = mutat_f;
+      popul_parent[n_parof + 1][sp] = cross;
+    }
   }
+  this->eval_models(popul_parent, popul_size);
+  model_eval = popul_size;
   for (sp = 0; sp < popul_size; sp++) {
     models_for_comp[sp].model_fitness = popul_parent[this->par_count][sp];
     models_for_comp[sp].model_index = sp;
@@ -497,43 +634,13 @@ void DE_optim<FCD>::random_perm()
     rand_indexes[sp] = sp + 1;
   }
   for (sp = popul_size - 1; sp > 0; sp--) {
-    j = rand_unsint(sp + 1);
+    j = rng.below(sp + 1);
     tmp = rand_indexes[j];
     rand_indexes[j] = rand_indexes[sp];
     rand_indexes[sp] = tmp;
   }
 }
 
-/**
- * - uniform random unsigned integer number generator
- * @param n upper limit for generated values (excluded)
- * @return random number
- */
-template<class FCD>
-unsigned DE_optim<FCD>::rand_unsint(unsigned n)
-{
-  unsigned limit = RAND_MAX - RAND_MAX % n;
-  unsigned rnd;
-  do {
-    rnd = rand();
-  } while (rnd >= limit);
-
-  return rnd % n;
-}
-
-/**
- * - uniform random double number generator
- * @return random number between 0 and 1 (excluding 1)
- */
-template<class FCD>
-double DE_optim<FCD>::randu_gen()
-{
-  unsigned LIM_MAX;
-
-  LIM_MAX = 1 + (static_cast<unsigned>(RAND_MAX)); //to exclude upper limit (number 1)
-  return static_cast<double>(rand()) / static_cast<double>(LIM_MAX);
-}
-
 /**
  * - creates the complexes from parent population
  */
@@ -543,7 +650,7 @@ void DE_optim<FCD>::make_comp_from_parent()
   unsigned com, sp, par, tmp = 0;
   for (com = 0; com < n_comp; com++) {
     for (sp = 0; sp < comp_size; sp++) {
-      for (par = 0; par < n_parof; par++) {
+      for (par = 0; par < n_rows; par++) {
         comp[par][sp][com] = popul_parent[par][tmp];
       }
       tmp += n_comp;
@@ -561,7 +668,7 @@ void DE_optim<FCD>::make_parent_from_comp()
   unsigned com, sp, par, tmp = 0;
   for (com = 0; com < n_comp; com++) {
     for (sp = 0; sp < comp_size; sp++) {
-      for (par = 0; par < n_parof; par++) {
+      for (par = 0; par < n_rows; par++) {
         popul_parent[par][tmp] = comp[par][sp][com];
       }
       tmp++;
@@ -597,12 +704,12 @@ void DE_optim<FCD>::sort_param_parent()
   //swap parent model population
   unsigned sp, par;
   for (sp = 0; sp < popul_size; sp++) {
-    for (par = 0; par < n_parof; par++) {
+    for (par = 0; par < n_rows; par++) {
       popul_parent_tmp[par][sp] = popul_parent[par][models_for_comp[sp].model_index];
     }
   }
   for (sp = 0; sp < popul_size; sp++) {
-    for (par = 0; par < n_parof; par++) {
+    for (par = 0; par < n_rows; par++) {
       popul_parent[par][sp] = popul_parent_tmp[par][sp];
     }
   }
@@ -613,156 +720,690 @@ void DE_optim<FCD>::sort_param_parent()
 }
 
 /**
- * - fills given array by a sequence of random unsigned integers without repetitions
- * - checks if array has sufficient length for filling
- * @param randoms array to be filled
- * @param size array size
- * @param upper_limit limit for generated numbers (excluded)
- * @param forbidden one value forbidden to be generated
+ * - gets number of random members of complex used for mutation according to DE type
+ * @return number of members
  */
 template<class FCD>
-void DE_optim<FCD>::get_randoms_without_rep(unsigned *randoms, unsigned size, unsigned upper_limit, unsigned forbidden)
+unsigned DE_optim<FCD>::get_sp_rand_size()
 {
-  if (size >= upper_limit - 1) //-1 is due to one forbidden value
-    throw bil_err("The limit does not allow to store unique randoms to given array.");
-  unsigned tmp_rand, r, tmp_r;
-  double tmp_drand;
-  bool accept;
-  for (r = 0; r < size; r++) {
-    do {
-      accept = true;
-      tmp_drand = randu_gen();
-      tmp_rand = static_cast<unsigned>(tmp_drand * upper_limit);
-      if (tmp_rand == forbidden)
-        accept = false;
-      else {
-        for (tmp_r = 0; tmp_r < r; tmp_r++) {
-          if (tmp_rand == randoms[tmp_r]) {
-            accept = false;
+  switch (DE_type) {
+    case BEST_ONE_BIN:
+      return 2;
+    case BEST_TWO_BIN:
+      return 4;
+    case RAND_TWO_BIN:
+      return 5;
+    case JDE_BEST_ONE_BIN:
+      return 2;
+    case JDE_RAND_ONE_BIN:
+      return 3;
+    default:
+      throw bil_err("Invalid DE type.");
+      break;
+  }
+}
+
+/**
+ * - number of uniform random values for one offspring: crossover values for parameters,
+ *   for self-adaptive types values deciding on new mutation and crossover parameters
+ *   and for random bound handling values for parameters outside bounds
+ * @return number of values
+ */
+template<class FCD>
+unsigned DE_optim<FCD>::get_u_rand_size()
+{
+  return this->par_count + (is_adaptive() ? 4 : 0) + (bound_handling == BOUND_RANDOM ? this->par_count : 0);
+}
+
+/**
+ * - generates random members for mutation and uniform random values for crossover for each offspring of one generation in a complex
+ * - random values do not depend on fitness, so they can be generated in advance for several generations or complexes
+ * @param sp_rand members for mutation and index of parameter mutated always in the last column - matrix(comp_size, sp_rand_size + 1) by rows
+ * @param u_rand uniform random values - matrix(comp_size, u_rand_size) by rows
+ */
+template<class FCD>
+void DE_optim<FCD>::draw_DE_randoms(unsigned *sp_rand, double *u_rand)
+{
+  unsigned sp_rand_size = get_sp_rand_size(), u_rand_size = get_u_rand_size(), sp, u;
+  for (sp = 0; sp < comp_size; sp++) {
+    rng.draw_distinct(sp_rand + sp * (sp_rand_size + 1), sp_rand_size, comp_size, sp);
+    sp_rand[sp * (sp_rand_size + 1) + sp_rand_size] = rng.below(this->par_count); //index of parameter to be mutated for any crossover probability
+    for (u = 0; u < u_rand_size; u++)
+      u_rand[sp * u_rand_size + u] = rng.uniform();
+  }
+}
+
+/**
+ * - creates offsprings of given members of a complex by mutation and crossover
+ * - for self-adaptive types (jDE), offspring takes mutation and crossover parameters of its parent or with probability jde_tau new random ones,
+ *   they are kept in the population only if the offspring replaces its parent
+ * @param com index of complex
+ * @param first index of the first member
+ * @param count number of members
+ * @param sp_rand members for mutation generated by draw_DE_randoms
+ * @param u_rand uniform random values generated by draw_DE_randoms
+ * @param best best model used for mutation
+ * @param offsprings offsprings to be created - matrix(n_rows, comp_size)
+ */
+template<class FCD>
+void DE_optim<FCD>::make_offsprings(unsigned com, unsigned first, unsigned count, const unsigned *sp_rand, const double *u_rand, const double *best, double **offsprings)
+{
+  unsigned sp_rand_size = get_sp_rand_size(), u_rand_size = get_u_rand_size(), sp, par;
+  const unsigned *tmp_rand;
+  const double *tmp_u;
+  double tmp_f = mutat_f, tmp_cross = cross;
+  for (sp = first; sp < first + count; sp++) {
+    tmp_rand = sp_rand + sp * (sp_rand_size + 1);
+    tmp_u = u_rand + sp * u_rand_size;
+    if (is_adaptive()) {
+      const double *u_ctrl = tmp_u + this->par_count;
+      tmp_f = u_ctrl[0] < jde_tau ? jde_f_lower + u_ctrl[1] * (jde_f_upper - jde_f_lower) : comp[n_parof][sp][com];
+      tmp_cross = u_ctrl[2] < jde_tau ? u_ctrl[3] : comp[n_parof + 1][sp][com];
+      offsprings[n_parof][sp] = tmp_f;
+      offsprings[n_parof + 1][sp] = tmp_cross;
+    }
+    for (par = 0; par < this->par_count; par++) {
+      if (tmp_u[par] < tmp_cross || par == tmp_rand[sp_rand_size]) {
+        switch (DE_type) {
+          case BEST_ONE_BIN:
+          case JDE_BEST_ONE_BIN:
+            offsprings[par][sp] = best[par] + tmp_f * (comp[par][tmp_rand[0]][com] - comp[par][tmp_rand[1]][com]);
+            break;
+          case BEST_TWO_BIN:
+            offsprings[par][sp] = best[par] + mutat_k * (comp[par][tmp_rand[0]][com] - comp[par][tmp_rand[3]][com]) + mutat_f * (comp[par][tmp_rand[1]][com] - comp[par][tmp_rand[2]][com]);
+            break;
+          case RAND_TWO_BIN:
+            offsprings[par][sp] = comp[par][tmp_rand[0]][com] + mutat_k * (comp[par][tmp_rand[4]][com] - comp[par][tmp_rand[3]][com]) + mutat_f * (comp[par][tmp_rand[1]][com] - comp[par][tmp_rand[2]][com]);
+            break;
+          case JDE_RAND_ONE_BIN:
+            offsprings[par][sp] = comp[par][tmp_rand[0]][com] + tmp_f * (comp[par][tmp_rand[1]][com] - comp[par][tmp_rand[2]][com]);
+            break;
+          default:
             break;
-          }
         }
+        if (offsprings[par][sp] < this->dm[par] || offsprings[par][sp] > this->hm[par])
+          offsprings[par][sp] = handle_bounds(par, offsprings[par][sp], comp[par][sp][com], bound_handling == BOUND_RANDOM ? tmp_u[u_rand_size - this->par_count + par] : 0);
+      }
+      else {
+        offsprings[par][sp] = comp[par][sp][com];
       }
-    } while (accept == false);
-    randoms[r] = tmp_rand;
+    } //par
   }
 }
 
 /**
- * - perfoms DE of type best/1/bin
- * @param com index of complex
+ * - gets new value of mutated parameter which is outside bounds
+ * @param par index of parameter
+ * @param value mutated value outside bounds
+ * @param parent value of parent (within bounds)
+ * @param u uniform random value used for random reinitialization
+ * @return value according to bound handling
  */
 template<class FCD>
-void DE_optim<FCD>::DE(unsigned com)
+double DE_optim<FCD>::handle_bounds(unsigned par, double value, double parent, double u)
 {
-  unsigned sp_rand_size, *sp_rand, par_rand, sp, par, gen;
-  switch (DE_type) {
-    case BEST_ONE_BIN:
-      sp_rand_size = 2;
-      break;
-    case BEST_TWO_BIN:
-      sp_rand_size = 4;
-      break;
-    case RAND_TWO_BIN:
-      sp_rand_size = 5;
-      break;
+  double low = this->dm[par], upp = this->hm[par];
+  switch (bound_handling) {
+    case BOUND_REJECT:
+      return parent;
+    case BOUND_REFLECT:
+      value = value < low ? 2 * low - value : 2 * upp - value;
+      return value < low ? low : (value > upp ? upp : value); //clamped if reflected beyond the opposite bound
+    case BOUND_MIDPOINT:
+      return value < low ? (low + parent) / 2 : (upp + parent) / 2;
+    case BOUND_RANDOM:
+      return low + u * (upp - low);
+    case BOUND_CLAMP:
+      return value < low ? low : upp;
     default:
-      throw bil_err("Invalid DE type.");
-      break;
+      return value;
   }
-  sp_rand = new unsigned[sp_rand_size];
-  for (gen = 0; gen < n_gen_comp; gen++) {
-    for (sp = 0; sp < comp_size; sp++) {
-      get_randoms_without_rep(sp_rand, sp_rand_size, comp_size, sp);
-      par_rand = rand_unsint(this->par_count); //index of parameter to be mutated for any crossover probability
-      for (par = 0; par < this->par_count; par++) {
-        if (randu_gen() < cross || par == par_rand) {
-          switch (DE_type) {
-            case BEST_ONE_BIN:
-              offsprings_tmp[par][sp] = best_model[par] + mutat_f * (comp[par][sp_rand[0]][com] - comp[par][sp_rand[1]][com]);
-              break;
-            case BEST_TWO_BIN:
-              offsprings_tmp[par][sp] = best_model[par] + mutat_k * (comp[par][sp_rand[0]][com] - comp[par][sp_rand[3]][com]) + mutat_f * (comp[par][sp_rand[1]][com] - comp[par][sp_rand[2]][com]);
-              break;
-            case RAND_TWO_BIN:
-              offsprings_tmp[par][sp] = comp[par][sp_rand[0]][com] + mutat_k * (comp[par][sp_rand[4]][com] - comp[par][sp_rand[3]][com]) + mutat_f * (comp[par][sp_rand[1]][com] - comp[par][sp_rand[2]][com]);
-              break;
-            default:
-              break;
-          }
-          if (reject_outside) {
-            if (offsprings_tmp[par][sp] < this->dm[par] || offsprings_tmp[par][sp] > this->hm[par])
-              offsprings_tmp[par][sp] = comp[par][sp][com];
-          }
-        }
-        else {
-          offsprings_tmp[par][sp] = comp[par][sp][com];
-        }
+}
 
-        this->fcd->set_param(par, this->CURR, offsprings_tmp[par][sp]);
-      } //par
-      this->fcd->run(this->init_GS);
-      model_eval++;
-      offsprings_tmp[this->par_count][sp] = this->fcd->calc_crit(this->crit_type, this->weight_BF, this->use_weights);
-      if (offsprings_tmp[this->par_count][sp] < comp[this->par_count][sp][com]) {
-        for (par = 0; par < n_parof; par++)
-          comp[par][sp][com] = offsprings_tmp[par][sp];
-
-        if (offsprings_tmp[this->par_count][sp] < best_model[this->par_count]) {
-          for (par = 0; par < n_parof; par++) {
-            best_model[par] = offsprings_tmp[par][sp];
-          }
+/**
+ * - evaluates offsprings of given members of a complex
+ * - with surrogate, offsprings predicted to be worse than their parents by more than surrogate_factor times the mean error of the surrogate
+ *   are not evaluated and get criterion of their parents, so they do not replace them
+ * @param com index of complex
+ * @param first index of the first member
+ * @param count number of members
+ * @param offsprings offsprings to be evaluated - matrix(n_rows, comp_size)
+ * @param sur surrogate of the complex, evaluated offsprings are added to it
+ * @param eval_fcd functoid evaluating the models, 0 for evaluation by workers
+ * @return number of evaluated offsprings
+ */
+template<class FCD>
+unsigned DE_optim<FCD>::eval_offsprings(unsigned com, unsigned first, unsigned count, double **offsprings, DE_surrogate &sur, FCD eval_fcd)
+{
+  unsigned sp, par;
+  if (!use_surrogate) {
+    vector<double*> models(n_parof); //rows starting at the first member
+    for (par = 0; par < n_parof; par++)
+      models[par] = offsprings[par] + first;
+    if (eval_fcd)
+      this->eval_models(&models[0], count, eval_fcd);
+    else
+      this->eval_models(&models[0], count);
+    return count;
+  }
+
+  unsigned screened_count = 0;
+  double **screened = new double*[n_parof]; //offsprings to be evaluated
+  for (par = 0; par < n_parof; par++)
+    screened[par] = new double[count];
+  unsigned *screened_sp = new unsigned[count];
+  double *predicted = new double[count];
+  bool *is_predicted = new bool[count];
+  for (sp = first; sp < first + count; sp++) {
+    double pred = 0;
+    bool is_pred = sur.predict(offsprings, sp, pred);
+    if (is_pred && sur.is_verified() && pred - comp[this->par_count][sp][com] > surrogate_factor * sur.get_error()) {
+      offsprings[this->par_count][sp] = comp[this->par_count][sp][com];
+      continue;
+    }
+    for (par = 0; par < this->par_count; par++)
+      screened[par][screened_count] = offsprings[par][sp];
+    screened_sp[screened_count] = sp;
+    predicted[screened_count] = pred;
+    is_predicted[screened_count] = is_pred;
+    screened_count++;
+  }
+
+  bool is_err = false;
+  string err_descr;
+  try {
+    if (eval_fcd)
+      this->eval_models(screened, screened_count, eval_fcd);
+    else
+      this->eval_models(screened, screened_count);
+  }
+  catch (bil_err &error) {
+    is_err = true;
+    err_descr = error.descr;
+  }
+  if (!is_err) {
+    for (unsigned s = 0; s < screened_count; s++) {
+      double fit = screened[this->par_count][s];
+      offsprings[this->par_count][screened_sp[s]] = fit;
+      if (is_predicted[s] && fit < numeric_limits<double>::max())
+        sur.add_error(fabs(predicted[s] - fit));
+      sur.add(screened, s);
+    }
+  }
+
+  for (par = 0; par < n_parof; par++)
+    delete[] screened[par];
+  delete[] screened;
+  delete[] screened_sp;
+  delete[] predicted;
+  delete[] is_predicted;
+  if (is_err)
+    throw bil_err(err_descr);
+  return screened_count;
+}
+
+/**
+ * - evaluated offsprings of given members replace worse members of the complex in order, best model is updated
+ * @param com index of complex
+ * @param first index of the first member
+ * @param count number of members
+ * @param offsprings evaluated offsprings - matrix(par_count+1, comp_size)
+ * @param best best model to be updated
+ */
+template<class FCD>
+void DE_optim<FCD>::select_offsprings(unsigned com, unsigned first, unsigned count, double **offsprings, double *best)
+{
+  unsigned sp, par;
+  for (sp = first; sp < first + count; sp++) {
+    if (offsprings[this->par_count][sp] < comp[this->par_count][sp][com]) {
+      for (par = 0; par < n_rows; par++)
+        comp[par][sp][com] = offsprings[par][sp];
+
+      if (offsprings[this->par_count][sp] < best[this->par_count]) {
+        for (par = 0; par < n_parof; par++) {
+          best[par] = offsprings[par][sp];
         }
       }
     }
+  }
+}
+
+/**
+ * - performs one generation of DE in a complex
+ * - in steady-state mode, each offspring is created from the current complex, evaluated by given functoid and replaces its parent immediately if it is better
+ * - in generational mode, offsprings are created from the complex at the beginning of the generation and evaluated together,
+ *   then they replace worse members of the complex in order
+ * @param com index of complex
+ * @param sp_rand members for mutation generated by draw_DE_randoms
+ * @param u_rand uniform random values generated by draw_DE_randoms
+ * @param best best model used for mutation and updated by selection
+ * @param offsprings offsprings of the generation - matrix(n_rows, comp_size)
+ * @param sur surrogate of the complex
+ * @param eval_fcd functoid evaluating the models, 0 for evaluation by workers (by the model in steady-state mode)
+ * @return number of evaluated offsprings
+ */
+template<class FCD>
+unsigned DE_optim<FCD>::evolve_generation(unsigned com, const unsigned *sp_rand, const double *u_rand, double *best, double **offsprings, DE_surrogate &sur, FCD eval_fcd)
+{
+  if (generational) {
+    make_offsprings(com, 0, comp_size, sp_rand, u_rand, best, offsprings);
+    unsigned evals = eval_offsprings(com, 0, comp_size, offsprings, sur, eval_fcd);
+    select_offsprings(com, 0, comp_size, offsprings, best);
+    return evals;
+  }
+
+  if (!eval_fcd)
+    eval_fcd = this->fcd;
+  unsigned evals = 0;
+  for (unsigned sp = 0; sp < comp_size; sp++) {
+    make_offsprings(com, sp, 1, sp_rand, u_rand, best, offsprings);
+    evals += eval_offsprings(com, sp, 1, offsprings, sur, eval_fcd);
+    select_offsprings(com, sp, 1, offsprings, best);
+  }
+  return evals;
+}
+
+/**
+ * - perfoms DE of type best/1/bin
+ * - offsprings replace members of the complex one by one, or in generational mode after all of them are evaluated (possibly in parallel)
+ * @param com index of complex
+ */
+template<class FCD>
+void DE_optim<FCD>::DE(unsigned com)
+{
+  unsigned *sp_rand = new unsigned[comp_size * (get_sp_rand_size() + 1)];
+  double *u_rand = new double[comp_size * get_u_rand_size()];
+  for (unsigned gen = 0; gen < n_gen_comp; gen++) {
+    draw_DE_randoms(sp_rand, u_rand);
+    unsigned evals = evolve_generation(com, sp_rand, u_rand, best_model, offsprings_tmp, surrogate, 0);
+    model_eval += evals;
+    offspring_count += comp_size;
+    skipped_count += comp_size - evals;
   } //end of generation loop in one complex
   delete[] sp_rand;
+  delete[] u_rand;
+}
+
+/**
+ * - performs DE for all complexes concurrently, each complex is evaluated by one worker (or by the model if workers are not available)
+ * - random values are generated in advance in order of complexes, so they are the same as for sequential DE
+ * - each complex mutates with its own copy of the best model from the beginning of shuffle, the best model is updated from the complexes after they finish
+ */
+template<class FCD>
+void DE_optim<FCD>::DE_parallel()
+{
+  unsigned rand_gen_size = comp_size * (get_sp_rand_size() + 1), u_gen_size = comp_size * get_u_rand_size();
+  unsigned com, gen, par;
+  unsigned *sp_rand = new unsigned[n_comp * n_gen_comp * rand_gen_size];
+  double *u_rand = new double[n_comp * n_gen_comp * u_gen_size];
+  for (com = 0; com < n_comp; com++) {
+    for (gen = 0; gen < n_gen_comp; gen++)
+      draw_DE_randoms(sp_rand + (com * n_gen_comp + gen) * rand_gen_size, u_rand + (com * n_gen_comp + gen) * u_gen_size);
+  }
+
+  double **comp_best = new double*[n_comp];
+  double ***comp_offsprings = new double**[n_comp];
+  for (com = 0; com < n_comp; com++) {
+    comp_best[com] = new double[n_parof];
+    for (par = 0; par < n_parof; par++)
+      comp_best[com][par] = best_model[par];
+    comp_offsprings[com] = new double*[n_rows];
+    for (par = 0; par < n_rows; par++)
+      comp_offsprings[com][par] = new double[comp_size];
+  }
+  vector<DE_surrogate> comp_sur(n_comp, surrogate); //each complex extends its own copy of surrogate
+  vector<unsigned> comp_evals(n_comp, 0);
+
+  bool is_err = false;
+  string err_descr;
+  #pragma omp parallel for private(gen) schedule(dynamic) num_threads(this->workers.empty() ? 1 : this->workers.size())
+  for (int c = 0; c < static_cast<int>(n_comp); c++) {
+    FCD eval_fcd = this->fcd;
+#ifdef _OPENMP
+    if (!this->workers.empty())
+      eval_fcd = this->workers[omp_get_thread_num()];
+#endif
+    try {
+      for (gen = 0; gen < n_gen_comp; gen++) {
+        comp_evals[c] += evolve_generation(c, sp_rand + (c * n_gen_comp + gen) * rand_gen_size, u_rand + (c * n_gen_comp + gen) * u_gen_size,
+          comp_best[c], comp_offsprings[c], comp_sur[c], eval_fcd);
+      }
+    }
+    catch (bil_err &error) { //exceptions cannot leave parallel region
+      #pragma omp critical(bil_eval_err)
+      {
+        is_err = true;
+        err_descr = error.descr;
+      }
+    }
+  }
+  for (com = 0; com < n_comp; com++) {
+    model_eval += comp_evals[com];
+    offspring_count += n_gen_comp * comp_size;
+    skipped_count += n_gen_comp * comp_size - comp_evals[com];
+  }
+
+  for (com = 0; com < n_comp; com++) {
+    if (comp_best[com][this->par_count] < best_model[this->par_count]) {
+      for (par = 0; par < n_parof; par++)
+        best_model[par] = comp_best[com][par];
+    }
+    for (par = 0; par < n_rows; par++)
+      delete[] comp_offsprings[com][par];
+    delete[] comp_offsprings[com];
+    delete[] comp_best[com];
+  }
+  delete[] comp_offsprings;
+  delete[] comp_best;
+  delete[] sp_rand;
+  delete[] u_rand;
+  if (is_err)
+    throw bil_err(err_descr);
+}
+
+/**
+ * - maximum spread of parameters in parent population, spread of parameter is its range relative to the range of its bounds
+ * @return maximum spread (0 if population is collapsed to one point)
+ */
+template<class FCD>
+double DE_optim<FCD>::get_popul_spread()
+{
+  double max_spread = 0;
+  for (unsigned par = 0; par < this->par_count; par++) {
+    if (this->hm[par] - this->dm[par] < NUMERIC_EPS)
+      continue;
+    double *par_popul = popul_parent[par];
+    double spread = (*max_element(par_popul, par_popul + popul_size) - *min_element(par_popul, par_popul + popul_size)) / (this->hm[par] - this->dm[par]);
+    if (spread > max_spread)
+      max_spread = spread;
+  }
+  return max_spread;
+}
+
+/**
+ * - checks rules for termination of ensemble member before next shuffle, sets reason for termination
+ * @param shuffle number of finished shuffles
+ * @return whether to terminate the member
+ */
+template<class FCD>
+bool DE_optim<FCD>::is_stop(unsigned shuffle)
+{
+  if (shuffle >= maxn_shuffles)
+    stop_reason = STOP_SHUFFLES;
+  else if (stop_shuffles > 0 && shuffle >= stop_shuffles
+    && shuffle_best[shuffle - stop_shuffles] - shuffle_best[shuffle] <= stop_improv * fabs(shuffle_best[shuffle - stop_shuffles]))
+    stop_reason = STOP_IMPROV;
+  else if (stop_spread > 0 && get_popul_spread() < stop_spread)
+    stop_reason = STOP_SPREAD;
+  else if (max_eval > 0 && model_eval + popul_size * n_gen_comp > max_eval)
+    stop_reason = STOP_MAX_EVAL;
+  else
+    return false;
+  return true;
 }
 
 /**
  * - shuffled complex evolution using differential evolution of given type
+ * - shuffles are done until a rule for termination is met, state of the member is stored in checkpoint after each shuffle
+ * @param ens index of ensemble member
+ * @param first_shuffle number of shuffles already done (when resumed from checkpoint)
  */
 template<class FCD>
-void DE_optim<FCD>::SCE_DE()
+void DE_optim<FCD>::SCE_DE(unsigned ens, unsigned first_shuffle)
 {
-  for (unsigned k = 0; k < maxn_shuffles; k++) {
+  for (unsigned k = first_shuffle; !is_stop(k); k++) {
     sort_param_parent();
     make_comp_from_parent();
-    for (unsigned com = 0; com < n_comp; com++) {
-      DE(com);
+    if (use_surrogate) {
+      surrogate.init(this->par_count, this->dm, this->hm, surrogate_size);
+      for (unsigned sp = 0; sp < popul_size; sp++)
+        surrogate.add(popul_parent, sp);
+    }
+    if (parallel_comp)
+      DE_parallel();
+    else {
+      for (unsigned com = 0; com < n_comp; com++) {
+        DE(com);
+      }
     }
     make_parent_from_comp();
+    shuffle_best.push_back(best_model[this->par_count]);
+    if (ckp)
+      ckp->set_member(ens, k + 1, model_eval, rng, popul_parent, best_model, shuffle_best);
   }
 }
 
+/**
+ * - SCE-DE optimization run for one ensemble member
+ * - random number generator is set to the stream of the member, so results of members do not depend on their order
+ * - member started before is continued from the state stored in checkpoint
+ * @param ens index of ensemble member
+ * @param member_rng random number generator of the member
+ */
+template<class FCD>
+void DE_optim<FCD>::optimize_member(unsigned ens, const bil_rng &member_rng)
+{
+  unsigned first_shuffle = 0;
+  if (ckp && ckp->get_status(ens) == DE_checkpoint::STARTED) {
+    first_shuffle = ckp->get_member(ens, model_eval, rng, popul_parent, best_model, shuffle_best);
+    for (unsigned sp = 0; sp < popul_size; sp++) {
+      models_for_comp[sp].model_fitness = popul_parent[this->par_count][sp];
+      models_for_comp[sp].model_index = sp;
+    }
+  }
+  else {
+    rng = member_rng;
+    initialize_population();
+    unsigned best_sp = 0; //best model of initial population, used if member is terminated before first shuffle
+    for (unsigned sp = 1; sp < popul_size; sp++) {
+      if (popul_parent[this->par_count][sp] < popul_parent[this->par_count][best_sp])
+        best_sp = sp;
+    }
+    for (unsigned par = 0; par < n_parof; par++)
+      best_model[par] = popul_parent[par][best_sp];
+    shuffle_best.assign(1, best_model[this->par_count]);
+    if (ckp)
+      ckp->set_member(ens, 0, model_eval, rng, popul_parent, best_model, shuffle_best);
+  }
+  SCE_DE(ens, first_shuffle);
+
+  for (unsigned par = 0; par < this->par_count; par++)
+    ensemble_resul[ens][par] = best_model[par];
+  if (this->crit_type == this->NS || this->crit_type == this->LNNS)
+    ensemble_resul[ens][this->par_count] = 1 - best_model[this->par_count];
+  else
+    ensemble_resul[ens][this->par_count] = best_model[this->par_count];
+  ensemble_resul[ens][n_parof] = static_cast<double>(model_eval);
+  ensemble_resul[ens][n_parof + 1] = static_cast<double>(stop_reason);
+  if (ckp)
+    ckp->set_result(ens, ensemble_resul[ens]);
+}
+
+/**
+ * - gets settings which must be the same when optimization is resumed from checkpoint
+ * @return DE settings, criterion settings and parameter bounds
+ */
+template<class FCD>
+vector<double> DE_optim<FCD>::get_checkpoint_settings()
+{
+  double tmp_sett[] = { static_cast<double>(this->par_count), static_cast<double>(ens_count), static_cast<double>(popul_size),
+    static_cast<double>(n_comp), static_cast<double>(comp_size), static_cast<double>(maxn_shuffles), static_cast<double>(n_gen_comp),
+    static_cast<double>(DE_type), cross, mutat_f, mutat_k, static_cast<double>(parallel_comp), static_cast<double>(generational), static_cast<double>(seed),
+    static_cast<double>(this->crit_type), this->weight_BF, static_cast<double>(this->use_weights), static_cast<double>(this->init_GS),
+    static_cast<double>(stop_shuffles), stop_improv, stop_spread, static_cast<double>(max_eval), static_cast<double>(bound_handling),
+    static_cast<double>(use_surrogate), surrogate_factor, static_cast<double>(surrogate_size) };
+  vector<double> sett(tmp_sett, tmp_sett + sizeof(tmp_sett) / sizeof(tmp_sett[0]));
+  for (unsigned par = 0; par < this->par_count; par++) {
+    sett.push_back(this->dm[par]);
+    sett.push_back(this->hm[par]);
+  }
+  return sett;
+}
+
 /**
  * - ensemble SCE-DE optimization run
+ * - each ensemble member has its own stream of random numbers, streams are separated by jumps of generator initialized by the seed
+ * - with more threads, members are optimized concurrently by copies of the optimizer if there are at least as many members as threads,
+ *   otherwise members are optimized one by one and models are evaluated concurrently; results are the same in both cases
+ * - with checkpoint file, state is written after each shuffle and each member, resumed optimization skips finished members and continues started ones
  * - last ensemble results are assigned to current model (to allow write of results by write_file)
  */
 template<class FCD>
 void DE_optim<FCD>::optimize()
+{
+  std::vector<unsigned> todo = prepare_members();
+
+  unsigned par;
+  this->new_workers(this->crit_type);
+  if (!this->workers.empty() && todo.size() >= this->workers.size()) {
+    //copies of optimizer evaluating models by workers
+    std::vector<DE_optim<FCD>*> members(this->workers.size());
+    for (unsigned t = 0; t < members.size(); t++) {
+      members[t] = clone();
+      members[t]->set_functoid(this->workers[t]);
+      members[t]->ckp = ckp;
+    }
+    bool is_err = false;
+    string err_descr;
+    #pragma omp parallel for private(par) schedule(dynamic) num_threads(members.size())
+    for (int m = 0; m < static_cast<int>(todo.size()); m++) {
+      unsigned e = todo[m];
+      DE_optim<FCD> *member = members[0];
+#ifdef _OPENMP
+      member = members[omp_get_thread_num()];
+#endif
+      try {
+        member->optimize_member(e, member_rngs[e]);
+        for (par = 0; par < n_parof + 2; par++)
+          ensemble_resul[e][par] = member->ensemble_resul[e][par];
+      }
+      catch (bil_err &error) { //exceptions cannot leave parallel region
+        #pragma omp critical(bil_eval_err)
+        {
+          is_err = true;
+          err_descr = error.descr;
+        }
+      }
+    }
+    for (unsigned t = 0; t < members.size(); t++) {
+      offspring_count += members[t]->offspring_count;
+      skipped_count += members[t]->skipped_count;
+      members[t]->ckp = 0; //owned by this optimizer
+      delete members[t];
+    }
+    if (is_err)
+      throw bil_err(err_descr);
+  }
+  else {
+    for (unsigned m = 0; m < todo.size(); m++)
+      optimize_member(todo[m], member_rngs[todo[m]]);
+  }
+  this->delete_workers();
+  finish_members();
+}
+
+/**
+ * - prepares ensemble run: allocates arrays, initializes generators of members, reads or creates checkpoint
+ *   and calculates statistics of observed data (so that members can be optimized concurrently)
+ * @return indexes of members to be optimized (all of them unless resumed from checkpoint)
+ */
+template<class FCD>
+vector<unsigned> DE_optim<FCD>::prepare_members()
 {
   init();
   if (n_comp == 0)
     throw bil_err("DE optimization is not set and cannot be used.");
 
-  unsigned par;
-  if (seed > 0)
-    srand(seed);
-  for (unsigned ens = 0; ens < ens_count; ens++) {
-    initialize_population();
- 	  SCE_DE();
+  unsigned ens;
+  member_rngs.resize(ens_count);
+  bil_rng tmp_rng;
+  tmp_rng.seed(seed > 0 ? seed : static_cast<uint32_t>(time(0)));
+  for (ens = 0; ens < ens_count; ens++) {
+    member_rngs[ens] = tmp_rng;
+    tmp_rng.jump();
+  }
 
-    for (par = 0; par < this->par_count; par++)
-      ensemble_resul[ens][par] = best_model[par];
-    if (this->crit_type == this->NS || this->crit_type == this->LNNS)
-      ensemble_resul[ens][this->par_count] = 1 - best_model[this->par_count];
-    else
-      ensemble_resul[ens][this->par_count] = best_model[this->par_count];
-    ensemble_resul[ens][n_parof] = static_cast<double>(model_eval);
+  offspring_count = skipped_count = 0;
+  delete ckp;
+  ckp = 0;
+  vector<unsigned> todo; //members not finished yet
+  if (checkpoint_file.empty()) {
+    for (ens = 0; ens < ens_count; ens++)
+      todo.push_back(ens);
   }
-  //last ensemble results to current model
-  for (par = 0; par < this->par_count; par++) {
+  else {
+    ckp = new DE_checkpoint(checkpoint_file, get_checkpoint_settings(), ens_count, n_parof, n_rows, popul_size, maxn_shuffles);
+    if (resume && ckp->read()) {
+      for (ens = 0; ens < ens_count; ens++) {
+        member_rngs[ens] = ckp->get_rng(ens); //initial generators of members not started, seed could be taken from time
+        if (ckp->get_status(ens) == DE_checkpoint::DONE)
+          ckp->get_result(ens, ensemble_resul[ens]);
+        else
+          todo.push_back(ens);
+      }
+    }
+    else {
+      for (ens = 0; ens < ens_count; ens++) {
+        ckp->init_member(ens, member_rngs[ens]);
+        todo.push_back(ens);
+      }
+      ckp->write();
+    }
+  }
+  this->fcd->prepare_obs_stats(this->crit_type, this->weight_BF, this->use_weights);
+  return todo;
+}
+
+/**
+ * - optimizes one ensemble member by a copy of the optimizer evaluating models by its own worker functoid
+ * - can be called concurrently for different members after prepare_members, results are the same as by optimize
+ * @param ens index of ensemble member
+ */
+template<class FCD>
+void DE_optim<FCD>::optimize_member_copy(unsigned ens)
+{
+  DE_optim<FCD> *member;
+  #pragma omp critical(bil_member_copy)
+  {
+    member = clone();
+  }
+  FCD worker = this->fcd->new_worker();
+  member->set_functoid(worker);
+  member->ckp = ckp;
+  bool is_err = false;
+  string err_descr;
+  try {
+    member->optimize_member(ens, member_rngs[ens]);
+  }
+  catch (bil_err &error) {
+    is_err = true;
+    err_descr = error.descr;
+  }
+  #pragma omp critical(bil_member_copy)
+  {
+    if (!is_err) {
+      for (unsigned par = 0; par < n_parof + 2; par++)
+        ensemble_resul[ens][par] = member->ensemble_resul[ens][par];
+      offspring_count += member->offspring_count;
+      skipped_count += member->skipped_count;
+    }
+    member->ckp = 0; //owned by this optimizer
+    delete member;
+  }
+  this->fcd->delete_worker(worker);
+  if (is_err)
+    throw bil_err(err_descr);
+}
+
+/**
+ * - finishes ensemble run, last ensemble results are assigned to current model and its criterion is calculated
+ */
+template<class FCD>
+void DE_optim<FCD>::finish_members()
+{
+  delete ckp;
+  ckp = 0;
+  for (unsigned par = 0; par < this->par_count; par++) {
     this->fcd->set_param(par, this->CURR, ensemble_resul[ens_count - 1][par]);
   }
   this->fcd->run(this->init_GS);
@@ -771,6 +1412,103 @@ void DE_optim<FCD>::optimize()
     this->ok = 1 - this->ok;
 }
 
+/**
+ * - gets estimated cost of optimization of one ensemble member as maximum number of model evaluations
+ *   (initial population and all shuffles, limited by max_eval) times number of time steps of model run
+ * @return estimated cost
+ */
+template<class FCD>
+double DE_optim<FCD>::get_member_cost()
+{
+  unsigned shuffle_eval = popul_size * n_gen_comp, shuffles = maxn_shuffles;
+  if (max_eval > 0 && shuffle_eval > 0) {
+    unsigned max_shuffles = max_eval > popul_size ? (max_eval - popul_size) / shuffle_eval : 0;
+    if (max_shuffles < shuffles)
+      shuffles = max_shuffles;
+  }
+  return static_cast<double>(popul_size + shuffles * shuffle_eval) * this->fcd->get_time_steps();
+}
+
+/**
+ * - optimizes ensembles of several optimizers (typically of many catchments) by a shared pool of threads
+ * - each ensemble member of each optimizer is one task, tasks are ordered by their estimated cost (maximum number of model evaluations
+ *   times number of time steps) from the most expensive and they are assigned to threads dynamically, so all threads are kept busy
+ *   even if some optimizers have less members or finish early
+ * - members are optimized with the same results as by optimize of each optimizer, number of threads of optimizers is not used
+ * @param optims optimizers with functoids and settings
+ * @param n_threads number of threads of the pool
+ * @param log_file name of file to which a line is appended when a task is finished, empty for no log
+ * @return progress and timing of tasks in order of their estimated cost (as they were assigned to threads)
+ */
+template<class FCD>
+vector<bil_task_info> DE_optimize_batch(const vector<DE_optim<FCD>*> &optims, unsigned n_threads, string log_file)
+{
+  for (unsigned o = 0; o < optims.size(); o++) {
+    if (find(optims.begin(), optims.begin() + o, optims[o]) != optims.begin() + o) {
+      ostringstream os;
+      os << "Optimizer " << o + 1 << " is already in the batch.";
+      throw bil_err(os.str());
+    }
+  }
+
+  vector<bil_task_info> tasks;
+  for (unsigned o = 0; o < optims.size(); o++) {
+    vector<unsigned> todo = optims[o]->prepare_members();
+    double cost = optims[o]->get_member_cost();
+    for (unsigned m = 0; m < todo.size(); m++) {
+      bil_task_info task = { o, todo[m], cost, 0, 0.0, 0.0, 0, false };
+      tasks.push_back(task);
+    }
+  }
+  stable_sort(tasks.begin(), tasks.end(), compare_task_cost);
+
+  ofstream log_stream;
+  if (!log_file.empty()) {
+    log_stream.open(log_file.c_str());
+    if (!log_stream)
+      throw bil_err("The log file '" + log_file + "' cannot be used.");
+    log_stream << "optim\tensemble\tthread\tstart\ttime\tevals\n";
+  }
+
+  bool is_err = false;
+  string err_descr;
+  double batch_start = bil_wtime();
+  #pragma omp parallel for schedule(dynamic) num_threads(n_threads > 0 ? n_threads : 1)
+  for (int t = 0; t < static_cast<int>(tasks.size()); t++) {
+    bil_task_info &task = tasks[t];
+    DE_optim<FCD> *optim = optims[task.optim_n];
+#ifdef _OPENMP
+    task.thread = omp_get_thread_num();
+#endif
+    task.start = bil_wtime() - batch_start;
+    try {
+      optim->optimize_member_copy(task.ens);
+      task.model_eval = static_cast<unsigned>(optim->ensemble_resul[task.ens][optim->par_count + 1]);
+      task.is_done = true;
+    }
+    catch (bil_err &error) { //exceptions cannot leave parallel region
+      #pragma omp critical(bil_eval_err)
+      {
+        is_err = true;
+        err_descr = error.descr;
+      }
+    }
+    task.time = bil_wtime() - batch_start - task.start;
+    if (!log_file.empty() && task.is_done) {
+      #pragma omp critical(bil_batch_log)
+      {
+        log_stream << task.optim_n + 1 << "\t" << task.ens + 1 << "\t" << task.thread << "\t" << task.start << "\t" << task.time << "\t" << task.model_eval << endl;
+      }
+    }
+  }
+  if (is_err)
+    throw bil_err(err_descr);
+
+  for (unsigned o = 0; o < optims.size(); o++)
+    optims[o]->finish_members();
+  return tasks;
+}
+
 /**
  * - gets DE optimization settings
  * @return settings as map with name of settings and value as a string
@@ -813,6 +1551,41 @@ map<string, string> DE_optim<FCD>::get_settings()
   os.str("");
   os << seed;
   sett.insert(pair<string, string>("seed", os.str()));
+  os.str("");
+  os << parallel_comp;
+  sett.insert(pair<string, string>("parallel_comp", os.str()));
+  os.str("");
+  os << generational;
+  sett.insert(pair<string, string>("generational", os.str()));
+  sett.insert(pair<string, string>("checkpoint_file", checkpoint_file));
+  os.str("");
+  os << stop_shuffles;
+  sett.insert(pair<string, string>("stop_shuffles", os.str()));
+  os.str("");
+  os << stop_improv;
+  sett.insert(pair<string, string>("stop_improv", os.str()));
+  os.str("");
+  os << stop_spread;
+  sett.insert(pair<string, string>("stop_spread", os.str()));
+  os.str("");
+  os << max_eval;
+  sett.insert(pair<string, string>("max_eval", os.str()));
+  os.str("");
+  os << resume;
+  sett.insert(pair<string, string>("resume", os.str()));
+  sett.insert(pair<string, string>("bound_handling", bound_names[bound_handling]));
+  os.str("");
+  os << use_surrogate;
+  sett.insert(pair<string, string>("surrogate", os.str()));
+  os.str("");
+  os << surrogate_factor;
+  sett.insert(pair<string, string>("surrogate_factor", os.str()));
+  os.str("");
+  os << surrogate_size;
+  sett.insert(pair<string, string>("surrogate_size", os.str()));
+  os.str("");
+  os << (offspring_count == 0 ? 0 : static_cast<double>(skipped_count) / offspring_count);
+  sett.insert(pair<string, string>("surrogate_skipped", os.str()));
 
   return sett;
 }
@@ -855,7 +1628,7 @@ void DE_optim<FCD>::write(string file_name)
   out_stream << "OK\t";
   for (ct = 0; ct < this->crit_count; ct++)
     out_stream << this->crit_names[ct] << "\t";
-  out_stream << "iter\n";
+  out_stream << "iter\tstop\n";
 
   for (unsigned ens = 0; ens < ens_count; ens++) {
     out_stream << ens + 1 << "\t";
@@ -876,7 +1649,8 @@ void DE_optim<FCD>::write(string file_name)
       else
         out_stream << static_cast<double>(this->fcd->calc_crit(ct, this->weight_BF, this->use_weights)) << "\t";
     }
-    out_stream << ensemble_resul[ens][n_parof] << "\n"; //number of model_eval
+    out_stream << ensemble_resul[ens][n_parof] << "\t"; //number of model_eval
+    out_stream << stop_names[static_cast<unsigned>(ensemble_resul[ens][n_parof + 1])] << "\n";
   }
   out_stream.close();
 }
@@ -0,0 +1,98 @@
+#ifndef BIL_OPTIM_ENS_H_INCLUDED
+#define BIL_OPTIM_ENS_H_INCLUDED
+
+using namespace std;
+
+/**
+ * - default ensemble simulation settings (no output variables, quantiles 0, 0.05, 0.5, 0.95 and 1)
+ */
+template<class FCD>
+ens_simulation<FCD>::ens_simulation()
+{
+  fcd = 0;
+  const double default_probs[] = { 0, 0.05, 0.5, 0.95, 1 };
+  probs.assign(default_probs, default_probs + 5);
+  init_GS = 50;
+  n_threads = 1;
+}
+
+/**
+ * - functoid setter
+ * @param functoid functoid to be set
+ */
+template<class FCD>
+void ens_simulation<FCD>::set_functoid(FCD functoid)
+{
+  fcd = functoid;
+}
+
+/**
+ * - sets ensemble simulation options
+ * @param out_vars output variables to be summarized
+ * @param probs probabilities of quantiles (0 for minimum, 1 for maximum)
+ * @param init_GS initial groundwater storage
+ * @param n_threads number of threads
+ */
+template<class FCD>
+void ens_simulation<FCD>::set(const vector<unsigned> &out_vars, const vector<double> &probs, long double init_GS, unsigned n_threads)
+{
+  if (out_vars.empty())
+    throw bil_err("No output variables to be simulated.");
+  if (probs.empty())
+    throw bil_err("No probabilities of quantiles.");
+  for (unsigned pr = 0; pr < probs.size(); pr++) {
+    if (!(probs[pr] >= 0 && probs[pr] <= 1))
+      throw bil_err("Probabilities of quantiles should be between 0 and 1.");
+  }
+  if (init_GS < 0)
+    throw bil_err("Initial groundwater storage must be positive.");
+  if (n_threads == 0)
+    throw bil_err("Number of threads cannot be zero.");
+
+  this->out_vars = out_vars;
+  this->probs = probs;
+  this->init_GS = init_GS;
+  this->n_threads = n_threads;
+}
+
+/**
+ * - runs all members and adds their outputs to streaming estimates of quantiles for each time step
+ * - members are run in chunks, concurrently by worker functoids with more threads, and added in order of members,
+ *   so results do not depend on number of threads and only outputs of one chunk are kept
+ * - parameters of the model are not changed
+ * @param models parameters of members - matrix(par_count, ens_count)
+ * @param ens_count number of members
+ */
+template<class FCD>
+void ens_simulation<FCD>::simulate(double **models, unsigned ens_count)
+{
+  if (!fcd)
+    throw bil_err("Ensemble simulation has no model.");
+  if (ens_count == 0)
+    throw bil_err("Ensemble has no members.");
+
+  unsigned time_steps = fcd->get_time_steps(), out_count = out_vars.size(), out;
+  bands.assign(out_count, bil_quantile_bands());
+  for (out = 0; out < out_count; out++)
+    bands[out].init(time_steps, probs);
+
+  bil_workers<FCD> workers;
+  workers.create(fcd, n_threads);
+  unsigned chunk_size = 4 * (workers.empty() ? 1 : workers.size());
+  vector<vector<bil_real> > outputs(chunk_size * out_count, vector<bil_real>(time_steps));
+  vector<bil_real*> out_cols(chunk_size * out_count);
+  for (unsigned col = 0; col < out_cols.size(); col++)
+    out_cols[col] = &outputs[col][0];
+
+  for (unsigned done = 0; done < ens_count; done += chunk_size) {
+    unsigned chunk_count = std::min(chunk_size, ens_count - done);
+    bil_vars_task<FCD> task = { init_GS, models, done, &out_vars, &out_cols[0] };
+    workers.run(task, chunk_count);
+    for (unsigned mb = 0; mb < chunk_count; mb++) {
+      for (out = 0; out < out_count; out++)
+        bands[out].add(out_cols[mb * out_count + out]);
+    }
+  }
+}
+
+#endif // BIL_OPTIM_ENS_H_INCLUDED
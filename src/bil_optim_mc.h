@@ -0,0 +1,237 @@
+#ifndef BIL_OPTIM_MC_H_INCLUDED
+#define BIL_OPTIM_MC_H_INCLUDED
+
+using namespace std;
+
+/**
+ * - default Monte Carlo settings (10000 samples, all of them behavioral, quantiles 0.05, 0.5 and 0.95)
+ */
+template<class FCD>
+mc_analysis<FCD>::mc_analysis()
+{
+  fcd = 0;
+  sample_count = 10000;
+  seed = 0;
+  use_threshold = false;
+  threshold = 0;
+  probs.push_back(0.05);
+  probs.push_back(0.5);
+  probs.push_back(0.95);
+  crit_type = optimizer_gen<FCD>::MSE;
+  weight_BF = 0;
+  use_weights = false;
+  init_GS = 50;
+  n_threads = 1;
+  par_count = 0;
+  behav_count = 0;
+}
+
+/**
+ * - functoid setter
+ * @param functoid functoid to be set
+ */
+template<class FCD>
+void mc_analysis<FCD>::set_functoid(FCD functoid)
+{
+  fcd = functoid;
+}
+
+/**
+ * - sets Monte Carlo analysis options
+ * @param sample_count number of parameter sets sampled uniformly within limits
+ * @param seed seed to initialize random number generator, if seed <= 0, generator is initialized by time
+ * @param use_threshold whether only samples with criterion better than threshold are behavioral (otherwise all samples are)
+ * @param threshold threshold of criterion (for NS and LNNS the efficiency, samples with higher are behavioral, for other criteria samples with lower are)
+ * @param probs probabilities of quantiles of modelled runoff of behavioral samples, empty for no series
+ * @param out_file name of file where parameters and criterion of each sample are written, empty for no file
+ * @param crit_type optimization criterion type
+ * @param weight_BF criterion weight for baseflow
+ * @param use_weights whether to use weights for time steps of runoff
+ * @param init_GS initial groundwater storage
+ * @param n_threads number of threads
+ */
+template<class FCD>
+void mc_analysis<FCD>::set(unsigned long sample_count, int seed, bool use_threshold, double threshold, const vector<double> &probs, string out_file, unsigned crit_type, double weight_BF, bool use_weights, long double init_GS, unsigned n_threads)
+{
+  if (sample_count == 0)
+    throw bil_err("Number of samples cannot be zero.");
+  for (unsigned pr = 0; pr < probs.size(); pr++) {
+    if (!(probs[pr] >= 0 && probs[pr] <= 1))
+      throw bil_err("Probabilities of quantiles should be between 0 and 1.");
+  }
+  if (weight_BF < 0 || weight_BF > 1)
+    throw bil_err("Weight for baseflow should be between 0 and 1.");
+  if (init_GS < 0)
+    throw bil_err("Initial groundwater storage must be positive.");
+  if (n_threads == 0)
+    throw bil_err("Number of threads cannot be zero.");
+
+  this->sample_count = sample_count;
+  this->seed = seed;
+  this->use_threshold = use_threshold;
+  this->threshold = threshold;
+  this->probs = probs;
+  this->out_file = out_file;
+  this->crit_type = crit_type;
+  this->weight_BF = weight_BF;
+  this->use_weights = use_weights;
+  this->init_GS = init_GS;
+  this->n_threads = n_threads;
+}
+
+/**
+ * - compares criterion values on the scale of results (efficiency for NS and LNNS)
+ * @param crit criterion value
+ * @param than criterion value to be compared with
+ * @return whether crit is better (not equal)
+ */
+template<class FCD>
+bool mc_analysis<FCD>::is_better(double crit, double than)
+{
+  if (crit_type == optimizer_gen<FCD>::NS || crit_type == optimizer_gen<FCD>::LNNS)
+    return crit > than;
+  else
+    return crit < than;
+}
+
+/**
+ * - evaluates criterion of a chunk of samples in batches (run in lockstep if the functoid supports it) and stores their modelled runoff in the same run
+ * - with more threads, batches are evaluated concurrently by worker functoids, results do not depend on number of threads
+ * - samples which cannot be evaluated (e.g. infinite criterion) get undefined criterion
+ * @param models parameters of samples and their criterion in the last row - matrix(par_count+1, chunk_count)
+ * @param chunk_count number of samples in the chunk
+ * @param RM_cols columns for modelled runoff of samples, null if not needed
+ */
+template<class FCD>
+void mc_analysis<FCD>::eval_chunk(double **models, unsigned chunk_count, bil_real **RM_cols)
+{
+  bil_crit_RM_task<FCD> task = { init_GS, crit_type, weight_BF, use_weights, models, par_count, RM_cols };
+  workers.run(task, chunk_count);
+}
+
+/**
+ * - Monte Carlo analysis: samples parameter sets uniformly within limits and evaluates them in chunks,
+ *   parameters and criterion of each sample are written to output file as soon as its chunk is evaluated
+ * - samples which cannot be evaluated are not behavioral and their criterion is written as NA
+ * - modelled runoff of behavioral samples is added to streaming estimates of quantiles for each time step in order of samples,
+ *   so results do not depend on number of threads and memory is limited by the chunk
+ * - parameters of the model are not changed
+ */
+template<class FCD>
+void mc_analysis<FCD>::analyze()
+{
+  if (!fcd)
+    throw bil_err("Monte Carlo analysis has no model.");
+  par_count = fcd->get_param_count();
+  if (par_count == 0)
+    throw bil_err("Number of parameters cannot be zero.");
+
+  if (use_weights)
+    fcd->calc_sum_weights();
+  fcd->clear_obs_stats(); //statistics of observed data calculated again
+  fcd->check_vars_for_optim(weight_BF > NUMERIC_EPS);
+
+  unsigned par, smp;
+  vector<double> lower(par_count), upper(par_count), curr(par_count);
+  for (par = 0; par < par_count; par++) {
+    lower[par] = fcd->get_param(par, optimizer_gen<FCD>::LOWER);
+    upper[par] = fcd->get_param(par, optimizer_gen<FCD>::UPPER);
+    curr[par] = fcd->get_param(par, optimizer_gen<FCD>::CURR);
+  }
+
+  ofstream out_stream;
+  if (!out_file.empty()) {
+    out_stream.open(out_file.c_str());
+    if (!out_stream)
+      throw bil_err("The output file '" + out_file + "' cannot be used.");
+    out_stream << "sample\t";
+    for (par = 0; par < par_count; par++)
+      out_stream << fcd->get_param_name(par) << "\t";
+    out_stream << "OK\tbehavioral\n";
+    out_stream << setprecision(15);
+  }
+
+  unsigned time_steps = fcd->get_time_steps();
+  bands.init(time_steps, probs);
+  behav_count = 0;
+  best_model.assign(par_count + 1, numeric_limits<double>::quiet_NaN());
+  rng.seed(seed > 0 ? seed : static_cast<uint32_t>(time(0)));
+
+  fcd->prepare_obs_stats(crit_type, weight_BF, use_weights); //workers only read the model
+  workers.create(fcd, n_threads);
+  unsigned chunk_size = 4 * fcd->get_batch_size() * (workers.empty() ? 1 : workers.size());
+  vector<vector<double> > models(par_count + 1, vector<double>(chunk_size));
+  vector<double*> model_rows(par_count + 1);
+  for (par = 0; par <= par_count; par++)
+    model_rows[par] = &models[par][0];
+  vector<vector<bil_real> > series;
+  vector<bil_real*> series_cols;
+  if (!probs.empty()) {
+    series.assign(chunk_size, vector<bil_real>(time_steps));
+    for (smp = 0; smp < chunk_size; smp++)
+      series_cols.push_back(&series[smp][0]);
+  }
+  vector<unsigned> behav;
+  behav.reserve(chunk_size);
+  bool is_NS = crit_type == optimizer_gen<FCD>::NS || crit_type == optimizer_gen<FCD>::LNNS;
+
+  try {
+    for (unsigned long done = 0; done < sample_count; done += chunk_size) {
+      unsigned chunk_count = static_cast<unsigned>(std::min(static_cast<unsigned long>(chunk_size), sample_count - done));
+      for (smp = 0; smp < chunk_count; smp++) {
+        for (par = 0; par < par_count; par++)
+          models[par][smp] = lower[par] + rng.uniform() * (upper[par] - lower[par]);
+      }
+      eval_chunk(&model_rows[0], chunk_count, probs.empty() ? 0 : &series_cols[0]);
+
+      behav.clear();
+      for (smp = 0; smp < chunk_count; smp++) {
+        double &crit = models[par_count][smp];
+        if (is_NS)
+          crit = 1 - crit;
+        if (!std::isfinite(crit))
+          continue;
+        if (!use_threshold || !is_better(threshold, crit))
+          behav.push_back(smp);
+        if (std::isnan(best_model[par_count]) || is_better(crit, best_model[par_count])) {
+          for (par = 0; par <= par_count; par++)
+            best_model[par] = models[par][smp];
+        }
+      }
+      behav_count += behav.size();
+
+      if (!probs.empty()) {
+        for (unsigned bh = 0; bh < behav.size(); bh++)
+          bands.add(series_cols[behav[bh]]);
+      }
+
+      if (out_stream.is_open()) {
+        unsigned bh = 0;
+        for (smp = 0; smp < chunk_count; smp++) {
+          bool is_behav = bh < behav.size() && behav[bh] == smp;
+          if (is_behav)
+            bh++;
+          out_stream << done + smp + 1 << "\t";
+          for (par = 0; par < par_count; par++)
+            out_stream << models[par][smp] << "\t";
+          if (std::isfinite(models[par_count][smp]))
+            out_stream << models[par_count][smp] << "\t";
+          else
+            out_stream << "NA\t";
+          out_stream << is_behav << "\n";
+        }
+      }
+    }
+  }
+  catch (bil_err &) {
+    workers.clear();
+    for (par = 0; par < par_count; par++)
+      fcd->set_param(par, optimizer_gen<FCD>::CURR, curr[par]);
+    throw;
+  }
+  workers.clear();
+  for (par = 0; par < par_count; par++) //functoid without batch support changes parameters
+    fcd->set_param(par, optimizer_gen<FCD>::CURR, curr[par]);
+}
+
+#endif // BIL_OPTIM_MC_H_INCLUDED
@@ -0,0 +1,520 @@
+#ifndef BIL_OPTIM_MO_H_INCLUDED
+#define BIL_OPTIM_MO_H_INCLUDED
+
+using namespace std;
+
+/**
+ * - default empty MO optim settings
+ */
+template<class FCD>
+MO_optim<FCD>::MO_optim()
+{
+  popul_size = n_gen = 0;
+  cross = mutat_f = 0.0;
+  seed = 0;
+  model_eval = 0;
+  front_count = best_front = 0;
+  front_resul = 0;
+}
+
+/**
+ * - copy constructor
+ */
+template<class FCD>
+MO_optim<FCD>::MO_optim(const MO_optim<FCD>& orig) : optimizer_gen<FCD>(orig)
+{
+  popul_size = orig.popul_size;
+  n_gen = orig.n_gen;
+  cross = orig.cross;
+  mutat_f = orig.mutat_f;
+  seed = orig.seed;
+  rng = orig.rng;
+  model_eval = orig.model_eval;
+  front_count = orig.front_count;
+  best_front = orig.best_front;
+
+  if (front_count != 0) {
+    front_resul = new double*[front_count];
+    for (unsigned fr = 0; fr < front_count; fr++) {
+      front_resul[fr] = new double[this->par_count + 3];
+      for (unsigned par = 0; par < this->par_count + 3; par++)
+        front_resul[fr][par] = orig.front_resul[fr][par];
+    }
+  }
+  else
+    front_resul = 0;
+}
+
+/**
+ * - "virtual copy constructor"
+ */
+template<class FCD>
+MO_optim<FCD>* MO_optim<FCD>::clone() const
+{
+  return new MO_optim(*this);
+}
+
+/**
+ * - assignment operator
+ */
+template<class FCD>
+optimizer_gen<FCD>& MO_optim<FCD>::operator=(const optimizer_gen<FCD>& orig)
+{
+  if (this != &orig) {
+    delete_front();
+    optimizer_gen<FCD>::operator=(orig); //general part
+
+    //specific part
+    const MO_optim& tmp_orig = dynamic_cast<const MO_optim&>(orig);
+
+    popul_size = tmp_orig.popul_size;
+    n_gen = tmp_orig.n_gen;
+    cross = tmp_orig.cross;
+    mutat_f = tmp_orig.mutat_f;
+    seed = tmp_orig.seed;
+    rng = tmp_orig.rng;
+    model_eval = tmp_orig.model_eval;
+    front_count = tmp_orig.front_count;
+    best_front = tmp_orig.best_front;
+
+    if (front_count != 0) {
+      front_resul = new double*[front_count];
+      for (unsigned fr = 0; fr < front_count; fr++) {
+        front_resul[fr] = new double[this->par_count + 3];
+        for (unsigned par = 0; par < this->par_count + 3; par++)
+          front_resul[fr][par] = tmp_orig.front_resul[fr][par];
+      }
+    }
+  }
+  return *this;
+}
+
+template<class FCD>
+MO_optim<FCD>::~MO_optim()
+{
+  delete_front();
+}
+
+/**
+ * - deletes Pareto front of previous optimization
+ */
+template<class FCD>
+void MO_optim<FCD>::delete_front()
+{
+  for (unsigned fr = 0; fr < front_count; fr++)
+    delete[] front_resul[fr];
+  delete[] front_resul;
+  front_resul = 0;
+  front_count = best_front = 0;
+}
+
+/**
+ * - changes values of settings for MO optimization
+ * @param crit_type optimization criterion used for both runoff and baseflow
+ * @param popul_size number of parameter sets in population
+ * @param n_gen number of generations
+ * @param cross crossover parameter
+ * @param mutat_f mutation parameter
+ * @param seed seed to initialize random number generator, if seed <= 0, generator is initialized by time
+ * @param weight_BF weight of baseflow to choose parameters from Pareto front assigned to the model
+ * @param use_weights whether to use weights for time steps of runoff
+ * @param init_GS initial groundwater storage
+ */
+template<class FCD>
+void MO_optim<FCD>::set(unsigned crit_type, unsigned popul_size, unsigned n_gen, double cross, double mutat_f, int seed, double weight_BF, bool use_weights, long double init_GS)
+{
+  this->optimizer_gen<FCD>::set(crit_type, weight_BF, use_weights, init_GS);
+
+  if (popul_size < 5)
+    throw bil_err("Population size for multi-objective optimization must be at least 5.");
+  if (cross < 0 || cross > 1)
+    throw bil_err("Crossover parameter should be between 0 and 1.");
+
+  this->popul_size = popul_size;
+  this->n_gen = n_gen;
+  this->cross = cross;
+  this->mutat_f = mutat_f;
+  this->seed = seed;
+}
+
+/**
+ * - sets parameters of each model, runs it and stores criteria of runoff and baseflow
+ * - models are evaluated in batches concurrently by worker functoids if they were created, otherwise by functoid of the model,
+ *   so results do not depend on number of threads
+ * - models of a failed batch are evaluated one by one, those which fail (e.g. infinite criterion) or have undefined criterion get the worst possible values
+ * @param models parameters of models and their criteria in the last two rows - matrix(par_count+2, number of models)
+ * @param model_first index of the first model to be evaluated
+ * @param model_count number of models to be evaluated
+ */
+template<class FCD>
+void MO_optim<FCD>::eval_objs(double **models, unsigned model_first, unsigned model_count)
+{
+  bil_objs_task<FCD> task = { this->init_GS, this->crit_type, this->use_weights, models, this->par_count, model_first };
+  if (this->workers.empty())
+    task(this->fcd, 0, model_count);
+  else
+    this->workers.run(task, model_count);
+  for (unsigned ob = this->par_count; ob < this->par_count + obj_count; ob++) {
+    for (unsigned sp = model_first; sp < model_first + model_count; sp++) {
+      if (!(fabs(models[ob][sp]) <= numeric_limits<double>::max()))
+        models[ob][sp] = numeric_limits<double>::max();
+    }
+  }
+}
+
+/**
+ * - creates offsprings of parents (the first popul_size models) by DE/rand/1/bin operators and stores them after parents
+ * - values outside parameter limits are replaced by values of parent
+ * @param popul population - matrix(par_count+2, 2*popul_size)
+ */
+template<class FCD>
+void MO_optim<FCD>::make_offsprings(double **popul)
+{
+  unsigned sp_rand[3];
+  for (unsigned sp = 0; sp < popul_size; sp++) {
+    rng.draw_distinct(sp_rand, 3, popul_size, sp);
+    unsigned par_rand = rng.below(this->par_count); //at least this parameter is taken from mutant
+    for (unsigned par = 0; par < this->par_count; par++) {
+      double value = popul[par][sp];
+      if (rng.uniform() < cross || par == par_rand) {
+        double mutant = popul[par][sp_rand[0]] + mutat_f * (popul[par][sp_rand[1]] - popul[par][sp_rand[2]]);
+        if (mutant >= this->dm[par] && mutant <= this->hm[par])
+          value = mutant;
+      }
+      popul[par][popul_size + sp] = value;
+    }
+  }
+}
+
+/**
+ * - checks Pareto dominance of two models, both criteria are minimized
+ * @param popul population
+ * @param first index of the first model
+ * @param second index of the second model
+ * @return whether the first model is not worse in both criteria and better in at least one
+ */
+template<class FCD>
+bool MO_optim<FCD>::dominates(double **popul, unsigned first, unsigned second)
+{
+  bool is_better = false;
+  for (unsigned ob = this->par_count; ob < this->par_count + obj_count; ob++) {
+    if (popul[ob][first] > popul[ob][second])
+      return false;
+    if (popul[ob][first] < popul[ob][second])
+      is_better = true;
+  }
+  return is_better;
+}
+
+/**
+ * - fast non-dominated sorting after Deb et al. (2002), rank zero is the Pareto front
+ * @param popul population
+ * @param count number of models to be sorted (from the first one)
+ * @param rank ranks of models
+ */
+template<class FCD>
+void MO_optim<FCD>::sort_fronts(double **popul, unsigned count, vector<unsigned> &rank)
+{
+  vector<unsigned> dominated_by(count, 0); //number of models dominating the model
+  vector<vector<unsigned> > dominating(count); //models dominated by the model
+  unsigned sp, sp2;
+  for (sp = 0; sp < count; sp++) {
+    for (sp2 = sp + 1; sp2 < count; sp2++) {
+      if (dominates(popul, sp, sp2)) {
+        dominating[sp].push_back(sp2);
+        dominated_by[sp2]++;
+      }
+      else if (dominates(popul, sp2, sp)) {
+        dominating[sp2].push_back(sp);
+        dominated_by[sp]++;
+      }
+    }
+  }
+  rank.assign(count, 0);
+  vector<unsigned> front, next_front;
+  for (sp = 0; sp < count; sp++) {
+    if (dominated_by[sp] == 0)
+      front.push_back(sp);
+  }
+  for (unsigned rk = 0; !front.empty(); rk++) {
+    next_front.clear();
+    for (unsigned fr = 0; fr < front.size(); fr++) {
+      rank[front[fr]] = rk;
+      for (unsigned d = 0; d < dominating[front[fr]].size(); d++) {
+        sp2 = dominating[front[fr]][d];
+        if (--dominated_by[sp2] == 0)
+          next_front.push_back(sp2);
+      }
+    }
+    front.swap(next_front);
+  }
+}
+
+/**
+ * - calculates crowding distance of models in one front, boundary models have infinite distance
+ * @param popul population
+ * @param members indexes of models in the front
+ * @param crowding crowding distances of models in order of members
+ */
+template<class FCD>
+void MO_optim<FCD>::calc_crowding(double **popul, const vector<unsigned> &members, vector<double> &crowding)
+{
+  unsigned count = members.size();
+  if (count < 3) {
+    crowding.assign(count, numeric_limits<double>::infinity());
+    return;
+  }
+  crowding.assign(count, 0.0);
+  vector<pair<double, unsigned> > order(count);
+  for (unsigned ob = this->par_count; ob < this->par_count + obj_count; ob++) {
+    for (unsigned m = 0; m < count; m++)
+      order[m] = make_pair(popul[ob][members[m]], m); //ties ordered by position to be deterministic
+    sort(order.begin(), order.end());
+    crowding[order[0].second] = crowding[order[count - 1].second] = numeric_limits<double>::infinity();
+    double range = order[count - 1].first - order[0].first;
+    if (range <= 0)
+      continue;
+    for (unsigned m = 1; m < count - 1; m++)
+      crowding[order[m].second] += (order[m + 1].first - order[m - 1].first) / range;
+  }
+}
+
+/**
+ * - selects new parents from parents and offsprings by rank and crowding distance in the last front that does not fit whole
+ * @param popul population - matrix(par_count+2, 2*popul_size), new parents are stored as the first popul_size models
+ */
+template<class FCD>
+void MO_optim<FCD>::select_popul(double **popul)
+{
+  unsigned total = 2 * popul_size, sp, par;
+  vector<unsigned> rank;
+  sort_fronts(popul, total, rank);
+
+  vector<unsigned> selected, front;
+  vector<double> crowding;
+  for (unsigned rk = 0; selected.size() < popul_size; rk++) {
+    front.clear();
+    for (sp = 0; sp < total; sp++) {
+      if (rank[sp] == rk)
+        front.push_back(sp);
+    }
+    if (selected.size() + front.size() <= popul_size)
+      selected.insert(selected.end(), front.begin(), front.end());
+    else {
+      calc_crowding(popul, front, crowding);
+      vector<pair<double, unsigned> > order(front.size());
+      for (unsigned m = 0; m < front.size(); m++)
+        order[m] = make_pair(-crowding[m], front[m]); //less crowded models first
+      sort(order.begin(), order.end());
+      for (unsigned m = 0; selected.size() < popul_size; m++)
+        selected.push_back(order[m].second);
+    }
+  }
+
+  vector<double> tmp_popul(popul_size);
+  for (par = 0; par < this->par_count + obj_count; par++) {
+    for (sp = 0; sp < popul_size; sp++)
+      tmp_popul[sp] = popul[par][selected[sp]];
+    for (sp = 0; sp < popul_size; sp++)
+      popul[par][sp] = tmp_popul[sp];
+  }
+}
+
+/**
+ * - stores non-dominated models of final population ordered by criterion of runoff
+ * - the model gets parameters of front member with the best criterion weighted by weight_BF and its criterion is calculated
+ * @param popul final population
+ */
+template<class FCD>
+void MO_optim<FCD>::finish_front(double **popul)
+{
+  unsigned par, sp, fr;
+  vector<unsigned> rank;
+  sort_fronts(popul, popul_size, rank);
+  vector<pair<double, unsigned> > order;
+  for (sp = 0; sp < popul_size; sp++) {
+    if (rank[sp] == 0)
+      order.push_back(make_pair(popul[this->par_count][sp], sp));
+  }
+  sort(order.begin(), order.end());
+
+  delete_front();
+  front_count = order.size();
+  front_resul = new double*[front_count];
+  bool is_NS = this->crit_type == this->NS || this->crit_type == this->LNNS;
+  double best_crit = numeric_limits<double>::max();
+  for (fr = 0; fr < front_count; fr++) {
+    sp = order[fr].second;
+    front_resul[fr] = new double[this->par_count + 3];
+    for (par = 0; par < this->par_count; par++)
+      front_resul[fr][par] = popul[par][sp];
+    for (par = this->par_count; par < this->par_count + obj_count; par++)
+      front_resul[fr][par] = is_NS ? 1 - popul[par][sp] : popul[par][sp];
+    front_resul[fr][this->par_count + 2] = static_cast<double>(model_eval);
+
+    double weighted = (1 - this->weight_BF) * popul[this->par_count][sp] + this->weight_BF * popul[this->par_count + 1][sp];
+    if (weighted < best_crit) {
+      best_crit = weighted;
+      best_front = fr;
+    }
+  }
+
+  for (par = 0; par < this->par_count; par++)
+    this->fcd->set_param(par, this->CURR, front_resul[best_front][par]);
+  this->fcd->run(this->init_GS);
+  this->ok = this->fcd->calc_crit(this->crit_type, this->weight_BF, this->use_weights);
+  if (is_NS)
+    this->ok = 1 - this->ok;
+}
+
+/**
+ * - multi-objective optimization of criteria of runoff and baseflow by NSGA-II (Deb et al., 2002) with offsprings created by differential evolution
+ * - both criteria are calculated from one run of each model, offsprings of a generation are evaluated together (in parallel if more threads are set)
+ * - random numbers are drawn only when creating offsprings, so results do not depend on number of threads
+ * - result is the Pareto front of the final population, the model gets parameters of the front member with the best criterion weighted by weight_BF
+ */
+template<class FCD>
+void MO_optim<FCD>::optimize()
+{
+  if (popul_size == 0)
+    throw bil_err("MO optimization is not set and cannot be used.");
+  this->optimizer_gen<FCD>::init();
+  this->fcd->check_vars_for_optim(true); //baseflow is always needed
+
+  unsigned n_rows = this->par_count + obj_count, par, sp;
+  vector<double> popul_data(n_rows * 2 * popul_size, 0.0);
+  vector<double*> popul(n_rows);
+  for (par = 0; par < n_rows; par++)
+    popul[par] = &popul_data[par * 2 * popul_size];
+
+  rng.seed(seed > 0 ? seed : static_cast<uint32_t>(time(0)));
+  vector<unsigned> perm(popul_size);
+  for (par = 0; par < this->par_count; par++) { //Latin hypercube sampling as for DE
+    for (sp = 0; sp < popul_size; sp++)
+      perm[sp] = sp + 1;
+    for (sp = popul_size - 1; sp > 0; sp--)
+      swap(perm[sp], perm[rng.below(sp + 1)]);
+    for (sp = 0; sp < popul_size; sp++)
+      popul[par][sp] = ((this->hm[par] - this->dm[par]) * (static_cast<double>(perm[sp]) - rng.uniform()) / (static_cast<double>(popul_size))) + this->dm[par];
+  }
+
+  this->fcd->prepare_obs_stats(this->crit_type, 1, this->use_weights); //statistics of baseflow for any weight_BF
+  this->new_workers(this->crit_type);
+  eval_objs(&popul[0], 0, popul_size);
+  model_eval = popul_size;
+  for (unsigned gen = 0; gen < n_gen; gen++) {
+    make_offsprings(&popul[0]);
+    eval_objs(&popul[0], popul_size, popul_size);
+    model_eval += popul_size;
+    select_popul(&popul[0]);
+  }
+  this->delete_workers();
+  finish_front(&popul[0]);
+}
+
+/**
+ * - gets MO optimization settings
+ * @return settings as map with name of settings and value as a string
+ */
+template<class FCD>
+map<string, string> MO_optim<FCD>::get_settings()
+{
+  ostringstream os;
+
+  map<string, string> sett;
+  sett = this->optimizer_gen<FCD>::get_settings();
+
+  sett.insert(pair<string, string>("crit", this->crit_names[this->crit_type]));
+  os << setprecision(15) << popul_size;
+  sett.insert(pair<string, string>("popul_size", os.str()));
+  os.str("");
+  os << n_gen;
+  sett.insert(pair<string, string>("n_gen", os.str()));
+  os.str("");
+  os << cross;
+  sett.insert(pair<string, string>("cross", os.str()));
+  os.str("");
+  os << mutat_f;
+  sett.insert(pair<string, string>("mutat_f", os.str()));
+  os.str("");
+  os << seed;
+  sett.insert(pair<string, string>("seed", os.str()));
+  os.str("");
+  os << front_count;
+  sett.insert(pair<string, string>("front_count", os.str()));
+  os.str("");
+  os << model_eval;
+  sett.insert(pair<string, string>("model_eval", os.str()));
+
+  return sett;
+}
+
+/**
+ * - gets number of parameter sets in Pareto front
+ * @return size of Pareto front
+ */
+template<class FCD>
+unsigned MO_optim<FCD>::get_ens_count()
+{
+  return front_count;
+}
+
+/**
+ * - gets Pareto front
+ * @return pointer to Pareto front array
+ */
+template<class FCD>
+double** MO_optim<FCD>::get_ens_resul()
+{
+  return front_resul;
+}
+
+/**
+ * - writes parameters, criteria of runoff and baseflow and other criteria for each member of Pareto front
+ * - the model gets parameters of the compromise member again
+ * @param file_name name of output file
+ */
+template<class FCD>
+void MO_optim<FCD>::write(string file_name)
+{
+  ofstream out_stream(file_name.c_str());
+  if (!out_stream) {
+    throw bil_err("The output file '" + file_name + "' cannot be used.");
+  }
+  unsigned par, ct, fr;
+  out_stream << "member\t";
+  for (par = 0; par < this->par_count; par++)
+    out_stream << this->fcd->get_param_name(par) << "\t";
+  out_stream << "OK_R\tOK_B\t";
+  for (ct = 0; ct < this->crit_count; ct++)
+    out_stream << this->crit_names[ct] << "\t";
+  out_stream << "iter\n";
+
+  for (fr = 0; fr < front_count; fr++) {
+    out_stream << fr + 1 << "\t";
+    for (par = 0; par < this->par_count; par++) {
+      out_stream << front_resul[fr][par] << "\t";
+      this->fcd->set_param(par, this->CURR, front_resul[fr][par]);
+    }
+    out_stream << front_resul[fr][this->par_count] << "\t" << front_resul[fr][this->par_count + 1] << "\t";
+
+    //calculate other criteria than used for calibration
+    this->fcd->run(this->init_GS);
+    for (ct = this->MSE; ct <= this->MAPE; ct++) {
+      if (ct == this->NS || ct == this->LNNS)
+        out_stream << static_cast<double>(1 - this->fcd->calc_crit(ct, this->weight_BF, this->use_weights)) << "\t";
+      else
+        out_stream << static_cast<double>(this->fcd->calc_crit(ct, this->weight_BF, this->use_weights)) << "\t";
+    }
+    out_stream << front_resul[fr][this->par_count + 2] << "\n"; //number of model_eval
+  }
+  out_stream.close();
+
+  if (front_count > 0) {
+    for (par = 0; par < this->par_count; par++)
+      this->fcd->set_param(par, this->CURR, front_resul[best_front][par]);
+    this->fcd->run(this->init_GS);
+  }
+}
+
+#endif // BIL_OPTIM_MO_H_INCLUDED
@@ -0,0 +1,304 @@
+#ifndef BIL_OPTIM_SENS_H_INCLUDED
+#define BIL_OPTIM_SENS_H_INCLUDED
+
+using namespace std;
+
+/**
+ * - default sensitivity settings (Sobol method with 1000 base samples)
+ */
+template<class FCD>
+sens_analysis<FCD>::sens_analysis()
+{
+  fcd = 0;
+  method = SOBOL;
+  sample_count = 1000;
+  levels = 4;
+  seed = 0;
+  crit_type = optimizer_gen<FCD>::MSE;
+  weight_BF = 0;
+  use_weights = false;
+  init_GS = 50;
+  n_threads = 1;
+  par_count = eval_count = 0;
+}
+
+/**
+ * - functoid setter
+ * @param functoid functoid to be set
+ */
+template<class FCD>
+void sens_analysis<FCD>::set_functoid(FCD functoid)
+{
+  fcd = functoid;
+}
+
+/**
+ * - sets sensitivity analysis options
+ * @param method sensitivity method
+ * @param sample_count number of base samples for Sobol method (model is evaluated sample_count * (par_count + 2) times)
+ *   or number of trajectories for Morris method (sample_count * (par_count + 1) evaluations)
+ * @param levels number of levels of Morris grid (even number)
+ * @param seed seed to initialize random number generator, if seed <= 0, generator is initialized by time
+ * @param crit_type optimization criterion type
+ * @param weight_BF criterion weight for baseflow
+ * @param use_weights whether to use weights for time steps of runoff
+ * @param init_GS initial groundwater storage
+ * @param n_threads number of threads
+ */
+template<class FCD>
+void sens_analysis<FCD>::set(unsigned method, unsigned sample_count, unsigned levels, int seed, unsigned crit_type, double weight_BF, bool use_weights, long double init_GS, unsigned n_threads)
+{
+  if (method >= method_count)
+    throw bil_err("Unknown sensitivity method.");
+  if (sample_count == 0)
+    throw bil_err("Number of samples cannot be zero.");
+  if (method == MORRIS && (levels < 2 || levels % 2 != 0))
+    throw bil_err("Number of levels for Morris method must be even.");
+  if (weight_BF < 0 || weight_BF > 1)
+    throw bil_err("Weight for baseflow should be between 0 and 1.");
+  if (init_GS < 0)
+    throw bil_err("Initial groundwater storage must be positive.");
+  if (n_threads == 0)
+    throw bil_err("Number of threads cannot be zero.");
+
+  this->method = method;
+  this->sample_count = sample_count;
+  this->levels = levels;
+  this->seed = seed;
+  this->crit_type = crit_type;
+  this->weight_BF = weight_BF;
+  this->use_weights = use_weights;
+  this->init_GS = init_GS;
+  this->n_threads = n_threads;
+}
+
+/**
+ * - creates Saltelli design: for each base sample, models of matrices A and B and of matrices AB_i (A with i-th parameter from B)
+ *   are stored together as par_count + 2 consecutive models
+ */
+template<class FCD>
+void sens_analysis<FCD>::make_sobol_design()
+{
+  unsigned block = par_count + 2, par, par_b;
+  vector<double> sample_a(par_count), sample_b(par_count);
+  for (unsigned smp = 0; smp < sample_count; smp++) {
+    for (par = 0; par < par_count; par++) {
+      sample_a[par] = lower[par] + rng.uniform() * (upper[par] - lower[par]);
+      sample_b[par] = lower[par] + rng.uniform() * (upper[par] - lower[par]);
+    }
+    for (par = 0; par < par_count; par++) {
+      evals[par][smp * block] = sample_a[par];
+      evals[par][smp * block + 1] = sample_b[par];
+      for (par_b = 0; par_b < par_count; par_b++)
+        evals[par][smp * block + 2 + par_b] = par == par_b ? sample_b[par] : sample_a[par];
+    }
+  }
+}
+
+/**
+ * - creates Morris trajectories: random base point on grid of levels, each step changes one parameter (in random order)
+ *   by levels / (2 * (levels - 1)) of its range, up or down at random
+ * - trajectory is stored as par_count + 1 consecutive models
+ */
+template<class FCD>
+void sens_analysis<FCD>::make_morris_design()
+{
+  unsigned block = par_count + 1, par, step;
+  double delta = levels / (2.0 * (levels - 1));
+  vector<double> point(par_count);
+  vector<unsigned> order(par_count);
+  morris_par.resize(sample_count * par_count);
+  for (unsigned trj = 0; trj < sample_count; trj++) {
+    for (par = 0; par < par_count; par++) {
+      point[par] = rng.below(levels / 2) / static_cast<double>(levels - 1); //base point allows step up
+      order[par] = par;
+    }
+    for (par = par_count - 1; par > 0; par--)
+      swap(order[par], order[rng.below(par + 1)]);
+    vector<bool> is_up(par_count);
+    for (par = 0; par < par_count; par++) {
+      is_up[par] = rng.below(2) == 1;
+      if (!is_up[par])
+        point[par] += delta; //step down to base point
+    }
+    for (step = 0; step <= par_count; step++) {
+      if (step > 0) {
+        par = order[step - 1];
+        point[par] += is_up[par] ? delta : -delta;
+        morris_par[trj * par_count + step - 1] = par;
+      }
+      for (par = 0; par < par_count; par++)
+        evals[par][trj * block + step] = lower[par] + point[par] * (upper[par] - lower[par]);
+    }
+  }
+}
+
+/**
+ * - evaluates criterion of all models in design in batches (run in lockstep if the functoid supports it)
+ * - with more threads, batches are evaluated concurrently by worker functoids with private parameters, results do not depend on number of threads
+ */
+template<class FCD>
+void sens_analysis<FCD>::eval_design()
+{
+  bil_crit_task<FCD> task = { init_GS, crit_type, weight_BF, use_weights, &eval_rows[0], 0 };
+  workers.run(task, eval_count);
+  if (crit_type == optimizer_gen<FCD>::NS || crit_type == optimizer_gen<FCD>::LNNS) {
+    for (unsigned ev = 0; ev < eval_count; ev++)
+      evals[par_count][ev] = 1 - evals[par_count][ev];
+  }
+}
+
+/**
+ * - calculates first order indices by estimator of Saltelli et al. (2010) and total order indices by estimator of Jansen (1999),
+ *   variance is estimated from models of both matrices A and B
+ * - all indices are zero if the variance is zero (criterion does not depend on parameters)
+ */
+template<class FCD>
+void sens_analysis<FCD>::calc_sobol()
+{
+  unsigned block = par_count + 2, smp, par;
+  const vector<double> &crit = evals[par_count];
+  long double mean = 0, variance = 0;
+  for (smp = 0; smp < sample_count; smp++)
+    mean += crit[smp * block] + crit[smp * block + 1];
+  mean /= 2.0 * sample_count;
+  for (smp = 0; smp < sample_count; smp++)
+    variance += (crit[smp * block] - mean) * (crit[smp * block] - mean) + (crit[smp * block + 1] - mean) * (crit[smp * block + 1] - mean);
+  variance /= 2.0 * sample_count;
+
+  indices.assign(par_count, vector<double>(2, 0.0));
+  if (!(variance > 0))
+    return;
+  for (par = 0; par < par_count; par++) {
+    long double sum_first = 0, sum_total = 0;
+    for (smp = 0; smp < sample_count; smp++) {
+      double crit_a = crit[smp * block], crit_b = crit[smp * block + 1], crit_ab = crit[smp * block + 2 + par];
+      sum_first += crit_b * (crit_ab - crit_a);
+      sum_total += (crit_a - crit_ab) * (crit_a - crit_ab);
+    }
+    indices[par][0] = static_cast<double>(sum_first / sample_count / variance);
+    indices[par][1] = static_cast<double>(sum_total / (2.0 * sample_count) / variance);
+  }
+}
+
+/**
+ * - calculates mean, mean of absolute values and standard deviation of elementary effects (Campolongo et al., 2007),
+ *   effects are related to parameter changes relative to their ranges
+ */
+template<class FCD>
+void sens_analysis<FCD>::calc_morris()
+{
+  unsigned block = par_count + 1, trj, step, par;
+  const vector<double> &crit = evals[par_count];
+  vector<vector<double> > effects(par_count);
+  for (trj = 0; trj < sample_count; trj++) {
+    for (step = 1; step <= par_count; step++) {
+      par = morris_par[trj * par_count + step - 1];
+      unsigned ev = trj * block + step;
+      double range = upper[par] - lower[par], change = 0;
+      if (range > 0)
+        change = (evals[par][ev] - evals[par][ev - 1]) / range;
+      effects[par].push_back(change != 0 ? (crit[ev] - crit[ev - 1]) / change : 0.0);
+    }
+  }
+
+  indices.assign(par_count, vector<double>(3, 0.0));
+  for (par = 0; par < par_count; par++) {
+    long double sum = 0, sum_abs = 0, sum_sq = 0;
+    for (trj = 0; trj < sample_count; trj++) {
+      sum += effects[par][trj];
+      sum_abs += fabs(effects[par][trj]);
+    }
+    long double mean = sum / sample_count;
+    for (trj = 0; trj < sample_count; trj++)
+      sum_sq += (effects[par][trj] - mean) * (effects[par][trj] - mean);
+    indices[par][0] = static_cast<double>(mean);
+    indices[par][1] = static_cast<double>(sum_abs / sample_count);
+    indices[par][2] = sample_count > 1 ? static_cast<double>(sqrt(sum_sq / (sample_count - 1))) : 0.0;
+  }
+}
+
+/**
+ * - global sensitivity analysis: creates design within parameter limits, evaluates it and calculates indices
+ * - design and all evaluations are kept and can be obtained by get_evals
+ * - parameters of the model are not changed
+ */
+template<class FCD>
+void sens_analysis<FCD>::analyze()
+{
+  if (!fcd)
+    throw bil_err("Sensitivity analysis has no model.");
+  par_count = fcd->get_param_count();
+  if (par_count == 0)
+    throw bil_err("Number of parameters cannot be zero.");
+
+  if (use_weights)
+    fcd->calc_sum_weights();
+  fcd->clear_obs_stats(); //statistics of observed data calculated again
+  fcd->check_vars_for_optim(weight_BF > NUMERIC_EPS);
+
+  unsigned par;
+  lower.resize(par_count);
+  upper.resize(par_count);
+  vector<double> curr(par_count);
+  for (par = 0; par < par_count; par++) {
+    lower[par] = fcd->get_param(par, optimizer_gen<FCD>::LOWER);
+    upper[par] = fcd->get_param(par, optimizer_gen<FCD>::UPPER);
+    curr[par] = fcd->get_param(par, optimizer_gen<FCD>::CURR);
+  }
+
+  eval_count = sample_count * (par_count + (method == SOBOL ? 2 : 1));
+  evals.assign(par_count + 1, vector<double>(eval_count, 0.0));
+  eval_rows.resize(par_count + 1);
+  for (par = 0; par <= par_count; par++)
+    eval_rows[par] = &evals[par][0];
+
+  rng.seed(seed > 0 ? seed : static_cast<uint32_t>(time(0)));
+  if (method == SOBOL)
+    make_sobol_design();
+  else
+    make_morris_design();
+
+  fcd->prepare_obs_stats(crit_type, weight_BF, use_weights); //workers only read the model
+  workers.create(fcd, n_threads);
+  try {
+    eval_design();
+  }
+  catch (bil_err &) {
+    workers.clear();
+    for (par = 0; par < par_count; par++)
+      fcd->set_param(par, optimizer_gen<FCD>::CURR, curr[par]);
+    throw;
+  }
+  workers.clear();
+  for (par = 0; par < par_count; par++) //functoid without batch support changes parameters
+    fcd->set_param(par, optimizer_gen<FCD>::CURR, curr[par]);
+
+  if (method == SOBOL)
+    calc_sobol();
+  else
+    calc_morris();
+}
+
+/**
+ * - gets number of indices for a parameter according to method
+ * @return number of indices
+ */
+template<class FCD>
+unsigned sens_analysis<FCD>::get_index_count()
+{
+  return method == SOBOL ? 2 : 3;
+}
+
+/**
+ * - gets name of index according to method
+ * @param index index number
+ * @return name of index
+ */
+template<class FCD>
+string sens_analysis<FCD>::get_index_name(unsigned index)
+{
+  return method == SOBOL ? sobol_names[index] : morris_names[index];
+}
+
+#endif // BIL_OPTIM_SENS_H_INCLUDED
@@ -48,17 +48,17 @@ void bilan::pet_estim_latit(long double latitude)
     if (calen[ts].is_leap())
       days_in_year = 366;
 
-    var[ts][PET] = 0;
+    var[PET][ts] = 0;
     for (unsigned doy = begin_doy; doy <= end_doy; doy++) {
       dr = 1 + 0.033 * cos(doy * 2 * M_PI / days_in_year);
       delta = 0.409 * sin(doy * 2 * M_PI / days_in_year - 1.39);
       om = acos(-tan(rad_lat) * tan(delta));
       Ra = (24 * 60) / M_PI * Gsc * dr * (om * sin(rad_lat) * sin(delta) + cos(rad_lat) * cos(delta) * sin(om));
 
-      t5 = var[ts][T] + 5;
+      t5 = var[T][ts] + 5;
       tmp_PET = 0.408 * Ra * t5 / 100;
       if (tmp_PET > 0)
-        var[ts][PET] += tmp_PET;
+        var[PET][ts] += tmp_PET;
     }
   }
   var_is_input[PET] = true;
@@ -79,7 +79,7 @@ void bilan::pet_estim_tab()
 
   //zjištění průměrné teploty
   for (ts = 0; ts < time_steps; ts++)
-    Tsum += var[ts][T];
+    Tsum += var[T][ts];
   Tmean = Tsum / time_steps;
 
   //veg. zóna pro horní mez - u posledního a prvního obě meze stejné
@@ -99,7 +99,7 @@ void bilan::pet_estim_tab()
   //store results for the first zone
   long double* tmp_PET = new long double[time_steps];
   for (ts = 0; ts < time_steps; ts++)
-    tmp_PET[ts] = var[ts][PET];
+    tmp_PET[ts] = var[PET][ts];
 
   /*kdyz je jen 1 zona, nepocita se dal*/
   if (veg_zone != TUNDRA && veg_zone != STEP) {
@@ -113,7 +113,7 @@ void bilan::pet_estim_tab()
     case STEP:
       if (type == DAILY) {
         for (ts = 0; ts < time_steps; ts++)
-          var[ts][PET] = var[ts][PET] / 30; /*na jednotlivy dny, tabulky jsou pro mesice*/
+          var[PET][ts] = var[PET][ts] / 30; /*na jednotlivy dny, tabulky jsou pro mesice*/
       }
       break;
     case JEHL:
@@ -122,9 +122,9 @@ void bilan::pet_estim_tab()
     case LESOSTEP:
       /*linearni interpolace mezi vegetacnimi zonami*/
       for (ts = 0; ts < time_steps; ts++) {
-        var[ts][PET] = var[ts][PET] + (Tmean - T_veg_zone[veg_zone - 1]) * (tmp_PET[ts] - var[ts][PET]) / (T_veg_zone[veg_zone] - T_veg_zone[veg_zone - 1]);
+        var[PET][ts] = var[PET][ts] + (Tmean - T_veg_zone[veg_zone - 1]) * (tmp_PET[ts] - var[PET][ts]) / (T_veg_zone[veg_zone] - T_veg_zone[veg_zone - 1]);
         if (type == DAILY)
-          var[ts][PET] = var[ts][PET] / 30;
+          var[PET][ts] = var[PET][ts] / 30;
       }
       break;
     default:
@@ -253,10 +253,10 @@ void bilan::pet_estim_tab_zone(int veg_zone)
   /*teplota,vlhkost->sytostni doplnek*/
   for (ts = 0; ts < time_steps; ts++) {
     /*vypocet maximálního tlaku vodní páry dle Coufala*/
-    t = var[ts][T] + 273.16;
+    t = var[T][ts] + 273.16;
     pom = 273.16 / t;
     pom2 = 1 / pom;
-    if (var[ts][T] > 0) {
+    if (var[T][ts] > 0) {
       exp1 = 10.79574 * (1 - pom) - 0.4342945 * 5.028 * log(pom2);
       exp2 = 1.50475 * 0.0001 * (1 - pow(10, (-8.22969 * (pom2 - 1))));
       exp3 = 0.42873 * 0.001 * (pow(10, (4.76955 * (1 - pom))) - 1) + 0.78614;
@@ -268,7 +268,7 @@ void bilan::pet_estim_tab_zone(int veg_zone)
     }
 
     et = pow(10, (exp1 + exp2 + exp3)); //maximální tlak vodní páry
-    dop = et * (100 - var[ts][H]) / 100;  //sytostní doplněk
+    dop = et * (100 - var[H][ts]) / 100;  //sytostní doplněk
 
     if (dop < 0) {
       throw bil_err("Physically impossible: negative value of saturation deficit.\n");
@@ -288,6 +288,6 @@ void bilan::pet_estim_tab_zone(int veg_zone)
       rozdil = tabulka[sd_horni + 1][calen[ts].month - 1] - tabulka[sd_horni][calen[ts].month - 1];
       vypv = tabulka[sd_horni][calen[ts].month - 1] + rozdil * (dop - ((long double) sd_horni) + 1);
     }
-    var[ts][PET] = vypv;
+    var[PET][ts] = vypv;
   } //ts
 }
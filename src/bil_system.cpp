@@ -11,6 +11,10 @@ bil_system::bil_system()
   catch_opt_count = 0;
   par_count_catch = 0;
   par_fix_count_catch = 0;
+  cache_init_GS = 0;
+  cache_crit = 0;
+  cache_weight_BF = 0;
+  cache_use_weights = false;
   fcd.set(this);
   optim = new optimizer<bilsys_fcd*>(); //default optimization
   optim->set_functoid(&fcd);
@@ -144,6 +148,7 @@ void bil_system::prepare_opt()
       tmp_c++;
     }
   }
+  clear_crit_cache();
 }
 
 /**
@@ -166,6 +171,29 @@ void bil_system::calc_sum_weights()
   }
 }
 
+/**
+ * - gets total number of time steps of catchments to be optimized
+ * @return number of time steps
+ */
+unsigned bil_system::get_time_steps()
+{
+  unsigned time_steps = 0;
+  for (unsigned cat = 0; cat < catch_opt_count; cat++)
+    time_steps += catchs_opt[cat]->time_steps;
+  return time_steps;
+}
+
+/**
+ * - invalidates statistics of observed data for catchments to be optimized
+ */
+void bil_system::clear_obs_stats()
+{
+  for (unsigned cat = 0; cat < catch_opt_count; cat++) {
+    catchs_opt[cat]->clear_obs_stats();
+  }
+  clear_crit_cache();
+}
+
 /**
  * - checks if input variables needed for optimization are loaded for all catchments
  * @param is_weight_BF whether baseflow will be used for optimization
@@ -181,21 +209,23 @@ void bil_system::check_vars_for_optim(bool is_weight_BF)
  * - gets value of parameter
  * @param par_n parameter serial number within all catchments
  * @param par_type type of parameter
+ * @param cat_param parameters of catchments (of a worker), null for parameters of optimized catchments
  * @return value of parameter
  */
-double bil_system::get_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type)
+double bil_system::get_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type, parameter **cat_param)
 {
   unsigned catch_n = par_n / par_count_catch; //division of integer to get integer
   unsigned par_catch_n = par_n % par_count_catch;
+  parameter *tmp_param = cat_param ? cat_param[catch_n] : catchs_opt[catch_n]->param;
   switch (par_type) {
     case parameter::INIT:
-      return catchs_opt[catch_n]->param[par_catch_n].initial;
+      return tmp_param[par_catch_n].initial;
     case parameter::CURR:
-      return catchs_opt[catch_n]->param[par_catch_n].value;
+      return tmp_param[par_catch_n].value;
     case parameter::LOWER:
-      return catchs_opt[catch_n]->param[par_catch_n].lower;
+      return tmp_param[par_catch_n].lower;
     case parameter::UPPER:
-      return catchs_opt[catch_n]->param[par_catch_n].upper;
+      return tmp_param[par_catch_n].upper;
     default:
       throw bil_err("Undefined parameter type.");
       break;
@@ -204,26 +234,31 @@ double bil_system::get_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_t
 
 /**
  * - sets value of parameter
+ * - change of current value of parameters of optimized catchments invalidates cached criterion of the catchment
  * @param par_n parameter serial number within all catchments
  * @param par_type type of parameter
  * @param value value to be set
+ * @param cat_param parameters of catchments (of a worker), null for parameters of optimized catchments
  */
-void bil_system::set_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type, double value)
+void bil_system::set_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type, double value, parameter **cat_param)
 {
   unsigned catch_n = par_n / par_count_catch;
   unsigned par_catch_n = par_n % par_count_catch;
+  parameter *tmp_param = cat_param ? cat_param[catch_n] : catchs_opt[catch_n]->param;
   switch (par_type) {
     case parameter::INIT:
-      catchs_opt[catch_n]->param[par_catch_n].initial = value;
+      tmp_param[par_catch_n].initial = value;
       break;
     case parameter::CURR:
-      catchs_opt[catch_n]->param[par_catch_n].value = value;
+      if (!cat_param && tmp_param[par_catch_n].value != value && catch_n < is_cat_crit_valid.size())
+        is_cat_crit_valid[catch_n] = false;
+      tmp_param[par_catch_n].value = value;
       break;
     case parameter::LOWER:
-      catchs_opt[catch_n]->param[par_catch_n].lower = value;
+      tmp_param[par_catch_n].lower = value;
       break;
     case parameter::UPPER:
-      catchs_opt[catch_n]->param[par_catch_n].upper = value;
+      tmp_param[par_catch_n].upper = value;
       break;
     default:
       break;
@@ -258,20 +293,52 @@ std::string bil_system::get_param_name(unsigned par_n)
 }
 
 /**
- * - runs the model for all catchments
+ * - gets number of threads for catchments according to optimization settings
+ * - catchments are processed by one thread if called from a parallel region (when parameter sets are evaluated concurrently)
+ * @return number of threads
+ */
+unsigned bil_system::get_n_threads()
+{
+  unsigned n_threads = optim ? optim->n_threads : 1;
+#ifdef _OPENMP
+  if (omp_in_parallel())
+    n_threads = 1;
+#endif
+  if (n_threads > catch_opt_count)
+    n_threads = catch_opt_count;
+  return n_threads > 0 ? n_threads : 1;
+}
+
+/**
+ * - runs the model for all catchments, catchments are run concurrently if more threads are set
  * @param init_GS initial groundwater storage, same for each catchment
  */
 void bil_system::run(long double init_GS)
 {
-  for (unsigned cat = 0; cat < catch_opt_count; cat++) {
-    catchs_opt[cat]->run(init_GS);
+  bool is_err = false;
+  string err_descr;
+  #pragma omp parallel for schedule(dynamic) num_threads(get_n_threads())
+  for (int cat = 0; cat < static_cast<int>(catch_opt_count); cat++) {
+    try {
+      catchs_opt[cat]->run(init_GS);
+    }
+    catch (bil_err &error) { //exceptions cannot leave parallel region
+      #pragma omp critical(bil_eval_err)
+      {
+        is_err = true;
+        err_descr = error.descr;
+      }
+    }
   }
+  if (is_err)
+    throw bil_err(err_descr);
 }
 
 /**
  * - calculates optimization criterion value for a system
  * - resulting criterion as simple mean of criteria for each catchments
  * - in case of two catchments adds penalty for negative difference in flows between the second and first catchment
+ * - criteria of catchments are calculated concurrently if more threads are set, the mean and penalty after all of them finish
  * @param crit criterion type
  * @param weight_BF weight for baseflow
  * @param use_weights whether to use weights
@@ -279,19 +346,187 @@ void bil_system::run(long double init_GS)
  */
 long double bil_system::calc_crit(unsigned crit, double weight_BF, bool use_weights)
 {
+  vector<long double> cat_crit(catch_opt_count, 0);
+  bool is_err = false;
+  string err_descr;
+  #pragma omp parallel for schedule(dynamic) num_threads(get_n_threads())
+  for (int cat = 0; cat < static_cast<int>(catch_opt_count); cat++) {
+    try {
+      cat_crit[cat] = catchs_opt[cat]->calc_crit_RM_BF(crit, weight_BF, use_weights);
+    }
+    catch (bil_err &error) { //exceptions cannot leave parallel region
+      #pragma omp critical(bil_eval_err)
+      {
+        is_err = true;
+        err_descr = error.descr;
+      }
+    }
+  }
+  if (is_err)
+    throw bil_err(err_descr);
+
+  long double tmp_crit = 0;
+  for (unsigned cat = 0; cat < catch_opt_count; cat++) {
+    tmp_crit += cat_crit[cat]; //sum in order of catchments to get the same result for any number of threads
+  }
+  bil_real *RM_first = catch_opt_count == 2 ? catchs_opt[0]->var[bilan::RM] : 0;
+  bil_real *RM_second = catch_opt_count == 2 ? catchs_opt[1]->var[bilan::RM] : 0;
+  return (tmp_crit + 0.1 * count_neg_flows(RM_first, RM_second)) / static_cast<long double>(catch_opt_count);
+}
+
+/**
+ * - runs the model and calculates optimization criterion value for a system in one pass for each catchment
+ * - only modelled runoff is stored and only if needed for penalty
+ * - with private parameters and runoff columns of a worker the catchments are only read (statistics of observed data have to be prepared)
+ * - with parameters of optimized catchments, only catchments with changed parameters are run, criteria of others are taken from the previous call
+ *   (a parameter affects only its catchment, so e.g. gradient optimization runs one catchment per parameter change)
+ * - catchments are run concurrently if more threads are set, the mean and penalty are calculated after all of them finish
+ * @param init_GS initial groundwater storage, same for each catchment
+ * @param crit criterion type
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights
+ * @param cat_param parameters of catchments, null for parameters of optimized catchments
+ * @param cat_RM columns for modelled runoff of catchments, null for variables of optimized catchments
+ * @param crit_BF mean criterion of baseflow alone of catchments (calculated for any weight_BF), null if not needed
+ * @return criterion value
+ */
+long double bil_system::run_crit(long double init_GS, unsigned crit, double weight_BF, bool use_weights, parameter **cat_param, bil_real **cat_RM, long double *crit_BF)
+{
+  bool use_cache = !cat_param && !cat_RM && !crit_BF;
+  if (use_cache) {
+    if (init_GS != cache_init_GS || crit != cache_crit || weight_BF != cache_weight_BF || use_weights != cache_use_weights) {
+      clear_crit_cache();
+      cache_init_GS = init_GS;
+      cache_crit = crit;
+      cache_weight_BF = weight_BF;
+      cache_use_weights = use_weights;
+    }
+  }
+  vector<long double> tmp_cat_crit(catch_opt_count, 0);
+  vector<long double> &cat_crit = use_cache ? cat_crit_cache : tmp_cat_crit;
+  vector<long double> cat_crit_BF(crit_BF ? catch_opt_count : 0, 0);
+  vector<unsigned> cats_to_run; //catchments to be run
+  for (unsigned cat = 0; cat < catch_opt_count; cat++) {
+    if (!use_cache || !is_cat_crit_valid[cat])
+      cats_to_run.push_back(cat);
+  }
+
+  bil_real *RM_out[2] = { 0, 0 };
+  if (catch_opt_count == 2) {
+    for (unsigned cat = 0; cat < 2; cat++)
+      RM_out[cat] = cat_RM ? cat_RM[cat] : catchs_opt[cat]->var[bilan::RM];
+  }
+  bool is_err = false;
+  string err_descr;
+  #pragma omp parallel for schedule(dynamic) num_threads(get_n_threads())
+  for (int c = 0; c < static_cast<int>(cats_to_run.size()); c++) {
+    unsigned cat = cats_to_run[c];
+    try {
+      cat_crit[cat] = catchs_opt[cat]->run_crit(init_GS, crit, weight_BF, use_weights, cat_param ? cat_param[cat] : 0, catch_opt_count == 2 ? RM_out[cat] : 0, crit_BF ? &cat_crit_BF[cat] : 0);
+    }
+    catch (bil_err &error) { //exceptions cannot leave parallel region
+      #pragma omp critical(bil_eval_err)
+      {
+        is_err = true;
+        err_descr = error.descr;
+      }
+    }
+  }
+  if (is_err) {
+    if (use_cache)
+      clear_crit_cache();
+    throw bil_err(err_descr);
+  }
+  if (use_cache) {
+    for (unsigned c = 0; c < cats_to_run.size(); c++)
+      is_cat_crit_valid[cats_to_run[c]] = true;
+  }
+
   long double tmp_crit = 0;
   for (unsigned cat = 0; cat < catch_opt_count; cat++) {
-    tmp_crit += catchs_opt[cat]->calc_crit_RM_BF(crit, weight_BF, use_weights);
+    tmp_crit += cat_crit[cat]; //sum in order of catchments to get the same result for any number of threads
+  }
+  if (crit_BF) {
+    *crit_BF = 0;
+    for (unsigned cat = 0; cat < catch_opt_count; cat++)
+      *crit_BF += cat_crit_BF[cat];
+    *crit_BF /= static_cast<long double>(catch_opt_count);
+  }
+  return (tmp_crit + 0.1 * count_neg_flows(RM_out[0], RM_out[1])) / static_cast<long double>(catch_opt_count);
+}
+
+/**
+ * - invalidates cached criteria of all optimized catchments, e.g. after change of data or settings
+ */
+void bil_system::clear_crit_cache()
+{
+  cat_crit_cache.assign(catch_opt_count, 0);
+  is_cat_crit_valid.assign(catch_opt_count, false);
+}
+
+/**
+ * - calculates statistics of observed data for all catchments, criterion can be then calculated concurrently
+ * @param crit criterion type
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights
+ */
+void bil_system::prepare_obs_stats(unsigned crit, double weight_BF, bool use_weights)
+{
+  for (unsigned cat = 0; cat < catch_opt_count; cat++) {
+    catchs_opt[cat]->prepare_obs_stats(crit, weight_BF, use_weights);
+  }
+}
+
+/**
+ * - allocates copies of parameters and columns for modelled runoff of optimized catchments
+ * @param cat_param parameters for each catchment to be allocated
+ * @param cat_RM runoff columns for each catchment to be allocated
+ */
+void bil_system::new_worker_data(parameter **&cat_param, bil_real **&cat_RM)
+{
+  cat_param = new parameter*[catch_opt_count];
+  cat_RM = new bil_real*[catch_opt_count];
+  for (unsigned cat = 0; cat < catch_opt_count; cat++) {
+    unsigned par_count = catchs_opt[cat]->par_count;
+    cat_param[cat] = new parameter[par_count];
+    for (unsigned par = 0; par < par_count; par++)
+      cat_param[cat][par] = catchs_opt[cat]->param[par];
+    cat_RM[cat] = new bil_real[catchs_opt[cat]->time_steps];
+  }
+}
+
+/**
+ * - deletes data allocated by new_worker_data
+ * @param cat_param parameters for each catchment
+ * @param cat_RM runoff columns for each catchment
+ */
+void bil_system::delete_worker_data(parameter **cat_param, bil_real **cat_RM)
+{
+  for (unsigned cat = 0; cat < catch_opt_count; cat++) {
+    delete[] cat_param[cat];
+    delete[] cat_RM[cat];
   }
+  delete[] cat_param;
+  delete[] cat_RM;
+}
+
+/**
+ * - counts time steps with negative difference in flows between the second and first catchment
+ * @param RM_first modelled runoff of the first catchment
+ * @param RM_second modelled runoff of the second catchment
+ * @return number of time steps, zero if there are not two catchments
+ */
+unsigned bil_system::count_neg_flows(bil_real *RM_first, bil_real *RM_second)
+{
   unsigned neg_flows = 0;
   if (catch_opt_count == 2) {
     for (unsigned ts = 0; ts < catchs_opt[1]->time_steps; ts++) {
-      if (catchs_opt[1]->get_flow_m3s1(ts, bilan::RM) - catchs_opt[0]->get_flow_m3s1(ts, bilan::RM) < 0) {
+      if (catchs_opt[1]->get_flow_m3s1(RM_second[ts]) - catchs_opt[0]->get_flow_m3s1(RM_first[ts]) < 0) {
         neg_flows++;
       }
     }
   }
-  return (tmp_crit + 0.1 * neg_flows) / static_cast<long double>(catch_opt_count);
+  return neg_flows;
 }
 
 /**
@@ -302,6 +537,23 @@ void bilsys_fcd::calc_sum_weights()
   psbil->calc_sum_weights();
 }
 
+/**
+ * - gets number of time steps of a system run, used to estimate the cost of optimization
+ * @return number of time steps
+ */
+unsigned bilsys_fcd::get_time_steps()
+{
+  return psbil->get_time_steps();
+}
+
+/**
+ * - invalidates statistics of observed data
+ */
+void bilsys_fcd::clear_obs_stats()
+{
+  psbil->clear_obs_stats();
+}
+
 /**
  * - checks if input variables needed for optimization are loaded
  * @param is_weight_BF whether baseflow will be used for optimization
@@ -319,7 +571,7 @@ void bilsys_fcd::check_vars_for_optim(bool is_weight_BF)
  */
 double bilsys_fcd::get_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type)
 {
-  return psbil->get_param(par_n, par_type);
+  return psbil->get_param(par_n, par_type, wrk_param);
 }
 
 /**
@@ -330,7 +582,7 @@ double bilsys_fcd::get_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_t
  */
 void bilsys_fcd::set_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type, double value)
 {
-  psbil->set_param(par_n, par_type, value);
+  psbil->set_param(par_n, par_type, value, wrk_param);
 }
 
 /**
@@ -366,6 +618,8 @@ std::string bilsys_fcd::get_param_name(unsigned par_n)
  */
 void bilsys_fcd::run(long double init_GS)
 {
+  if (wrk_param)
+    throw bil_err("Worker functoid cannot run the model with outputs.");
   psbil->run(init_GS);
 }
 
@@ -378,5 +632,102 @@ void bilsys_fcd::run(long double init_GS)
  */
 long double bilsys_fcd::calc_crit(unsigned crit, double weight_BF, bool use_weights)
 {
+  if (wrk_param)
+    throw bil_err("Worker functoid cannot calculate criterion from outputs.");
   return psbil->calc_crit(crit, weight_BF, use_weights);
 }
+
+/**
+ * - runs the model and calculates optimization criterion value for a system without storing output variables
+ * @param init_GS initial groundwater storage
+ * @param crit criterion type
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights
+ * @return criterion value
+ */
+long double bilsys_fcd::run_crit(long double init_GS, unsigned crit, double weight_BF, bool use_weights)
+{
+  return psbil->run_crit(init_GS, crit, weight_BF, use_weights, wrk_param, wrk_RM);
+}
+
+/**
+ * - sets parameters of several models one by one, runs the system and stores criterion value of each in the last row
+ * - models are not run in lockstep as for a single catchment, catchments of the system are run for one model at a time
+ * @param init_GS initial groundwater storage
+ * @param crit criterion type
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights
+ * @param models parameters of models and their criterion in the last row - matrix(par_count+1, number of models)
+ * @param model_first index of the first model to run
+ * @param model_count number of models to run
+ * @param crits criterion values of the models in full precision, null if not needed
+ */
+void bilsys_fcd::run_crit_batch(long double init_GS, unsigned crit, double weight_BF, bool use_weights, double **models, unsigned model_first, unsigned model_count, long double *crits)
+{
+  unsigned par_count = get_param_count();
+  for (unsigned m = model_first; m < model_first + model_count; m++) {
+    for (unsigned par = 0; par < par_count; par++)
+      set_param(par, optimizer_gen<bilsys_fcd*>::CURR, models[par][m]);
+    long double crit_value = run_crit(init_GS, crit, weight_BF, use_weights);
+    models[par_count][m] = crit_value;
+    if (crits)
+      crits[m - model_first] = crit_value;
+  }
+}
+
+/**
+ * - sets parameters of several models one by one, runs the system and stores mean criteria of runoff and baseflow of each in the last two rows
+ * - both criteria are calculated from one run, for multi-objective optimization
+ * @param init_GS initial groundwater storage
+ * @param crit criterion type
+ * @param use_weights whether to use weights
+ * @param models parameters of models and their criteria of runoff and baseflow in the last rows - matrix(par_count+2, number of models)
+ * @param model_first index of the first model to run
+ * @param model_count number of models to run
+ */
+void bilsys_fcd::run_objs_batch(long double init_GS, unsigned crit, bool use_weights, double **models, unsigned model_first, unsigned model_count)
+{
+  unsigned par_count = get_param_count();
+  for (unsigned m = model_first; m < model_first + model_count; m++) {
+    for (unsigned par = 0; par < par_count; par++)
+      set_param(par, optimizer_gen<bilsys_fcd*>::CURR, models[par][m]);
+    long double crit_BF;
+    models[par_count][m] = psbil->run_crit(init_GS, crit, 0, use_weights, wrk_param, wrk_RM, &crit_BF);
+    models[par_count + 1][m] = crit_BF;
+  }
+}
+
+/**
+ * - calculates statistics of observed data, needed before the system is evaluated by several threads
+ * @param crit criterion type
+ * @param weight_BF weight for baseflow
+ * @param use_weights whether to use weights
+ */
+void bilsys_fcd::prepare_obs_stats(unsigned crit, double weight_BF, bool use_weights)
+{
+  psbil->prepare_obs_stats(crit, weight_BF, use_weights);
+}
+
+/**
+ * - creates functoid for a worker thread, it has its own copy of parameters and modelled runoff and shares input data with the system
+ * - worker can only set parameters and run the model with criterion calculation (statistics of observed data have to be prepared)
+ * @return new functoid to be deleted by delete_worker
+ */
+bilsys_fcd* bilsys_fcd::new_worker()
+{
+  bilsys_fcd *worker = new bilsys_fcd(psbil);
+  psbil->new_worker_data(worker->wrk_param, worker->wrk_RM);
+  return worker;
+}
+
+/**
+ * - deletes functoid of worker thread
+ * @param worker functoid created by new_worker
+ */
+void bilsys_fcd::delete_worker(bilsys_fcd *worker)
+{
+  if (worker) {
+    psbil->delete_worker_data(worker->wrk_param, worker->wrk_RM);
+    delete worker;
+  }
+}
@@ -16,9 +16,9 @@ class bil_system;
 class bilsys_fcd
 {
   public:
-    bilsys_fcd() { psbil = 0; };
+    bilsys_fcd() { psbil = 0; wrk_param = 0; wrk_RM = 0; };
     //! creation of functoid for a system
-    bilsys_fcd(bil_system *sbil) { psbil = sbil; };
+    bilsys_fcd(bil_system *sbil) { psbil = sbil; wrk_param = 0; wrk_RM = 0; };
     //! sets pointer to system
     void set(bil_system *sbil) { psbil = sbil; };
     void calc_sum_weights(); //!< calculates sum of weights for optimization
@@ -30,9 +30,21 @@ class bilsys_fcd
     std::string get_param_name(unsigned par_n); //!< gets name of parameter
     void run(long double init_GS); //!< runs the model
     long double calc_crit(unsigned crit, double weight_BF, bool use_weights); //!< calculates optimization criterion value
+    long double run_crit(long double init_GS, unsigned crit, double weight_BF, bool use_weights); //!< runs the model and calculates criterion in one pass
+    void run_crit_batch(long double init_GS, unsigned crit, double weight_BF, bool use_weights, double **models, unsigned model_first, unsigned model_count, long double *crits = 0); //!< runs models one by one and calculates their criteria
+    void run_objs_batch(long double init_GS, unsigned crit, bool use_weights, double **models, unsigned model_first, unsigned model_count); //!< runs models one by one and calculates criteria of runoff and baseflow
+    //! number of parameter sets run together by run_crit_batch - system is run for one set at a time
+    unsigned get_batch_size() { return 1; };
+    unsigned get_time_steps(); //!< gets number of time steps of a system run
+    void clear_obs_stats(); //!< invalidates statistics of observed data
+    void prepare_obs_stats(unsigned crit, double weight_BF, bool use_weights); //!< calculates statistics of observed data before parallel evaluation
+    bilsys_fcd* new_worker(); //!< creates functoid with private parameters and runoff for a worker thread
+    void delete_worker(bilsys_fcd *worker); //!< deletes functoid of a worker thread
 
   private:
     bil_system* psbil; //!< pointer to a system
+    parameter **wrk_param; //!< private parameters of worker functoid for each optimized catchment (null for functoid using parameters of catchments)
+    bil_real **wrk_RM; //!< private modelled runoff of worker functoid for each optimized catchment
 };
 
 /**
@@ -52,9 +64,10 @@ class bil_system
     void prepare_opt(); //!< prepares optimization
     void optimize(); //!< runs optimization for the system
     void calc_sum_weights(); //!< calculates sum of weights for catchments to be optimized
+    void clear_obs_stats(); //!< invalidates statistics of observed data for catchments to be optimized
     void check_vars_for_optim(bool is_weight_BF); //!< checks availability of variables for optimization
-    double get_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type); //!< gets parameter value
-    void set_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type, double value); //!< sets parameter value
+    double get_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type, parameter **cat_param = 0); //!< gets parameter value
+    void set_param(unsigned par_n, optimizer_gen<bilsys_fcd*>::param_type par_type, double value, parameter **cat_param = 0); //!< sets parameter value
     //! gets optimization criterion value for the system
     long double get_optim_ok() { return optim->get_ok(); };
     //! gets type of optimization criterion for the system
@@ -62,8 +75,13 @@ class bil_system
     unsigned get_param_count(); //!< gets number of all parameters
     unsigned get_param_fix_count(); //!< gets number of fixed parameters
     std::string get_param_name(unsigned par_n); //!< gets parameter name
+    unsigned get_time_steps(); //!< gets total number of time steps of catchments to be optimized
     void run(long double init_GS); //!< runs model for all catchments
     long double calc_crit(unsigned crit, double weight_BF, bool use_weights); //!< mean criterion for catchments
+    long double run_crit(long double init_GS, unsigned crit, double weight_BF, bool use_weights, parameter **cat_param = 0, bil_real **cat_RM = 0, long double *crit_BF = 0); //!< runs model and calculates mean criterion without storing outputs
+    void prepare_obs_stats(unsigned crit, double weight_BF, bool use_weights); //!< calculates statistics of observed data for catchments to be optimized
+    void new_worker_data(parameter **&cat_param, bil_real **&cat_RM); //!< allocates private parameters and runoff of catchments for a worker
+    void delete_worker_data(parameter **cat_param, bil_real **cat_RM); //!< deletes private data of a worker
 
     bilsys_fcd fcd; //!< functoid to be used in optimization
     optimizer_gen<bilsys_fcd*> *optim; //!< optimization settings and variables (gradient or DE method)
@@ -76,6 +94,22 @@ class bil_system
     unsigned par_count_catch; //!< number of parameters for one catchment
     unsigned par_fix_count_catch; //!< number of fixed parameters for one catchment
 
+    std::vector<long double> cat_crit_cache; //!< criterion of each optimized catchment from the last run_crit
+    std::vector<bool> is_cat_crit_valid; //!< whether cached criterion of catchment corresponds to its current parameters
+    //!@{
+    /** @name
+     *  settings of run_crit for which criteria of catchments are cached
+     */
+    long double cache_init_GS;
+    unsigned cache_crit;
+    double cache_weight_BF;
+    bool cache_use_weights;
+    //!@}
+
+    unsigned count_neg_flows(bil_real *RM_first, bil_real *RM_second); //!< number of time steps with negative difference of flows for two catchments
+    void clear_crit_cache(); //!< invalidates cached criteria of all catchments
+    unsigned get_n_threads(); //!< number of threads for catchments
+
 };
 
 #endif // BIL_SYSTEM_H_INCLUDED
@@ -117,6 +117,40 @@ RcppExport SEXP write_file(SEXP model_ptr, SEXP file_name, SEXP Rtype)
   return wrap(err);
 }
 
+RcppExport SEXP read_binary(SEXP model_ptr, SEXP file_name)
+{
+  XPtr<bilan> bil(model_ptr);
+  string file = as<string>(file_name);
+  string err = "";
+  try {
+    bil->read_binary(file);
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: " + error.descr;
+  }
+  return wrap(err);
+}
+
+RcppExport SEXP write_binary(SEXP model_ptr, SEXP file_name)
+{
+  XPtr<bilan> bil(model_ptr);
+  string file = as<string>(file_name);
+  string err = "";
+  try {
+    bil->write_binary(file);
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: " + error.descr;
+  }
+  return wrap(err);
+}
+
 RcppExport SEXP set_input_vars(SEXP model_ptr, SEXP Rinput_vars, SEXP Rinit_date, SEXP Rappend)
 {
   XPtr<bilan> bil(model_ptr);
@@ -150,8 +184,9 @@ RcppExport SEXP set_input_vars(SEXP model_ptr, SEXP Rinput_vars, SEXP Rinit_date
         var_pos = bil->get_var_pos(var_name);
 
         NumericVector tmp_col = input_vars[c];
+        bil_real *var_col = bil->get_var_col(var_pos);
         for (unsigned r = 0; r < nrow; r++) {
-          bil->var[r][var_pos] = tmp_col[r];
+          var_col[r] = tmp_col[r];
         }
         bil->var_is_input[var_pos] = true;
       }
@@ -282,10 +317,14 @@ RcppExport SEXP copy_optim(SEXP model_ptr, SEXP orig_model_ptr)
         bil->optim = new optimizer<bilan_fcd*>();
         bil->optim->set_functoid(&bil->fcd);
       }
-      else {
+      else if (bil_orig->optim->get_type() == optimizer_gen<bilan_fcd*>::DE) {
         bil->optim = new DE_optim<bilan_fcd*>();
         bil->optim->set_functoid(&bil->fcd);
       }
+      else {
+        bil->optim = new MO_optim<bilan_fcd*>();
+        bil->optim->set_functoid(&bil->fcd);
+      }
     }
     *(bil->optim) = *(bil_orig->optim);
   }
@@ -298,7 +337,7 @@ RcppExport SEXP copy_optim(SEXP model_ptr, SEXP orig_model_ptr)
   return wrap(err);
 }
 
-RcppExport SEXP set_optim(SEXP model_ptr, SEXP Rcrit_part1, SEXP Rcrit_part2, SEXP Rweight_BF, SEXP Rmax_iter, SEXP Rinit_GS, SEXP Ruse_weights)
+RcppExport SEXP set_optim(SEXP model_ptr, SEXP Rcrit_part1, SEXP Rcrit_part2, SEXP Rweight_BF, SEXP Rmax_iter, SEXP Rinit_GS, SEXP Ruse_weights, SEXP Rn_threads, SEXP Rprobes, SEXP Rcache_size)
 {
   XPtr<bilan> bil(model_ptr);
 
@@ -308,6 +347,9 @@ RcppExport SEXP set_optim(SEXP model_ptr, SEXP Rcrit_part1, SEXP Rcrit_part2, SE
   unsigned max_iter = as<unsigned>(Rmax_iter);
   long double init_GS = as<long double>(Rinit_GS);
   bool use_weights = as<bool>(Ruse_weights);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+  unsigned probes = as<unsigned>(Rprobes);
+  unsigned cache_size = as<unsigned>(Rcache_size);
 
   string err = "";
   try {
@@ -315,6 +357,9 @@ RcppExport SEXP set_optim(SEXP model_ptr, SEXP Rcrit_part1, SEXP Rcrit_part2, SE
     optimizer<bilan_fcd*> tmp_optim;
     tmp_optim.set_functoid(&bil->fcd);
     tmp_optim.set(crit_part1, crit_part2, weight_BF, use_weights, max_iter, init_GS);
+    tmp_optim.set_n_threads(n_threads);
+    tmp_optim.set_probes(probes);
+    tmp_optim.set_cache_size(cache_size);
     bil->optim = new optimizer<bilan_fcd*>();
     *(bil->optim) = tmp_optim;
   }
@@ -327,7 +372,7 @@ RcppExport SEXP set_optim(SEXP model_ptr, SEXP Rcrit_part1, SEXP Rcrit_part2, SE
   return wrap(err);
 }
 
-RcppExport SEXP set_DE_optim(SEXP model_ptr, SEXP Rcrit, SEXP RDE_type, SEXP Rn_comp, SEXP Rcomp_size, SEXP Rcross, SEXP Rmutat_f, SEXP Rmutat_k,SEXP Rmaxn_shuffles, SEXP Rn_gen_comp, SEXP Rens_count, SEXP Rseed, SEXP Rweight_BF, SEXP Rinit_GS, SEXP Ruse_weights)
+RcppExport SEXP set_DE_optim(SEXP model_ptr, SEXP Rcrit, SEXP RDE_type, SEXP Rn_comp, SEXP Rcomp_size, SEXP Rcross, SEXP Rmutat_f, SEXP Rmutat_k,SEXP Rmaxn_shuffles, SEXP Rn_gen_comp, SEXP Rens_count, SEXP Rseed, SEXP Rweight_BF, SEXP Rinit_GS, SEXP Ruse_weights, SEXP Rn_threads, SEXP Rparallel_comp, SEXP Rgenerational, SEXP Rcheckpoint_file, SEXP Rresume, SEXP Rstop_shuffles, SEXP Rstop_improv, SEXP Rstop_spread, SEXP Rmax_eval, SEXP Rbound_handling, SEXP Rsurrogate, SEXP Rsurrogate_factor, SEXP Rsurrogate_size)
 {
   XPtr<bilan> bil(model_ptr);
 
@@ -345,6 +390,19 @@ RcppExport SEXP set_DE_optim(SEXP model_ptr, SEXP Rcrit, SEXP RDE_type, SEXP Rn_
   double weight_BF = as<double>(Rweight_BF);
   long double init_GS = as<long double>(Rinit_GS);
   bool use_weights = as<bool>(Ruse_weights);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+  bool parallel_comp = as<bool>(Rparallel_comp);
+  bool generational = as<bool>(Rgenerational);
+  string checkpoint_file = as<string>(Rcheckpoint_file);
+  bool resume = as<bool>(Rresume);
+  unsigned stop_shuffles = as<unsigned>(Rstop_shuffles);
+  double stop_improv = as<double>(Rstop_improv);
+  double stop_spread = as<double>(Rstop_spread);
+  unsigned max_eval = as<unsigned>(Rmax_eval);
+  unsigned bound_handling = as<unsigned>(Rbound_handling);
+  bool surrogate = as<bool>(Rsurrogate);
+  double surrogate_factor = as<double>(Rsurrogate_factor);
+  unsigned surrogate_size = as<unsigned>(Rsurrogate_size);
 
   string err = "";
   try {
@@ -352,6 +410,13 @@ RcppExport SEXP set_DE_optim(SEXP model_ptr, SEXP Rcrit, SEXP RDE_type, SEXP Rn_
     DE_optim<bilan_fcd*> tmp_optim;
     tmp_optim.set_functoid(&bil->fcd);
     tmp_optim.set(crit, DE_type, n_comp, comp_size, cross, mutat_f, mutat_k, maxn_shuffles, n_gen_comp, ens_count, seed, weight_BF, use_weights, init_GS);
+    tmp_optim.set_n_threads(n_threads);
+    tmp_optim.set_parallel_comp(parallel_comp);
+    tmp_optim.set_generational(generational);
+    tmp_optim.set_checkpoint(checkpoint_file, resume);
+    tmp_optim.set_stopping(stop_shuffles, stop_improv, stop_spread, max_eval);
+    tmp_optim.set_bound_handling(bound_handling);
+    tmp_optim.set_surrogate(surrogate, surrogate_factor, surrogate_size);
     bil->optim = new DE_optim<bilan_fcd*>();
     *(bil->optim) = tmp_optim;
   }
@@ -364,6 +429,40 @@ RcppExport SEXP set_DE_optim(SEXP model_ptr, SEXP Rcrit, SEXP RDE_type, SEXP Rn_
   return wrap(err);
 }
 
+RcppExport SEXP set_MO_optim(SEXP model_ptr, SEXP Rcrit, SEXP Rpopul_size, SEXP Rn_gen, SEXP Rcross, SEXP Rmutat_f, SEXP Rseed, SEXP Rweight_BF, SEXP Rinit_GS, SEXP Ruse_weights, SEXP Rn_threads)
+{
+  XPtr<bilan> bil(model_ptr);
+
+  unsigned crit = as<unsigned>(Rcrit);
+  unsigned popul_size = as<unsigned>(Rpopul_size);
+  unsigned n_gen = as<unsigned>(Rn_gen);
+  double cross = as<double>(Rcross);
+  double mutat_f = as<double>(Rmutat_f);
+  int seed = as<int>(Rseed);
+  double weight_BF = as<double>(Rweight_BF);
+  long double init_GS = as<long double>(Rinit_GS);
+  bool use_weights = as<bool>(Ruse_weights);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+
+  string err = "";
+  try {
+    delete bil->optim;
+    MO_optim<bilan_fcd*> tmp_optim;
+    tmp_optim.set_functoid(&bil->fcd);
+    tmp_optim.set(crit, popul_size, n_gen, cross, mutat_f, seed, weight_BF, use_weights, init_GS);
+    tmp_optim.set_n_threads(n_threads);
+    bil->optim = new MO_optim<bilan_fcd*>();
+    *(bil->optim) = tmp_optim;
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: Optimization was not set - " + error.descr;
+  }
+  return wrap(err);
+}
+
 RcppExport SEXP pet(SEXP model_ptr, SEXP type_pet, SEXP latit)
 {
   XPtr<bilan> bil(model_ptr);
@@ -406,6 +505,42 @@ RcppExport SEXP run(SEXP model_ptr, SEXP Rinit_GS)
   return wrap(err);
 }
 
+RcppExport SEXP check_precision(SEXP model_ptr, SEXP Rinit_GS)
+{
+  XPtr<bilan> bil(model_ptr);
+  long double init_GS = as<long double>(Rinit_GS);
+  string err;
+  vector<long double> max_dev(bil->var_count);
+
+  try {
+    bil->calc_precision_dev(init_GS, &max_dev[0]);
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: " + error.descr;
+  }
+  if (!err.empty())
+    return wrap(err);
+
+  vector<double> tmp_dev(bil->var_count);
+  vector<string> var_names(bil->var_count);
+  for (unsigned v = 0; v < bil->var_count; v++) {
+    tmp_dev[v] = max_dev[v];
+    var_names[v] = bil->get_var_name(v);
+  }
+  NumericVector dev = wrap(tmp_dev);
+  dev.names() = var_names;
+
+  List output;
+  output["real_type"] = BIL_REAL_NAME;
+  output["digits"] = numeric_limits<bil_real>::digits;
+  output["max_dev"] = dev;
+
+  return output;
+}
+
 RcppExport SEXP optimize(SEXP model_ptr)
 {
   XPtr<bilan> bil(model_ptr);
@@ -423,6 +558,219 @@ RcppExport SEXP optimize(SEXP model_ptr)
   return wrap(err);
 }
 
+RcppExport SEXP optimize_batch(SEXP Rmodels, SEXP Rn_threads, SEXP Rlog_file)
+{
+  List models = as<List>(Rmodels);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+  string log_file = as<string>(Rlog_file);
+
+  string err;
+  vector<bil_task_info> tasks;
+  try {
+    vector<DE_optim<bilan_fcd*>*> optims(models.size());
+    for (unsigned m = 0; m < optims.size(); m++) {
+      XPtr<bilan> bil = models[m];
+      optims[m] = dynamic_cast<DE_optim<bilan_fcd*>*>(bil->optim);
+      if (!optims[m]) {
+        ostringstream os;
+        os << "Optimization of model " << m + 1 << " is not set to DE method.";
+        throw bil_err(os.str());
+      }
+    }
+    tasks = DE_optimize_batch(optims, n_threads, log_file);
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: " + error.descr;
+  }
+  if (!err.empty())
+    return wrap(err);
+
+  vector<unsigned> tmp_model(tasks.size()), tmp_ens(tasks.size()), tmp_evals(tasks.size());
+  vector<int> tmp_thread(tasks.size());
+  vector<double> tmp_start(tasks.size()), tmp_time(tasks.size());
+  for (unsigned t = 0; t < tasks.size(); t++) {
+    tmp_model[t] = tasks[t].optim_n + 1;
+    tmp_ens[t] = tasks[t].ens + 1;
+    tmp_thread[t] = tasks[t].thread;
+    tmp_start[t] = tasks[t].start;
+    tmp_time[t] = tasks[t].time;
+    tmp_evals[t] = tasks[t].model_eval;
+  }
+  return DataFrame::create(Named("model") = tmp_model, Named("ensemble") = tmp_ens, Named("thread") = tmp_thread,
+    Named("start") = tmp_start, Named("time") = tmp_time, Named("evals") = tmp_evals);
+}
+
+RcppExport SEXP sensitivity(SEXP model_ptr, SEXP Rmethod, SEXP Rsample_count, SEXP Rlevels, SEXP Rseed, SEXP Rcrit, SEXP Rweight_BF, SEXP Rinit_GS, SEXP Ruse_weights, SEXP Rn_threads)
+{
+  XPtr<bilan> bil(model_ptr);
+
+  unsigned method = as<unsigned>(Rmethod);
+  unsigned sample_count = as<unsigned>(Rsample_count);
+  unsigned levels = as<unsigned>(Rlevels);
+  int seed = as<int>(Rseed);
+  unsigned crit = as<unsigned>(Rcrit);
+  double weight_BF = as<double>(Rweight_BF);
+  long double init_GS = as<long double>(Rinit_GS);
+  bool use_weights = as<bool>(Ruse_weights);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+
+  string err;
+  sens_analysis<bilan_fcd*> sens;
+  try {
+    sens.set_functoid(&bil->fcd);
+    sens.set(method, sample_count, levels, seed, crit, weight_BF, use_weights, init_GS, n_threads);
+    sens.analyze();
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: " + error.descr;
+  }
+  if (!err.empty())
+    return wrap(err);
+
+  unsigned par_count = sens.get_par_count(), eval_count = sens.get_eval_count();
+  vector<string> par_names(par_count);
+  for (unsigned p = 0; p < par_count; p++)
+    par_names[p] = bil->fcd.get_param_name(p);
+
+  List indices;
+  indices.push_back(par_names, "param");
+  vector<double> tmp_index(par_count);
+  for (unsigned i = 0; i < sens.get_index_count(); i++) {
+    for (unsigned p = 0; p < par_count; p++)
+      tmp_index[p] = sens.get_index(p, i);
+    indices.push_back(tmp_index, sens.get_index_name(i));
+  }
+
+  double **evals = sens.get_evals();
+  List tmp_evals;
+  for (unsigned p = 0; p <= par_count; p++)
+    tmp_evals.push_back(vector<double>(evals[p], evals[p] + eval_count), p < par_count ? par_names[p] : "crit");
+
+  return List::create(Named("indices") = as<DataFrame>(indices), Named("evals") = as<DataFrame>(tmp_evals));
+}
+
+RcppExport SEXP monte_carlo(SEXP model_ptr, SEXP Rsample_count, SEXP Rseed, SEXP Rthreshold, SEXP Rprobs, SEXP Rout_file, SEXP Rcrit, SEXP Rweight_BF, SEXP Rinit_GS, SEXP Ruse_weights, SEXP Rn_threads)
+{
+  XPtr<bilan> bil(model_ptr);
+
+  unsigned long sample_count = as<unsigned long>(Rsample_count);
+  int seed = as<int>(Rseed);
+  double threshold = as<double>(Rthreshold);
+  vector<double> probs = as<vector<double> >(Rprobs);
+  string out_file = as<string>(Rout_file);
+  unsigned crit = as<unsigned>(Rcrit);
+  double weight_BF = as<double>(Rweight_BF);
+  long double init_GS = as<long double>(Rinit_GS);
+  bool use_weights = as<bool>(Ruse_weights);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+
+  string err;
+  mc_analysis<bilan_fcd*> mc;
+  try {
+    mc.set_functoid(&bil->fcd);
+    mc.set(sample_count, seed, !ISNAN(threshold), threshold, probs, out_file, crit, weight_BF, use_weights, init_GS, n_threads);
+    mc.analyze();
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: " + error.descr;
+  }
+  if (!err.empty())
+    return wrap(err);
+
+  unsigned par_count = mc.get_par_count();
+  const vector<double> &best_model = mc.get_best();
+  List best;
+  for (unsigned p = 0; p <= par_count; p++)
+    best.push_back(best_model[p], p < par_count ? bil->fcd.get_param_name(p) : "crit");
+
+  const bil_quantile_bands &bands = mc.get_bands();
+  List tmp_bands;
+  vector<double> tmp_quant(bil->time_steps);
+  for (unsigned pr = 0; pr < probs.size(); pr++) {
+    for (unsigned ts = 0; ts < tmp_quant.size(); ts++)
+      tmp_quant[ts] = bands.get(ts, pr);
+    ostringstream name;
+    name << "Q" << probs[pr];
+    tmp_bands.push_back(tmp_quant, name.str());
+  }
+
+  return List::create(Named("sample_count") = static_cast<double>(sample_count), Named("behavioral") = static_cast<double>(mc.get_behav_count()),
+    Named("best") = best, Named("bands") = as<DataFrame>(tmp_bands));
+}
+
+RcppExport SEXP ens_bands(SEXP model_ptr, SEXP Rparams, SEXP Rvars, SEXP Rprobs, SEXP Rinit_GS, SEXP Rn_threads)
+{
+  XPtr<bilan> bil(model_ptr);
+
+  List params(Rparams);
+  vector<string> var_names = as<vector<string> >(Rvars);
+  vector<double> probs = as<vector<double> >(Rprobs);
+  long double init_GS = as<long double>(Rinit_GS);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+
+  string err;
+  vector<unsigned> out_vars;
+  for (unsigned vn = 0; vn < var_names.size() && err.empty(); vn++) {
+    unsigned v;
+    for (v = 0; v < bil->var_count; v++) {
+      if (bil->get_var_name(v) == var_names[vn])
+        break;
+    }
+    if (v == bil->var_count || !bilan::is_output_var(v))
+      err = "\n*** Bilan error: Variable " + var_names[vn] + " is not an output of the model.";
+    out_vars.push_back(v);
+  }
+  if (!err.empty())
+    return wrap(err);
+  if (static_cast<unsigned>(params.size()) != bil->par_count)
+    return wrap("\n*** Bilan error: Number of parameters does not match the model.");
+
+  vector<vector<double> > models(bil->par_count);
+  vector<double*> model_rows(bil->par_count);
+  for (unsigned p = 0; p < bil->par_count; p++) {
+    models[p] = as<vector<double> >(params[p]);
+    model_rows[p] = models[p].empty() ? 0 : &models[p][0];
+  }
+  unsigned ens_count = models.empty() ? 0 : models[0].size();
+
+  ens_simulation<bilan_fcd*> ens;
+  try {
+    ens.set_functoid(&bil->fcd);
+    ens.set(out_vars, probs, init_GS, n_threads);
+    ens.simulate(&model_rows[0], ens_count);
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: " + error.descr;
+  }
+  if (!err.empty())
+    return wrap(err);
+
+  List bands;
+  vector<double> tmp_quant(bil->time_steps);
+  for (unsigned out = 0; out < out_vars.size(); out++) {
+    for (unsigned pr = 0; pr < probs.size(); pr++) {
+      for (unsigned ts = 0; ts < bil->time_steps; ts++)
+        tmp_quant[ts] = ens.get_bands(out).get(ts, pr);
+      ostringstream name;
+      name << var_names[out] << ".Q" << probs[pr];
+      bands.push_back(tmp_quant, name.str());
+    }
+  }
+  return as<DataFrame>(bands);
+}
+
 RcppExport SEXP get_params(SEXP model_ptr)
 {
   XPtr<bilan> bil(model_ptr);
@@ -455,7 +803,7 @@ RcppExport SEXP get_vars(SEXP model_ptr, SEXP Rget_chars)
         if (bil->is_value_na(ts, v))
           tmp_var[ts] = NA_REAL;
         else
-          tmp_var[ts] = bil->var[ts][v];
+          tmp_var[ts] = bil->var[v][ts];
       }
       vars.push_back(tmp_var, bil->get_var_name(v));
     }
@@ -577,9 +925,10 @@ RcppExport SEXP get_ens_resul(SEXP model_ptr)
   if (ensem_resul == 0) { //gradient
     return wrap(0);
   }
-  else { //differential evolution
-    unsigned dim = bil->optim->par_count+ 2;
+  else { //differential evolution or Pareto front of multi-objective optimization
+    unsigned dim = bil->optim->par_count+ 3;
     unsigned ens_count = bil->optim->get_ens_count();
+    bool is_MO = bil->optim->get_type() == optimizer_gen<bilan_fcd*>::MO;
 
     List ens_resul;
     vector<double> tmp_ens_resul(ens_count);
@@ -588,13 +937,15 @@ RcppExport SEXP get_ens_resul(SEXP model_ptr)
       for (unsigned ens = 0; ens < ens_count; ens++) {
         tmp_ens_resul[ens] = ensem_resul[ens][d];
       }
-      if (d == dim - 2) {
+      if (d == dim - 3) {
         ostringstream os;
         os << "OF" << bil->optim->crit_type;
         tmp_name = os.str();
       }
+      else if (d == dim - 2)
+        tmp_name = is_MO ? "BF" : "evals";
       else if (d == dim - 1)
-        tmp_name = "evals";
+        tmp_name = is_MO ? "evals" : "stop";
       else
         tmp_name = bil->get_param_name(d);
 
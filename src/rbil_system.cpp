@@ -92,7 +92,7 @@ RcppExport SEXP sbil_get_optim(SEXP system_ptr)
   return wrap(sett);
 }
 
-RcppExport SEXP sbil_set_optim(SEXP system_ptr, SEXP Rcrit_part1, SEXP Rcrit_part2, SEXP Rweight_BF, SEXP Rmax_iter, SEXP Rinit_GS, SEXP Ruse_weights)
+RcppExport SEXP sbil_set_optim(SEXP system_ptr, SEXP Rcrit_part1, SEXP Rcrit_part2, SEXP Rweight_BF, SEXP Rmax_iter, SEXP Rinit_GS, SEXP Ruse_weights, SEXP Rn_threads, SEXP Rprobes, SEXP Rcache_size)
 {
   XPtr<bil_system> sbil(system_ptr);
 
@@ -102,6 +102,9 @@ RcppExport SEXP sbil_set_optim(SEXP system_ptr, SEXP Rcrit_part1, SEXP Rcrit_par
   unsigned max_iter = as<unsigned>(Rmax_iter);
   long double init_GS = as<long double>(Rinit_GS);
   bool use_weights = as<bool>(Ruse_weights);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+  unsigned probes = as<unsigned>(Rprobes);
+  unsigned cache_size = as<unsigned>(Rcache_size);
 
   string err = "";
   try {
@@ -109,6 +112,9 @@ RcppExport SEXP sbil_set_optim(SEXP system_ptr, SEXP Rcrit_part1, SEXP Rcrit_par
     optimizer<bilsys_fcd*> tmp_optim;
     tmp_optim.set_functoid(&sbil->fcd);
     tmp_optim.set(crit_part1, crit_part2, weight_BF, use_weights, max_iter, init_GS);
+    tmp_optim.set_n_threads(n_threads);
+    tmp_optim.set_probes(probes);
+    tmp_optim.set_cache_size(cache_size);
     sbil->optim = new optimizer<bilsys_fcd*>();
     *(sbil->optim) = tmp_optim;
   }
@@ -121,7 +127,7 @@ RcppExport SEXP sbil_set_optim(SEXP system_ptr, SEXP Rcrit_part1, SEXP Rcrit_par
   return wrap(err);
 }
 
-RcppExport SEXP sbil_set_DE_optim(SEXP system_ptr, SEXP Rcrit, SEXP RDE_type, SEXP Rn_comp, SEXP Rcomp_size, SEXP Rcross, SEXP Rmutat_f, SEXP Rmutat_k,SEXP Rmaxn_shuffles, SEXP Rn_gen_comp, SEXP Rens_count, SEXP Rseed, SEXP Rweight_BF, SEXP Rinit_GS, SEXP Ruse_weights)
+RcppExport SEXP sbil_set_DE_optim(SEXP system_ptr, SEXP Rcrit, SEXP RDE_type, SEXP Rn_comp, SEXP Rcomp_size, SEXP Rcross, SEXP Rmutat_f, SEXP Rmutat_k,SEXP Rmaxn_shuffles, SEXP Rn_gen_comp, SEXP Rens_count, SEXP Rseed, SEXP Rweight_BF, SEXP Rinit_GS, SEXP Ruse_weights, SEXP Rn_threads, SEXP Rparallel_comp, SEXP Rgenerational, SEXP Rcheckpoint_file, SEXP Rresume, SEXP Rstop_shuffles, SEXP Rstop_improv, SEXP Rstop_spread, SEXP Rmax_eval, SEXP Rbound_handling, SEXP Rsurrogate, SEXP Rsurrogate_factor, SEXP Rsurrogate_size)
 {
   XPtr<bil_system> sbil(system_ptr);
 
@@ -139,6 +145,19 @@ RcppExport SEXP sbil_set_DE_optim(SEXP system_ptr, SEXP Rcrit, SEXP RDE_type, SE
   double weight_BF = as<double>(Rweight_BF);
   long double init_GS = as<long double>(Rinit_GS);
   bool use_weights = as<bool>(Ruse_weights);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+  bool parallel_comp = as<bool>(Rparallel_comp);
+  bool generational = as<bool>(Rgenerational);
+  string checkpoint_file = as<string>(Rcheckpoint_file);
+  bool resume = as<bool>(Rresume);
+  unsigned stop_shuffles = as<unsigned>(Rstop_shuffles);
+  double stop_improv = as<double>(Rstop_improv);
+  double stop_spread = as<double>(Rstop_spread);
+  unsigned max_eval = as<unsigned>(Rmax_eval);
+  unsigned bound_handling = as<unsigned>(Rbound_handling);
+  bool surrogate = as<bool>(Rsurrogate);
+  double surrogate_factor = as<double>(Rsurrogate_factor);
+  unsigned surrogate_size = as<unsigned>(Rsurrogate_size);
 
   string err = "";
   try {
@@ -146,6 +165,13 @@ RcppExport SEXP sbil_set_DE_optim(SEXP system_ptr, SEXP Rcrit, SEXP RDE_type, SE
     DE_optim<bilsys_fcd*> tmp_optim;
     tmp_optim.set_functoid(&sbil->fcd);
     tmp_optim.set(crit, DE_type, n_comp, comp_size, cross, mutat_f, mutat_k, maxn_shuffles, n_gen_comp, ens_count, seed, weight_BF, use_weights, init_GS);
+    tmp_optim.set_n_threads(n_threads);
+    tmp_optim.set_parallel_comp(parallel_comp);
+    tmp_optim.set_generational(generational);
+    tmp_optim.set_checkpoint(checkpoint_file, resume);
+    tmp_optim.set_stopping(stop_shuffles, stop_improv, stop_spread, max_eval);
+    tmp_optim.set_bound_handling(bound_handling);
+    tmp_optim.set_surrogate(surrogate, surrogate_factor, surrogate_size);
     sbil->optim = new DE_optim<bilsys_fcd*>();
     *(sbil->optim) = tmp_optim;
   }
@@ -158,6 +184,93 @@ RcppExport SEXP sbil_set_DE_optim(SEXP system_ptr, SEXP Rcrit, SEXP RDE_type, SE
   return wrap(err);
 }
 
+RcppExport SEXP sbil_set_MO_optim(SEXP system_ptr, SEXP Rcrit, SEXP Rpopul_size, SEXP Rn_gen, SEXP Rcross, SEXP Rmutat_f, SEXP Rseed, SEXP Rweight_BF, SEXP Rinit_GS, SEXP Ruse_weights, SEXP Rn_threads)
+{
+  XPtr<bil_system> sbil(system_ptr);
+
+  unsigned crit = as<unsigned>(Rcrit);
+  unsigned popul_size = as<unsigned>(Rpopul_size);
+  unsigned n_gen = as<unsigned>(Rn_gen);
+  double cross = as<double>(Rcross);
+  double mutat_f = as<double>(Rmutat_f);
+  int seed = as<int>(Rseed);
+  double weight_BF = as<double>(Rweight_BF);
+  long double init_GS = as<long double>(Rinit_GS);
+  bool use_weights = as<bool>(Ruse_weights);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+
+  string err = "";
+  try {
+    delete sbil->optim;
+    MO_optim<bilsys_fcd*> tmp_optim;
+    tmp_optim.set_functoid(&sbil->fcd);
+    tmp_optim.set(crit, popul_size, n_gen, cross, mutat_f, seed, weight_BF, use_weights, init_GS);
+    tmp_optim.set_n_threads(n_threads);
+    sbil->optim = new MO_optim<bilsys_fcd*>();
+    *(sbil->optim) = tmp_optim;
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: Optimization was not set - " + error.descr;
+  }
+  return wrap(err);
+}
+
+RcppExport SEXP sbil_sensitivity(SEXP system_ptr, SEXP Rmethod, SEXP Rsample_count, SEXP Rlevels, SEXP Rseed, SEXP Rcrit, SEXP Rweight_BF, SEXP Rinit_GS, SEXP Ruse_weights, SEXP Rn_threads)
+{
+  XPtr<bil_system> sbil(system_ptr);
+
+  unsigned method = as<unsigned>(Rmethod);
+  unsigned sample_count = as<unsigned>(Rsample_count);
+  unsigned levels = as<unsigned>(Rlevels);
+  int seed = as<int>(Rseed);
+  unsigned crit = as<unsigned>(Rcrit);
+  double weight_BF = as<double>(Rweight_BF);
+  long double init_GS = as<long double>(Rinit_GS);
+  bool use_weights = as<bool>(Ruse_weights);
+  unsigned n_threads = as<unsigned>(Rn_threads);
+
+  string err;
+  sens_analysis<bilsys_fcd*> sens;
+  try {
+    sbil->prepare_opt();
+    sens.set_functoid(&sbil->fcd);
+    sens.set(method, sample_count, levels, seed, crit, weight_BF, use_weights, init_GS, n_threads);
+    sens.analyze();
+  }
+  catch (std::exception &exc) {
+    err = exc.what();
+  }
+  catch (bil_err &error) {
+    err = "\n*** Bilan error: " + error.descr;
+  }
+  if (!err.empty())
+    return wrap(err);
+
+  unsigned par_count = sens.get_par_count(), eval_count = sens.get_eval_count();
+  vector<string> par_names(par_count);
+  for (unsigned p = 0; p < par_count; p++)
+    par_names[p] = sbil->fcd.get_param_name(p);
+
+  List indices;
+  indices.push_back(par_names, "param");
+  vector<double> tmp_index(par_count);
+  for (unsigned i = 0; i < sens.get_index_count(); i++) {
+    for (unsigned p = 0; p < par_count; p++)
+      tmp_index[p] = sens.get_index(p, i);
+    indices.push_back(tmp_index, sens.get_index_name(i));
+  }
+
+  double **evals = sens.get_evals();
+  List tmp_evals;
+  for (unsigned p = 0; p <= par_count; p++)
+    tmp_evals.push_back(vector<double>(evals[p], evals[p] + eval_count), p < par_count ? par_names[p] : "crit");
+
+  return List::create(Named("indices") = as<DataFrame>(indices), Named("evals") = as<DataFrame>(tmp_evals));
+}
+
 RcppExport SEXP sbil_run(SEXP system_ptr, SEXP Rinit_GS)
 {
   XPtr<bil_system> sbil(system_ptr);